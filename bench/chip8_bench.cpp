@@ -0,0 +1,485 @@
+/**
+ * The benchmark suite: microbenchmarks of the interpreter's building blocks, and every bundled ROM run headlessly on
+ * every execution engine, as run/<engine>/<ROM>.
+ *
+ * Results go to stdout (or --out) as JSON, see chip8::bench::write_json(), and a readable summary goes to stderr.
+ * Where the host lets us read its hardware performance counters, results include them as perf_* metrics.
+ *
+ * Usage: chip8_bench [--filter=SUBSTRING] [--out=FILE] [--roms=DIRECTORY] [--frames=N] [--ipf=N]
+ *                    [--min-time-ms=N] [--repetitions=N]
+ */
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <libgen.h>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include "harness.hpp"
+
+#include "cpu.hpp"
+#include "decode.hpp"
+#include "decodecache.hpp"
+#include "files.hpp"
+#include "framestream.hpp"
+#include "machine.hpp"
+#include "perfcounters.hpp"
+#include "rom.hpp"
+#include "runner.hpp"
+#include "sharedstate.hpp"
+#include "upscaler.hpp"
+
+#ifdef CHIP8_BUILD_ID_HEADER
+#include CHIP8_BUILD_ID_HEADER
+#endif
+
+#ifndef CHIP8_BUILD_ID
+#define CHIP8_BUILD_ID "unknown"
+#endif
+
+CHIP8_BENCH_COUNT_ALLOCATIONS
+
+namespace {
+    struct Options {
+        std::string filter;
+        std::string out;
+        std::string roms{"data/games"};
+        uint64_t frames{600};
+        unsigned instructionsPerFrame{10};
+        chip8::bench::Settings settings;
+    };
+
+    // Fixed so that runs are comparable
+    const uint32_t BENCH_SEED{0xC0FFEE};
+
+    /**
+     * One opcode for every instruction, with operands chosen so that repeating it forever is harmless.
+     */
+    struct Kernel {
+        const char *name;
+        uint16_t opcode;
+    };
+
+    const Kernel EXECUTE_KERNELS[] = {
+        {"CLS", 0x00E0},
+        {"RET", 0x00EE},
+        {"JMP", 0x1200},
+        {"CALL", 0x2300},
+        {"SKE_imm", 0x3105},
+        {"SKNE_imm", 0x4105},
+        {"SKE_reg", 0x5120},
+        {"MOV_imm", 0x6105},
+        {"INC", 0x7105},
+        {"MOV_reg", 0x8120},
+        {"OR", 0x8121},
+        {"AND", 0x8122},
+        {"XOR", 0x8123},
+        {"ADD", 0x8124},
+        {"SUB", 0x8125},
+        {"SHR", 0x8126},
+        {"SUBN", 0x8127},
+        {"SHL", 0x812E},
+        {"SKNE_reg", 0x9120},
+        {"LOADI", 0xA300},
+        {"JMPI", 0xB300},
+        {"RND", 0xC10F},
+        {"DRW_8x1", 0xD121},
+        {"DRW_8x15", 0xD12F},
+        {"SKP", 0xE19E},
+        {"SKNP", 0xE1A1},
+        {"MOVED", 0xF107},
+        {"KEYD", 0xF10A},
+        {"LOADD", 0xF115},
+        {"LOADS", 0xF118},
+        {"ADDI", 0xF11E},
+        {"LDSPR", 0xF129},
+        {"BCD", 0xF133},
+        {"STOR", 0xF155},
+        {"READ", 0xF165},
+    };
+
+    bool parse_options(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg{argv[i]};
+
+            if (arg.compare(0, 9, "--filter=") == 0) {
+                options.filter = arg.substr(9);
+            } else if (arg.compare(0, 6, "--out=") == 0) {
+                options.out = arg.substr(6);
+            } else if (arg.compare(0, 7, "--roms=") == 0) {
+                options.roms = arg.substr(7);
+            } else if (arg.compare(0, 9, "--frames=") == 0) {
+                options.frames = std::strtoull(arg.c_str() + 9, nullptr, 10);
+            } else if (arg.compare(0, 6, "--ipf=") == 0) {
+                options.instructionsPerFrame = static_cast<unsigned>(std::strtoul(arg.c_str() + 6, nullptr, 10));
+            } else if (arg.compare(0, 14, "--min-time-ms=") == 0) {
+                options.settings.minTime = std::chrono::milliseconds(std::strtoul(arg.c_str() + 14, nullptr, 10));
+            } else if (arg.compare(0, 14, "--repetitions=") == 0) {
+                options.settings.repetitions = static_cast<unsigned>(std::strtoul(arg.c_str() + 14, nullptr, 10));
+            } else {
+                return false;
+            }
+        }
+
+        return options.frames > 0 && options.instructionsPerFrame > 0;
+    }
+
+    class Suite {
+    public:
+        explicit Suite(const Options &options)
+            : mOptions(options)
+        {
+        }
+
+        bool wants(const std::string &name) const {
+            return mOptions.filter.empty() || name.find(mOptions.filter) != std::string::npos;
+        }
+
+        template <typename Body>
+        void micro(const std::string &name, Body body) {
+            if (wants(name)) {
+                report(chip8::bench::measure(name, mOptions.settings, body));
+            }
+        }
+
+        void report(chip8::bench::Result result) {
+            std::cerr << std::left << std::setw(32) << result.name << std::right;
+            if (!result.error.empty()) {
+                std::cerr << " error: " << result.error;
+            } else if (result.kind == "micro") {
+                std::cerr << std::fixed << std::setprecision(2)
+                          << std::setw(12) << result.get("ns_per_op") << " ns/op"
+                          << std::setw(10) << result.get("allocations_per_op") << " allocs/op";
+            } else {
+                std::cerr << std::fixed << std::setprecision(2)
+                          << std::setw(12) << result.get("instructions_per_second") / 1e6 << " MIPS"
+                          << std::setw(12) << result.get("ns_per_frame") << " ns/frame"
+                          << std::setw(10) << result.get("allocations_per_frame") << " allocs/frame";
+                if (result.get("perf_cycles_per_instruction") > 0) {
+                    std::cerr << std::setw(10) << result.get("perf_cycles_per_instruction") << " cycles/insn"
+                              << std::setw(10) << result.get("perf_branch_misses_per_instruction")
+                              << " branch-misses/insn";
+                }
+            }
+            std::cerr << std::endl;
+
+            mResults.push_back(std::move(result));
+        }
+
+        const std::vector<chip8::bench::Result> &results() const {
+            return mResults;
+        }
+
+    private:
+        const Options &mOptions;
+        std::vector<chip8::bench::Result> mResults;
+    };
+
+    void decode_benchmarks(Suite &suite) {
+        std::vector<uint16_t> opcodes;
+        for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++) {
+            if (chip8::is_valid_opcode(static_cast<uint16_t>(opcode))) {
+                opcodes.push_back(static_cast<uint16_t>(opcode));
+            }
+        }
+
+        std::size_t next{0};
+        suite.micro("decode_opcode", [&opcodes, &next]() {
+            auto instruction = chip8::decode_opcode(opcodes[next++ % opcodes.size()]);
+            chip8::bench::do_not_optimize(instruction.get());
+        });
+
+        suite.micro("is_valid_opcode", [&next]() {
+            chip8::bench::do_not_optimize(chip8::is_valid_opcode(static_cast<uint16_t>(next++)));
+        });
+
+        chip8::cpu_t cpu;
+        cpu.reset();
+        cpu.memory.write(0x200, 0x61);
+        cpu.memory.write(0x201, 0x05);
+        chip8::DecodeCache cache;
+        suite.micro("decode_cache/fetch", [&cpu, &cache]() {
+            chip8::bench::do_not_optimize(cache.fetch(cpu));
+        });
+    }
+
+    void execute_benchmarks(Suite &suite) {
+        chip8::cpu_t cpu;
+        cpu.reset();
+        for (uint8_t i = 0; i < chip8::REGISTER_COUNT; i++) {
+            cpu.V[i] = static_cast<uint8_t>(3 * i + 7);
+        }
+
+        // Something to draw, and a key held so that KEYD doesn't wait
+        for (uint16_t i = 0; i < 16; i++) {
+            cpu.memory.write(0x300 + i, static_cast<uint8_t>(0xA5 ^ (i * 17)));
+        }
+        cpu.keys = 1 << 5;
+
+        for (const Kernel &kernel : EXECUTE_KERNELS) {
+            std::string name{std::string("execute/") + kernel.name};
+            std::unique_ptr<chip8::Instruction> instruction = chip8::decode_opcode(kernel.opcode);
+            if (!instruction) {
+                std::cerr << name << ": 0x" << std::hex << kernel.opcode << std::dec << " doesn't decode" << std::endl;
+                continue;
+            }
+
+            bool calls = (kernel.opcode & 0xF000) == 0x2000;
+            bool returns = kernel.opcode == 0x00EE;
+            const chip8::Instruction &execute = *instruction;
+            suite.micro(name, [&cpu, &execute, calls, returns]() {
+                cpu.pc = 0x200;
+                cpu.I = 0x300;
+                if (returns) {
+                    cpu.stack.push(0x200);
+                }
+
+                execute.execute(cpu);
+
+                if (calls) {
+                    cpu.stack.pop();
+                }
+                chip8::bench::do_not_optimize(cpu.pc);
+            });
+        }
+
+        // Sprites that straddle the right and bottom edges take the wrapping path
+        cpu.V[1] = 60;
+        cpu.V[2] = 25;
+        chip8::DrawSpriteInstruction wrapping{1, 2, 15};
+        suite.micro("execute/DRW_8x15_wrapping", [&cpu, &wrapping]() {
+            cpu.I = 0x300;
+            wrapping.execute(cpu);
+            chip8::bench::do_not_optimize(cpu.V[15]);
+        });
+    }
+
+    /**
+     * What exporting every frame to shared memory costs the machine, and what reading it costs a consumer. The segment
+     * is only made if one of them is wanted, and if it can't be, that is their result.
+     */
+    void shared_state_benchmarks(Suite &suite, const chip8::Machine &running) {
+        const std::string names[] = {"sharedstate/publish", "sharedstate/read"};
+        if (!suite.wants(names[0]) && !suite.wants(names[1])) {
+            return;
+        }
+
+        std::unique_ptr<chip8::SharedStateWriter> shared;
+        std::unique_ptr<chip8::SharedStateReader> sharedReader;
+        try {
+            shared.reset(new chip8::SharedStateWriter("/chip8_bench_" + std::to_string(::getpid())));
+            sharedReader.reset(new chip8::SharedStateReader(shared->name()));
+        } catch (const std::system_error &e) {
+            for (const std::string &name : names) {
+                if (suite.wants(name)) {
+                    chip8::bench::Result result{name, "micro", {}, {}};
+                    result.error = e.what();
+                    suite.report(result);
+                }
+            }
+            return;
+        }
+
+        uint64_t sharedFrame{0};
+        suite.micro(names[0], [&shared, &running, &sharedFrame]() {
+            shared->publish(running.cpu(), ++sharedFrame);
+        });
+
+        chip8::SharedSnapshot snapshot{};
+        suite.micro(names[1], [&sharedReader, &snapshot]() {
+            sharedReader->read(snapshot);
+            chip8::bench::do_not_optimize(snapshot.frame);
+        });
+    }
+
+    void machine_benchmarks(Suite &suite, const std::string &romPath) {
+        std::shared_ptr<const chip8::Rom> rom;
+        try {
+            rom = chip8::load_rom(romPath);
+        } catch (const std::exception &e) {
+            std::cerr << "Skipping ROM and snapshot benchmarks: " << e.what() << std::endl;
+            return;
+        }
+
+        suite.micro("rom/load_rom", [&romPath]() {
+            chip8::bench::do_not_optimize(chip8::load_rom(romPath).get());
+        });
+
+        suite.micro("rom/make_rom", [&rom]() {
+            chip8::bench::do_not_optimize(chip8::make_rom(rom->bytes.data(), rom->bytes.size(), "bench").get());
+        });
+
+        // Keeps the ROM's shared code alive, as a running session would
+        chip8::Machine holder;
+        holder.loadProgram(*rom);
+
+        chip8::Machine machine;
+        suite.micro("machine/load_program", [&machine, &rom]() {
+            machine.loadProgram(*rom);
+        });
+
+        suite.micro("machine/load_program_unshared", [&machine, &rom]() {
+            machine.loadProgram(rom->bytes.data(), rom->bytes.size());
+        });
+
+        suite.micro("machine/reset", [&machine]() {
+            machine.reset();
+        });
+
+        chip8::cpu_t cpu;
+        suite.micro("cpu/reset", [&cpu]() {
+            cpu.reset();
+            chip8::bench::do_not_optimize(cpu.pc);
+        });
+
+        // A snapshot of a game in progress, with the pages it has written to
+        chip8::Machine running;
+        running.loadProgram(*rom);
+        running.seed(BENCH_SEED);
+        chip8::RunLimits limits;
+        limits.frames = 300;
+        chip8::RunStats stats;
+        try {
+            chip8::run(running, limits, chip8::Movie(), stats);
+        } catch (const chip8::MachineError &) {
+        }
+
+        chip8::cpu_t restored{running.cpu()};
+        suite.micro("snapshot/cpu_restore", [&restored, &running]() {
+            restored = running.cpu();
+            chip8::bench::do_not_optimize(restored.pc);
+        });
+
+        suite.micro("snapshot/cpu_copy", [&running]() {
+            chip8::cpu_t copy{running.cpu()};
+            chip8::bench::do_not_optimize(copy.pc);
+        });
+
+        chip8::Machine restoredMachine{running};
+        suite.micro("snapshot/machine_restore", [&restoredMachine, &running]() {
+            restoredMachine = running;
+        });
+
+        suite.micro("framebuffer/hash", [&running]() {
+            chip8::bench::do_not_optimize(running.cpu().fb.hash());
+        });
+
+        // What a streaming deployment pays to turn every frame it sends into an image
+        for (chip8::PixelFormat format : {chip8::PixelFormat::rgba8, chip8::PixelFormat::gray8}) {
+            for (chip8::SimdKernel kernel : {chip8::SimdKernel::scalar, chip8::SimdKernel::sse2,
+                                             chip8::SimdKernel::avx2}) {
+                if (!chip8::kernel_supported(kernel)) {
+                    continue;
+                }
+
+                chip8::Upscaler upscaler{8, format, chip8::Palette(), kernel};
+                std::vector<uint8_t> image(upscaler.size());
+                suite.micro(std::string("upscale/") + chip8::format_name(format) + "/" + chip8::kernel_name(kernel)
+                            + "/x8", [&running, &upscaler, &image]() {
+                    upscaler.convert(running.cpu().fb, image.data());
+                    chip8::bench::do_not_optimize(image.data());
+                });
+            }
+        }
+
+        // What streaming every frame costs the machine's thread: deltas between two frames a few frames apart, and
+        // the same frame as a keyframe
+        chip8::Machine later{running};
+        limits.frames = 5;
+        try {
+            chip8::run(later, limits, chip8::Movie(), stats);
+        } catch (const chip8::MachineError &) {
+        }
+
+        chip8::FrameEncoder deltas;
+        uint8_t record[chip8::MAX_FRAME_RECORD];
+        const chip8::FrameBuffer *frames[] = {&running.cpu().fb, &later.cpu().fb};
+        std::size_t next{0};
+        suite.micro("stream/encode_delta", [&deltas, &record, &frames, &next]() {
+            chip8::bench::do_not_optimize(deltas.encode(*frames[next], record));
+            next ^= 1;
+        });
+
+        chip8::FrameEncoder keyframes{1};
+        suite.micro("stream/encode_keyframe", [&keyframes, &record, &running]() {
+            chip8::bench::do_not_optimize(keyframes.encode(running.cpu().fb, record));
+        });
+
+        shared_state_benchmarks(suite, running);
+    }
+
+    void rom_benchmarks(Suite &suite, const Options &options) {
+        chip8::RunLimits limits;
+        limits.frames = options.frames;
+        limits.instructionsPerFrame = options.instructionsPerFrame;
+
+        for (const std::string &path : chip8::list_roms(options.roms)) {
+            std::string romName{basename(const_cast<char *>(path.c_str()))};
+
+            std::shared_ptr<const chip8::Rom> rom;
+            std::string error;
+            try {
+                rom = chip8::load_rom(path);
+            } catch (const std::exception &e) {
+                error = e.what();
+            }
+
+            for (chip8::Engine engine : {chip8::Engine::cached, chip8::Engine::decode}) {
+                std::string name{std::string("run/") + chip8::engine_name(engine) + "/" + romName};
+                if (!suite.wants(name)) {
+                    continue;
+                }
+
+                if (!rom) {
+                    chip8::bench::Result result{name, "rom", {}, {}};
+                    result.error = error;
+                    suite.report(result);
+                    continue;
+                }
+
+                suite.report(chip8::bench::measure_rom(name, options.settings, *rom, limits, chip8::Movie(),
+                                                       BENCH_SEED, engine));
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: " << basename(argv[0])
+                  << " [--filter=SUBSTRING] [--out=FILE] [--roms=DIRECTORY] [--frames=N] [--ipf=N]"
+                  << " [--min-time-ms=N] [--repetitions=N]" << std::endl;
+        return 1;
+    }
+
+    chip8::PerfCounters counters;
+    if (!counters.available()) {
+        std::cerr << "No hardware performance counters (" << counters.error() << "), reporting wall-clock time only"
+                  << std::endl;
+    }
+
+    Suite suite{options};
+    decode_benchmarks(suite);
+    execute_benchmarks(suite);
+    machine_benchmarks(suite, options.roms + "/BLINKY");
+    rom_benchmarks(suite, options);
+
+    if (options.out.empty()) {
+        chip8::bench::write_json(std::cout, CHIP8_BUILD_ID, suite.results());
+    } else {
+        std::ofstream out{options.out};
+        chip8::bench::write_json(out, CHIP8_BUILD_ID, suite.results());
+        if (!out) {
+            std::cerr << "Unable to write " << options.out << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * Measures how many machines fit on a host and how fast a core can rotate through them.
+ *
+ * Loads the same ROM into N machines, reports the resident memory each one costs, then steps them round-robin (one
+ * instruction per machine per pass, so every step lands on a different machine's state) and reports the time per
+ * step. Then runs them all frame by frame on one Scheduler, where the sessions that have stopped or are waiting
+ * park, and reports the time per session per frame.
+ *
+ * Usage: density [--machines=N] [--passes=N] [ROM]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "machine.hpp"
+#include "rom.hpp"
+#include "scheduler.hpp"
+
+namespace {
+    std::size_t resident_bytes() {
+        std::ifstream statm{"/proc/self/statm"};
+        std::size_t size{0};
+        std::size_t resident{0};
+        statm >> size >> resident;
+        return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    }
+
+    bool parse_count(const std::string &arg, const std::string &name, std::size_t &value) {
+        if (arg.compare(0, name.size(), name) != 0) {
+            return false;
+        }
+        value = std::stoul(arg.substr(name.size()));
+        return true;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::size_t machineCount{10000};
+    std::size_t passes{200};
+    std::string path{"data/games/MAZE"};
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg{argv[i]};
+        if (!parse_count(arg, "--machines=", machineCount) && !parse_count(arg, "--passes=", passes)) {
+            path = arg;
+        }
+    }
+
+    std::shared_ptr<const chip8::Rom> rom;
+    try {
+        rom = chip8::load_rom(path);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::size_t residentBefore{resident_bytes()};
+
+    std::vector<std::unique_ptr<chip8::Machine>> machines;
+    machines.reserve(machineCount);
+    for (std::size_t i = 0; i < machineCount; i++) {
+        machines.emplace_back(new chip8::Machine());
+        machines.back()->loadProgram(*rom);
+    }
+
+    // Run every machine once so that whatever they allocate lazily is counted
+    for (auto &machine : machines) {
+        machine->step();
+    }
+
+    std::size_t residentAfter{resident_bytes()};
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t pass = 0; pass < passes; pass++) {
+        for (auto &machine : machines) {
+            machine->step();
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    double steps = static_cast<double>(machineCount) * passes;
+    double nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count();
+
+    chip8::Scheduler scheduler;
+    for (auto &machine : machines) {
+        scheduler.add(*machine);
+    }
+    start = std::chrono::steady_clock::now();
+    for (std::size_t pass = 0; pass < passes; pass++) {
+        scheduler.runFrame();
+    }
+    double scheduledNanoseconds = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "sizeof(cpu_t):       " << sizeof(chip8::cpu_t) << " bytes" << std::endl;
+    std::cout << "sizeof(Machine):     " << sizeof(chip8::Machine) << " bytes" << std::endl;
+    std::cout << "resident/machine:    " << (residentAfter - residentBefore) / machineCount << " bytes" << std::endl;
+    std::cout << "machines:            " << machineCount << std::endl;
+    std::cout << "round-robin step:    " << nanoseconds / steps << " ns" << std::endl;
+    std::cout << "scheduled frame:     " << scheduledNanoseconds / steps << " ns per session" << std::endl;
+    std::cout << "parked frames:       " << scheduler.stats().framesParked << " of "
+              << scheduler.stats().framesParked + scheduler.stats().framesRun << std::endl;
+
+    return 0;
+}
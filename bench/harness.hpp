@@ -0,0 +1,399 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "machine.hpp"
+#include "movie.hpp"
+#include "perfcounters.hpp"
+#include "rom.hpp"
+#include "runner.hpp"
+
+namespace chip8 {
+    namespace bench {
+        /**
+         * Heap allocations made so far. Only counts in binaries that use CHIP8_BENCH_COUNT_ALLOCATIONS.
+         */
+        inline std::atomic<uint64_t> &allocation_count() {
+            static std::atomic<uint64_t> count{0};
+            return count;
+        }
+
+        /**
+         * Frees memory from CHIP8_BENCH_COUNT_ALLOCATIONS. Never inlined, so that the compiler doesn't take the free()
+         * in a replaced operator delete for a mismatch with operator new.
+         */
+        __attribute__((noinline)) inline void deallocate(void *pointer) noexcept {
+            std::free(pointer);
+        }
+
+        /**
+         * Keep the compiler from optimizing away a value that is computed only to be measured.
+         */
+        template <typename T>
+        inline void do_not_optimize(const T &value) {
+            asm volatile("" : : "r,m"(value) : "memory");
+        }
+
+        struct Settings {
+            // Each repetition of a microbenchmark runs for at least this long
+            std::chrono::nanoseconds minTime{std::chrono::milliseconds(50)};
+
+            // Reported numbers are the median over this many repetitions, so that a noisy neighbour on a shared
+            // host only spoils a run if it lasts for most of it
+            unsigned repetitions{5};
+        };
+
+        inline double median(std::vector<double> values) {
+            if (values.empty()) {
+                return 0;
+            }
+
+            std::sort(values.begin(), values.end());
+            std::size_t middle = values.size() / 2;
+            return values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+        }
+
+        /**
+         * The value below which fraction of the values fall, by nearest rank.
+         */
+        inline double percentile(std::vector<double> values, double fraction) {
+            if (values.empty()) {
+                return 0;
+            }
+
+            std::sort(values.begin(), values.end());
+            auto rank = static_cast<std::size_t>(fraction * static_cast<double>(values.size()));
+            return values[std::min(rank, values.size() - 1)];
+        }
+
+        /**
+         * The result of one benchmark. Metrics are named numbers, reported in the order they were added.
+         */
+        struct Result {
+            std::string name;
+            std::string kind;
+            std::vector<std::pair<std::string, double>> metrics;
+
+            // Set if the benchmark could not run to completion
+            std::string error;
+
+            void add(const std::string &metric, double value) {
+                metrics.emplace_back(metric, value);
+            }
+
+            double get(const std::string &metric) const {
+                for (const auto &entry : metrics) {
+                    if (entry.first == metric) {
+                        return entry.second;
+                    }
+                }
+                return 0;
+            }
+        };
+
+        /**
+         * Hardware counter samples over the repetitions of a benchmark, divided by the work each repetition did.
+         */
+        class CounterMedians {
+        public:
+            void add(const PerfSample &sample, double units) {
+                for (std::size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+                    if (sample.valid[i] && units > 0) {
+                        mPerUnit[i].push_back(static_cast<double>(sample.values[i]) / units);
+                    }
+                }
+            }
+
+            /**
+             * Add the median of every counter that was sampled to result, as perf_<counter>_per_<unit>.
+             */
+            void report(Result &result, const std::string &unit) const {
+                for (std::size_t i = 0; i < PERF_COUNTER_COUNT; i++) {
+                    if (!mPerUnit[i].empty()) {
+                        result.add(std::string("perf_") + PERF_COUNTER_NAMES[i] + "_per_" + unit, median(mPerUnit[i]));
+                    }
+                }
+            }
+
+        private:
+            std::array<std::vector<double>, PERF_COUNTER_COUNT> mPerUnit;
+        };
+
+        /**
+         * Time body() per call. The iteration count is calibrated so that each repetition runs for at least
+         * settings.minTime, and the median of the repetitions is reported as ns_per_op, along with the allocations
+         * each call makes and, where the host has them, hardware counters per call.
+         */
+        template <typename Body>
+        Result measure(const std::string &name, const Settings &settings, Body body) {
+            using clock = std::chrono::steady_clock;
+
+            auto timed = [&body](uint64_t iterations) {
+                auto start = clock::now();
+                for (uint64_t i = 0; i < iterations; i++) {
+                    body();
+                }
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+            };
+
+            // Grow the iteration count until a run takes long enough to time reliably
+            uint64_t iterations{1};
+            for (;;) {
+                auto elapsed = timed(iterations);
+                if (elapsed >= settings.minTime || iterations >= (uint64_t{1} << 40)) {
+                    break;
+                }
+
+                uint64_t grown = elapsed.count() > 0
+                                 ? iterations * settings.minTime.count() / elapsed.count() + 1
+                                 : iterations * 100;
+                iterations = std::max(iterations * 2, std::min(grown, iterations * 100));
+            }
+
+            PerfCounters counters;
+            CounterMedians counted;
+            std::vector<double> nanosecondsPerOp;
+            std::vector<double> allocationsPerOp;
+            for (unsigned repetition = 0; repetition < std::max(1u, settings.repetitions); repetition++) {
+                uint64_t allocationsBefore = allocation_count().load(std::memory_order_relaxed);
+                counters.start();
+                auto elapsed = timed(iterations);
+                counted.add(counters.stop(), static_cast<double>(iterations));
+                uint64_t allocations = allocation_count().load(std::memory_order_relaxed) - allocationsBefore;
+
+                nanosecondsPerOp.push_back(static_cast<double>(elapsed.count()) / iterations);
+                allocationsPerOp.push_back(static_cast<double>(allocations) / iterations);
+            }
+
+            Result result{name, "micro", {}, {}};
+            result.add("iterations", static_cast<double>(iterations));
+            result.add("ns_per_op", median(nanosecondsPerOp));
+            result.add("allocations_per_op", median(allocationsPerOp));
+            counted.report(result, "op");
+            return result;
+        }
+
+        /**
+         * Run a ROM headlessly from a fresh machine using engine, settings.repetitions times, and report the medians
+         * of its throughput (instructions_per_second, ns_per_frame), per-frame latency percentiles (p50_frame_ns,
+         * p99_frame_ns) and allocations_per_frame. Where the host has hardware counters, they are reported per
+         * emulated instruction too; elsewhere the wall-clock numbers are all there is.
+         *
+         * Loading the ROM is not part of the measurement, and an extra first run warms up the caches and is discarded.
+         */
+        inline Result measure_rom(const std::string &name, const Settings &settings, const Rom &rom,
+                                  const RunLimits &limits, const Movie &movie, uint32_t seed,
+                                  Engine engine = Engine::cached) {
+            using clock = std::chrono::steady_clock;
+
+            Result result{name, "rom", {}, {}};
+            std::vector<double> instructionsPerSecond;
+            std::vector<double> nanosecondsPerFrame;
+            std::vector<double> p50;
+            std::vector<double> p99;
+            std::vector<double> allocationsPerFrame;
+            PerfCounters counters;
+            CounterMedians counted;
+            RunStats stats;
+
+            std::vector<double> frameTimes;
+            frameTimes.reserve(limits.frames);
+
+            for (unsigned repetition = 0; repetition <= std::max(1u, settings.repetitions); repetition++) {
+                Machine machine;
+                machine.loadProgram(rom);
+                machine.seed(seed);
+                machine.setEngine(engine);
+
+                stats = RunStats();
+                frameTimes.clear();
+
+                uint64_t allocationsBefore = allocation_count().load(std::memory_order_relaxed);
+                counters.start();
+                auto start = clock::now();
+                auto frameStart = start;
+                try {
+                    run(machine, limits, movie, stats, [&frameTimes, &frameStart](uint64_t) {
+                        auto now = clock::now();
+                        frameTimes.push_back(std::chrono::duration<double, std::nano>(now - frameStart).count());
+                        frameStart = now;
+                        return true;
+                    });
+                } catch (const MachineError &e) {
+                    result.error = e.what();
+                    return result;
+                }
+                double elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+                PerfSample sample = counters.stop();
+                uint64_t allocations = allocation_count().load(std::memory_order_relaxed) - allocationsBefore;
+                if (repetition == 0) {
+                    continue;
+                }
+
+                double frames = std::max<double>(1, static_cast<double>(stats.frames));
+                instructionsPerSecond.push_back(elapsed > 0 ? stats.instructions / elapsed * 1e9 : 0);
+                nanosecondsPerFrame.push_back(elapsed / frames);
+                p50.push_back(percentile(frameTimes, 0.50));
+                p99.push_back(percentile(frameTimes, 0.99));
+                allocationsPerFrame.push_back(allocations / frames);
+                counted.add(sample, static_cast<double>(stats.instructions));
+            }
+
+            result.add("frames", static_cast<double>(stats.frames));
+            result.add("instructions", static_cast<double>(stats.instructions));
+            result.add("instructions_per_second", median(instructionsPerSecond));
+            result.add("ns_per_frame", median(nanosecondsPerFrame));
+            result.add("p50_frame_ns", median(p50));
+            result.add("p99_frame_ns", median(p99));
+            result.add("allocations_per_frame", median(allocationsPerFrame));
+            counted.report(result, "instruction");
+            return result;
+        }
+
+        inline void write_json_string(std::ostream &out, const std::string &value) {
+            out << '"';
+            for (char c : value) {
+                switch (c) {
+                    case '"':
+                        out << "\\\"";
+                        break;
+                    case '\\':
+                        out << "\\\\";
+                        break;
+                    case '\n':
+                        out << "\\n";
+                        break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            out << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xF] << "0123456789abcdef"[c & 0xF];
+                        } else {
+                            out << c;
+                        }
+                }
+            }
+            out << '"';
+        }
+
+        /**
+         * Write results as a JSON document that tools can diff across runs:
+         *
+         *   {"build": "...", "timestamp": 1700000000, "results": [
+         *     {"name": "decode_opcode", "kind": "micro", "metrics": {"ns_per_op": 3.1, ...}}, ...]}
+         */
+        inline void write_json(std::ostream &out, const std::string &build, const std::vector<Result> &results) {
+            auto timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+            auto precision = out.precision(10);
+            out << "{\n  \"build\": ";
+            write_json_string(out, build);
+            out << ",\n  \"timestamp\": " << timestamp << ",\n  \"results\": [";
+
+            for (std::size_t i = 0; i < results.size(); i++) {
+                out << (i == 0 ? "\n" : ",\n") << "    {\"name\": ";
+                write_json_string(out, results[i].name);
+                out << ", \"kind\": ";
+                write_json_string(out, results[i].kind);
+                out << ", \"metrics\": {";
+
+                const auto &metrics = results[i].metrics;
+                for (std::size_t m = 0; m < metrics.size(); m++) {
+                    out << (m == 0 ? "" : ", ");
+                    write_json_string(out, metrics[m].first);
+                    out << ": " << metrics[m].second;
+                }
+                out << "}";
+
+                if (!results[i].error.empty()) {
+                    out << ", \"error\": ";
+                    write_json_string(out, results[i].error);
+                }
+                out << "}";
+            }
+
+            out << "\n  ]\n}\n";
+            out.precision(precision);
+        }
+    }
+}
+
+/**
+ * Replace the global allocation functions with ones that bump chip8::bench::allocation_count(). Use once, at namespace
+ * scope, in the main source file of a benchmark. Every form is replaced, array and over-aligned ones included, so that
+ * each allocation is counted and freed by the matching function.
+ */
+#define CHIP8_BENCH_COUNT_ALLOCATIONS                                                   \
+    void *operator new(std::size_t size) {                                              \
+        chip8::bench::allocation_count().fetch_add(1, std::memory_order_relaxed);       \
+        if (void *pointer = std::malloc(size != 0 ? size : 1)) {                        \
+            return pointer;                                                             \
+        }                                                                               \
+        throw std::bad_alloc();                                                         \
+    }                                                                                   \
+                                                                                        \
+    void *operator new[](std::size_t size) {                                            \
+        return operator new(size);                                                      \
+    }                                                                                   \
+                                                                                        \
+    void operator delete(void *pointer) noexcept {                                      \
+        chip8::bench::deallocate(pointer);                                              \
+    }                                                                                   \
+                                                                                        \
+    void operator delete(void *pointer, std::size_t) noexcept {                         \
+        chip8::bench::deallocate(pointer);                                              \
+    }                                                                                   \
+                                                                                        \
+    void operator delete[](void *pointer) noexcept {                                    \
+        chip8::bench::deallocate(pointer);                                              \
+    }                                                                                   \
+                                                                                        \
+    void operator delete[](void *pointer, std::size_t) noexcept {                       \
+        chip8::bench::deallocate(pointer);                                              \
+    }                                                                                   \
+                                                                                        \
+    CHIP8_BENCH_COUNT_ALIGNED_ALLOCATIONS
+
+#ifdef __cpp_aligned_new
+#define CHIP8_BENCH_COUNT_ALIGNED_ALLOCATIONS                                           \
+    void *operator new(std::size_t size, std::align_val_t alignment) {                  \
+        chip8::bench::allocation_count().fetch_add(1, std::memory_order_relaxed);       \
+        void *pointer{nullptr};                                                         \
+        std::size_t align{static_cast<std::size_t>(alignment)};                         \
+        align = std::max(align, sizeof(void *));                                        \
+        if (::posix_memalign(&pointer, align, size != 0 ? size : 1) == 0) {             \
+            return pointer;                                                             \
+        }                                                                               \
+        throw std::bad_alloc();                                                         \
+    }                                                                                   \
+                                                                                        \
+    void *operator new[](std::size_t size, std::align_val_t alignment) {                \
+        return operator new(size, alignment);                                           \
+    }                                                                                   \
+                                                                                        \
+    void operator delete(void *pointer, std::align_val_t) noexcept {                    \
+        chip8::bench::deallocate(pointer);                                              \
+    }                                                                                   \
+                                                                                        \
+    void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept {       \
+        chip8::bench::deallocate(pointer);                                              \
+    }                                                                                   \
+                                                                                        \
+    void operator delete[](void *pointer, std::align_val_t) noexcept {                  \
+        chip8::bench::deallocate(pointer);                                              \
+    }                                                                                   \
+                                                                                        \
+    void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept {     \
+        chip8::bench::deallocate(pointer);                                              \
+    }
+#else
+#define CHIP8_BENCH_COUNT_ALIGNED_ALLOCATIONS
+#endif
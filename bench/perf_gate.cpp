@@ -0,0 +1,264 @@
+/**
+ * Performance regression gate: runs a fixed workload on the bundled ROMs and fails if it got slower than a checked-in
+ * baseline.
+ *
+ * Every ROM runs from a fresh machine with a fixed seed and a fixed input movie, several times over, and the medians
+ * of its instructions per second and its p50 and p99 frame times are compared with the baseline. The gate fails if the
+ * geometric mean over all ROMs of any of them is worse than the baseline by more than the threshold (a fraction, so
+ * 0.3 allows 30% noise); single ROMs on a shared host are too noisy to gate on, but are reported. The threshold
+ * defaults to CHIP8_PERF_THRESHOLD from the environment, or 0.3.
+ *
+ * Numbers from an unoptimized build say nothing about regressions, so in one the gate exits with SKIPPED_EXIT_CODE,
+ * which ctest reports as skipped.
+ *
+ * The baseline is a text file of "ROM METRIC VALUE" lines. It is specific to the host it was recorded on; regenerate
+ * it on the reference host with --update. For the same reason ctest only runs the gate in builds configured with
+ * -DCHIP8_PERF_GATE=ON.
+ *
+ * Usage: perf_gate --baseline=FILE [--update] [--roms=DIRECTORY] [--movie=FILE] [--frames=N] [--ipf=N]
+ *                  [--repetitions=N] [--threshold=FRACTION]
+ */
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <libgen.h>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "harness.hpp"
+
+#include "files.hpp"
+#include "movie.hpp"
+#include "rom.hpp"
+#include "runner.hpp"
+
+namespace {
+    const int SKIPPED_EXIT_CODE{77};
+
+    // Fixed so that every run executes exactly the same instructions
+    const uint32_t GATE_SEED{0xC0FFEE};
+
+    struct Options {
+        std::string baseline;
+        bool update{false};
+        std::string roms{"data/games"};
+        std::string movie{"data/perf/input.movie"};
+        uint64_t frames{6000};
+        unsigned instructionsPerFrame{10};
+        unsigned repetitions{11};
+        double threshold{0.3};
+    };
+
+    /**
+     * A metric the gate checks, and whether bigger values are better.
+     */
+    struct Check {
+        const char *metric;
+        bool higherIsBetter;
+    };
+
+    const Check CHECKS[] = {
+        {"instructions_per_second", true},
+        {"p50_frame_ns", false},
+        {"p99_frame_ns", false},
+    };
+
+    using Baseline = std::map<std::string, std::map<std::string, double>>;
+
+    bool parse_options(int argc, char **argv, Options &options) {
+        if (const char *threshold = std::getenv("CHIP8_PERF_THRESHOLD")) {
+            options.threshold = std::strtod(threshold, nullptr);
+        }
+
+        for (int i = 1; i < argc; i++) {
+            std::string arg{argv[i]};
+
+            if (arg.compare(0, 11, "--baseline=") == 0) {
+                options.baseline = arg.substr(11);
+            } else if (arg == "--update") {
+                options.update = true;
+            } else if (arg.compare(0, 7, "--roms=") == 0) {
+                options.roms = arg.substr(7);
+            } else if (arg.compare(0, 8, "--movie=") == 0) {
+                options.movie = arg.substr(8);
+            } else if (arg.compare(0, 9, "--frames=") == 0) {
+                options.frames = std::strtoull(arg.c_str() + 9, nullptr, 10);
+            } else if (arg.compare(0, 6, "--ipf=") == 0) {
+                options.instructionsPerFrame = static_cast<unsigned>(std::strtoul(arg.c_str() + 6, nullptr, 10));
+            } else if (arg.compare(0, 14, "--repetitions=") == 0) {
+                options.repetitions = static_cast<unsigned>(std::strtoul(arg.c_str() + 14, nullptr, 10));
+            } else if (arg.compare(0, 12, "--threshold=") == 0) {
+                options.threshold = std::strtod(arg.c_str() + 12, nullptr);
+            } else {
+                return false;
+            }
+        }
+
+        return !options.baseline.empty() && options.frames > 0 && options.instructionsPerFrame > 0
+               && options.threshold >= 0;
+    }
+
+    bool read_baseline(const std::string &path, Baseline &baseline) {
+        std::ifstream file{path};
+        if (!file) {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields{line};
+            std::string rom;
+            std::string metric;
+            double value;
+            if (!(fields >> rom) || rom[0] == '#') {
+                continue;
+            }
+            if (!(fields >> metric >> value)) {
+                std::cerr << path << ": can't parse \"" << line << "\"" << std::endl;
+                return false;
+            }
+            baseline[rom][metric] = value;
+        }
+
+        return true;
+    }
+
+    bool write_baseline(const std::string &path, const Options &options,
+                        const std::vector<chip8::bench::Result> &results) {
+        std::ofstream file{path};
+        file << "# Performance gate baseline, recorded by perf_gate --update with " << options.frames << " frames at "
+             << options.instructionsPerFrame << " instructions per frame, median of " << options.repetitions
+             << " runs." << std::endl;
+        file << "# ROM METRIC VALUE" << std::endl;
+
+        file << std::setprecision(10);
+        for (const auto &result : results) {
+            for (const Check &check : CHECKS) {
+                file << result.name << ' ' << check.metric << ' ' << result.get(check.metric) << std::endl;
+            }
+        }
+
+        return static_cast<bool>(file);
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: " << basename(argv[0])
+                  << " --baseline=FILE [--update] [--roms=DIRECTORY] [--movie=FILE] [--frames=N] [--ipf=N]"
+                  << " [--repetitions=N] [--threshold=FRACTION]" << std::endl;
+        return 1;
+    }
+
+#ifndef NDEBUG
+    if (!options.update) {
+        std::cerr << "Skipping the performance gate in an unoptimized build" << std::endl;
+        return SKIPPED_EXIT_CODE;
+    }
+#endif
+
+    chip8::Movie movie;
+    try {
+        movie = chip8::load_movie(options.movie);
+    } catch (const chip8::MovieError &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    chip8::bench::Settings settings;
+    settings.repetitions = options.repetitions;
+
+    chip8::RunLimits limits;
+    limits.frames = options.frames;
+    limits.instructionsPerFrame = options.instructionsPerFrame;
+
+    std::vector<chip8::bench::Result> results;
+    for (const std::string &path : chip8::list_roms(options.roms)) {
+        std::string name{basename(const_cast<char *>(path.c_str()))};
+
+        std::shared_ptr<const chip8::Rom> rom;
+        try {
+            rom = chip8::load_rom(path);
+        } catch (const std::exception &e) {
+            std::cerr << name << ": " << e.what() << std::endl;
+            return 1;
+        }
+
+        chip8::bench::Result result = chip8::bench::measure_rom(name, settings, *rom, limits, movie, GATE_SEED);
+        if (!result.error.empty()) {
+            std::cerr << name << ": " << result.error << std::endl;
+            return 1;
+        }
+        results.push_back(result);
+    }
+
+    if (options.update) {
+        if (!write_baseline(options.baseline, options, results)) {
+            std::cerr << "Unable to write " << options.baseline << std::endl;
+            return 1;
+        }
+        std::cerr << "Wrote the baseline for " << results.size() << " ROMs to " << options.baseline << std::endl;
+        return 0;
+    }
+
+    Baseline baseline;
+    if (!read_baseline(options.baseline, baseline)) {
+        std::cerr << "Unable to read the baseline " << options.baseline << std::endl;
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(12) << "ROM" << std::setw(26) << "metric" << std::right
+              << std::setw(16) << "baseline" << std::setw(16) << "current" << std::setw(10) << "change" << std::endl;
+
+    // How much worse each metric got over all the ROMs, as the sum of the logs of the ratios of current to baseline
+    // (inverted where higher is better), so that the geometric mean follows
+    double logWorse[sizeof(CHECKS) / sizeof(CHECKS[0])]{};
+    int failures{0};
+    for (const auto &result : results) {
+        auto rom = baseline.find(result.name);
+        if (rom == baseline.end()) {
+            std::cout << std::left << std::setw(12) << result.name << "not in the baseline" << std::endl;
+            failures++;
+            continue;
+        }
+
+        for (std::size_t c = 0; c < sizeof(CHECKS) / sizeof(CHECKS[0]); c++) {
+            const Check &check = CHECKS[c];
+            auto expected = rom->second.find(check.metric);
+            double current = result.get(check.metric);
+            if (expected == rom->second.end() || expected->second <= 0 || current <= 0) {
+                std::cout << std::left << std::setw(12) << result.name << std::setw(26) << check.metric
+                          << "not in the baseline" << std::endl;
+                failures++;
+                continue;
+            }
+
+            double worse = check.higherIsBetter ? expected->second / current : current / expected->second;
+            logWorse[c] += std::log(worse);
+
+            std::cout << std::left << std::setw(12) << result.name << std::setw(26) << check.metric << std::right
+                      << std::fixed << std::setprecision(1)
+                      << std::setw(16) << expected->second << std::setw(16) << current
+                      << std::setw(9) << (current / expected->second - 1) * 100 << '%' << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+    for (std::size_t c = 0; c < sizeof(CHECKS) / sizeof(CHECKS[0]) && !results.empty(); c++) {
+        double worse = std::exp(logWorse[c] / static_cast<double>(results.size())) - 1;
+        bool regressed = worse > options.threshold;
+        failures += regressed ? 1 : 0;
+
+        std::cout << std::left << std::setw(12) << "geomean" << std::setw(26) << CHECKS[c].metric << std::right
+                  << std::setw(41) << worse * 100 << "% worse" << (regressed ? "  REGRESSED" : "") << std::endl;
+    }
+
+    std::cout << std::endl << (failures == 0 ? "PASS" : "FAIL") << ": " << failures << " regressions beyond "
+              << options.threshold * 100 << "% over " << results.size() << " ROMs" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
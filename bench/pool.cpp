@@ -0,0 +1,103 @@
+/**
+ * Measures how fast sessions can be created and torn down, from a MachinePool and, for comparison, by constructing
+ * a Machine and loading the ROM into it.
+ *
+ * Every thread creates a session, runs a few instructions on it, and destroys it, in a loop, for a fixed number of
+ * sessions.
+ *
+ * Usage: pool [--threads=N] [--sessions=N] [--steps=N] [ROM]
+ */
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "machinepool.hpp"
+#include "rom.hpp"
+
+namespace {
+    bool parse_count(const std::string &arg, const std::string &name, std::size_t &value) {
+        if (arg.compare(0, name.size(), name) != 0) {
+            return false;
+        }
+        value = std::stoul(arg.substr(name.size()));
+        return true;
+    }
+
+    /**
+     * Run body(sessions) on threadCount threads at once and report the sessions per second across all of them.
+     */
+    template <typename Body>
+    void measure(const std::string &name, std::size_t threadCount, std::size_t sessionsPerThread, Body body) {
+        std::vector<std::thread> threads;
+
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t t = 0; t < threadCount; t++) {
+            threads.emplace_back([&body, sessionsPerThread]() {
+                body(sessionsPerThread);
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        double sessions = static_cast<double>(threadCount) * sessionsPerThread;
+        double nanoseconds = std::chrono::duration<double, std::nano>(elapsed).count();
+
+        std::cout << name << ": " << sessions / nanoseconds * 1e9 << " sessions/s, "
+                  << nanoseconds / sessions << " ns per create + teardown" << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::size_t threadCount{std::max(1u, std::thread::hardware_concurrency())};
+    std::size_t sessionsPerThread{200000};
+    std::size_t steps{4};
+    std::string path{"data/games/MAZE"};
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg{argv[i]};
+        if (!parse_count(arg, "--threads=", threadCount)
+            && !parse_count(arg, "--sessions=", sessionsPerThread)
+            && !parse_count(arg, "--steps=", steps)) {
+            path = arg;
+        }
+    }
+
+    std::shared_ptr<const chip8::Rom> rom;
+    try {
+        rom = chip8::load_rom(path);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << threadCount << " threads, " << sessionsPerThread << " sessions each, "
+              << steps << " instructions per session" << std::endl;
+
+    measure("construct + load", threadCount, sessionsPerThread, [&rom, steps](std::size_t sessions) {
+        for (std::size_t i = 0; i < sessions; i++) {
+            std::unique_ptr<chip8::Machine> machine{new chip8::Machine()};
+            machine->loadProgram(*rom);
+            for (std::size_t step = 0; step < steps; step++) {
+                machine->step();
+            }
+        }
+    });
+
+    chip8::MachinePool pool{*rom, threadCount * 2};
+    measure("pool", threadCount, sessionsPerThread, [&pool, steps](std::size_t sessions) {
+        for (std::size_t i = 0; i < sessions; i++) {
+            chip8::MachinePool::Session session = pool.acquire();
+            for (std::size_t step = 0; step < steps; step++) {
+                session->step();
+            }
+        }
+    });
+
+    return 0;
+}
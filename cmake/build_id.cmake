@@ -0,0 +1,24 @@
+# Writes OUTPUT, a header defining CHIP8_BUILD_ID as a hash of the emulator's sources in SOURCE_DIR. Run on every build;
+# the header is only rewritten when the hash changes, so that an unchanged tree doesn't rebuild anything.
+
+file(GLOB_RECURSE CHIP8_SOURCES
+  ${SOURCE_DIR}/src/*.hpp
+  ${SOURCE_DIR}/src/*.cpp)
+list(SORT CHIP8_SOURCES)
+
+set(CHIP8_SOURCE_HASHES "")
+foreach(source ${CHIP8_SOURCES})
+  file(SHA256 ${source} sourceHash)
+  file(RELATIVE_PATH sourceName ${SOURCE_DIR} ${source})
+  string(APPEND CHIP8_SOURCE_HASHES "${sourceName} ${sourceHash}\n")
+endforeach()
+string(SHA256 CHIP8_BUILD_HASH "${CHIP8_SOURCE_HASHES}")
+string(SUBSTRING ${CHIP8_BUILD_HASH} 0 16 CHIP8_BUILD_HASH)
+
+set(CHIP8_BUILD_ID_HEADER "#define CHIP8_BUILD_ID \"${CHIP8_BUILD_HASH}\"\n")
+if(EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} CHIP8_PREVIOUS_HEADER)
+endif()
+if(NOT CHIP8_PREVIOUS_HEADER STREQUAL CHIP8_BUILD_ID_HEADER)
+  file(WRITE ${OUTPUT} ${CHIP8_BUILD_ID_HEADER})
+endif()
@@ -1,68 +1,578 @@
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
-#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <libgen.h>
-#include <iomanip>
+#include <limits.h>
 
-#include "decode.hpp"
+#include "analysis.hpp"
+#include "files.hpp"
+#include "format.hpp"
+#include "mappedfile.hpp"
 
-int main(int argc, char **argv)
-{
-    if (argc != 2) {
-        std::cerr << "Usage: " << basename(argv[0]) << " IMAGE_FILE" << std::endl;
-        return 1;
+namespace {
+    const uint16_t ORIGIN{0x200};
+
+    enum class OutputFormat {
+        Text,
+        Json,
+        Binary
+    };
+
+    struct Options {
+        OutputFormat format{OutputFormat::Text};
+        unsigned jobs{std::max(1u, std::thread::hardware_concurrency())};
+        bool stats{false};
+        std::size_t synthetic{0};
+        std::vector<std::string> paths;
+    };
+
+    /**
+     * Longest output a single byte of an image can produce in any format, including a label.
+     */
+    const std::size_t MAX_OUTPUT_PER_BYTE{96};
+
+    /**
+     * A buffer that output is formatted into. Each worker allocates one up front, big enough for the largest image, so
+     * formatting doesn't allocate. Every write still checks the capacity, and grows the buffer if the estimate ever
+     * turns out to be too small.
+     */
+    class OutputBuffer {
+    public:
+        explicit OutputBuffer(std::size_t capacity)
+            : mData(new char[capacity]),
+              mCapacity(capacity)
+        {
+        }
+
+        void clear() {
+            mSize = 0;
+        }
+
+        void append(const char *data, std::size_t length) {
+            reserve(length);
+            std::memcpy(mData.get() + mSize, data, length);
+            mSize += length;
+        }
+
+        void append(const char *text) {
+            append(text, std::strlen(text));
+        }
+
+        void append(const std::string &text) {
+            append(text.data(), text.size());
+        }
+
+        void push_back(char c) {
+            reserve(1);
+            mData[mSize++] = c;
+        }
+
+        void appendHex(unsigned value, int width) {
+            static const char DIGITS[] = "0123456789abcdef";
+            reserve(static_cast<std::size_t>(width));
+            for (int i = width - 1; i >= 0; i--) {
+                mData[mSize + i] = DIGITS[value & 0xF];
+                value >>= 4;
+            }
+            mSize += static_cast<std::size_t>(width);
+        }
+
+        void appendDec(std::size_t value) {
+            char digits[20];
+            int count{0};
+            do {
+                digits[count++] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value != 0);
+            while (count > 0) {
+                push_back(digits[--count]);
+            }
+        }
+
+        void appendJsonString(const std::string &text) {
+            push_back('"');
+            for (char c : text) {
+                if (c == '"' || c == '\\') {
+                    push_back('\\');
+                    push_back(c);
+                } else if (static_cast<unsigned char>(c) < 0x20) {
+                    append("\\u00");
+                    appendHex(static_cast<unsigned char>(c), 2);
+                } else {
+                    push_back(c);
+                }
+            }
+            push_back('"');
+        }
+
+        template <typename T>
+        void appendLittleEndian(T value) {
+            for (std::size_t i = 0; i < sizeof(T); i++) {
+                push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+        void patchLittleEndian32(std::size_t offset, uint32_t value) {
+            if (offset > mSize || mSize - offset < 4) {
+                throw std::out_of_range("Patching past the end of the output");
+            }
+            for (std::size_t i = 0; i < 4; i++) {
+                mData[offset + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+            }
+        }
+
+        std::size_t size() const {
+            return mSize;
+        }
+
+        const char *data() const {
+            return mData.get();
+        }
+
+    private:
+        /**
+         * Make room for length more bytes.
+         */
+        void reserve(std::size_t length) {
+            if (length <= mCapacity - mSize) {
+                return;
+            }
+
+            std::size_t capacity{std::max(mCapacity * 2, mSize + length)};
+            std::unique_ptr<char[]> data{new char[capacity]};
+            std::memcpy(data.get(), mData.get(), mSize);
+            mData = std::move(data);
+            mCapacity = capacity;
+        }
+
+        std::unique_ptr<char[]> mData;
+        std::size_t mCapacity;
+        std::size_t mSize{0};
+    };
+
+    /**
+     * Jump and call targets as bitsets, since the formatters check every address.
+     */
+    struct Labels {
+        explicit Labels(const chip8::ControlFlowGraph &graph) {
+            for (auto target : graph.jumpTargets) {
+                jumps.set(target % chip8::MEMORY_SIZE);
+            }
+            for (auto target : graph.callTargets) {
+                calls.set(target % chip8::MEMORY_SIZE);
+            }
+        }
+
+        std::bitset<chip8::MEMORY_SIZE> jumps;
+        std::bitset<chip8::MEMORY_SIZE> calls;
+    };
+
+    uint16_t read_opcode(const uint8_t *image, std::size_t address) {
+        return static_cast<uint16_t>(image[address - ORIGIN] << 8 | image[address - ORIGIN + 1]);
     }
 
-    std::ifstream image_file;
-    image_file.open(argv[1], std::ios::binary);
-    if (!image_file.is_open()) {
-        std::cerr << "ERROR: Unable to open "<< argv[1] << ": " << std::strerror(errno) << std::endl;
-        return 1;
+    const char *kind_name(chip8::ByteKind kind) {
+        switch (kind) {
+            case chip8::ByteKind::Code:
+                return "code";
+            case chip8::ByteKind::Sprite:
+                return "sprite";
+            case chip8::ByteKind::Data:
+                return "data";
+            case chip8::ByteKind::Unknown:
+            default:
+                return "unknown";
+        }
     }
 
-    std::cout << "\t\tstart:" << std::endl;
+    void disassemble_text(const chip8::ControlFlowGraph &graph, const uint8_t *image, std::size_t end,
+                          OutputBuffer &out) {
+        Labels labels{graph};
+        char text[chip8::MAX_FORMATTED_OPCODE_LENGTH];
 
-    uint8_t next[2];
-    while (!image_file.eof()) {
-        image_file.read(reinterpret_cast<char *>(next), 2);
+        out.append("\t\tstart:\n");
 
-        if (image_file.gcount() != 2) {
-            break;
-        }
+        std::size_t address{ORIGIN};
+        while (address < end) {
+            auto addr16 = static_cast<uint16_t>(address);
+
+            if (labels.calls.test(addr16)) {
+                out.append("\tsub_");
+                out.appendHex(addr16, 3);
+                out.append(":\n");
+            } else if (labels.jumps.test(addr16)) {
+                out.append("\taddr_");
+                out.appendHex(addr16, 3);
+                out.append(":\n");
+            }
+
+            if (graph.isInstruction(addr16)) {
+                uint16_t opcode{read_opcode(image, address)};
+
+                out.append("0x");
+                out.appendHex(opcode, 4);
+                out.append("|\t\t");
+                out.append(text, chip8::format_opcode(opcode, text));
 
-        if (image_file.fail()) {
-            if (image_file.eof()) {
+                if ((opcode & 0xF000) == 0xB000) {
+                    out.append("\t; unresolved jump");
+                }
+
+                out.append("\n");
+                address += 2;
                 continue;
+            }
+
+            uint8_t value{image[address - ORIGIN]};
+            out.append("0x");
+            out.appendHex(value, 2);
+            out.append("|\t\tDB 0x");
+            out.appendHex(value, 2);
+
+            if (graph.kindAt(addr16) == chip8::ByteKind::Sprite) {
+                char picture[8];
+                for (int bit = 0; bit < 8; bit++) {
+                    picture[bit] = (value & (0x80 >> bit)) ? '*' : ' ';
+                }
+                out.append("\t; ");
+                out.append(picture, sizeof(picture));
+            }
+
+            out.append("\n");
+            address++;
+        }
+    }
+
+    void disassemble_json(const std::string &path, const chip8::ControlFlowGraph &graph, const uint8_t *image,
+                          std::size_t size, std::size_t end, OutputBuffer &out) {
+        Labels labels{graph};
+        char text[chip8::MAX_FORMATTED_OPCODE_LENGTH];
+
+        out.append("{\"path\":");
+        out.appendJsonString(path);
+        out.append(",\"size\":");
+        out.appendDec(size);
+        out.append(",\"blocks\":");
+        out.appendDec(graph.blocks.size());
+        out.append(",\"unresolved\":[");
+        for (std::size_t i = 0; i < graph.unresolvedJumps.size(); i++) {
+            out.append(i == 0 ? "" : ",");
+            out.appendDec(graph.unresolvedJumps[i]);
+        }
+        out.append("],\"invalid\":[");
+        for (std::size_t i = 0; i < graph.invalidInstructions.size(); i++) {
+            out.append(i == 0 ? "" : ",");
+            out.appendDec(graph.invalidInstructions[i]);
+        }
+        out.append("],\"items\":[");
+
+        std::size_t address{ORIGIN};
+        while (address < end) {
+            auto addr16 = static_cast<uint16_t>(address);
+
+            out.append(address == ORIGIN ? "\n{\"address\":" : ",\n{\"address\":");
+            out.appendDec(address);
+            out.append(",\"kind\":\"");
+            out.append(kind_name(graph.kindAt(addr16)));
+            out.append("\"");
+
+            if (labels.calls.test(addr16)) {
+                out.append(",\"label\":\"sub_");
+                out.appendHex(addr16, 3);
+                out.append("\"");
+            } else if (labels.jumps.test(addr16)) {
+                out.append(",\"label\":\"addr_");
+                out.appendHex(addr16, 3);
+                out.append("\"");
+            }
+
+            if (graph.isInstruction(addr16)) {
+                uint16_t opcode{read_opcode(image, address)};
+                out.append(",\"opcode\":\"");
+                out.appendHex(opcode, 4);
+                out.append("\",\"text\":\"");
+                out.append(text, chip8::format_opcode(opcode, text));
+                out.append("\"}");
+                address += 2;
             } else {
-                std::cerr << "ERROR: Failed to read next opcode at offset: " << image_file.tellg() << std::endl;
-                return 1;
+                out.append(",\"byte\":\"");
+                out.appendHex(image[address - ORIGIN], 2);
+                out.append("\"}");
+                address++;
             }
         }
 
-        uint16_t opcode{static_cast<uint16_t>(next[0] << 8 | next[1])};
+        out.append("]}");
+    }
+
+    /**
+     * Binary layout, all integers little endian:
+     *
+     *   u32 path length, path bytes, u32 image size, u32 record count,
+     *   then per record: u16 address, u16 value (opcode or byte), u8 kind (ByteKind), u8 flags (1 = instruction,
+     *   2 = jump target, 4 = call target, 8 = unresolved jump)
+     */
+    void disassemble_binary(const std::string &path, const chip8::ControlFlowGraph &graph, const uint8_t *image,
+                            std::size_t size, std::size_t end, OutputBuffer &out) {
+        Labels labels{graph};
+        out.appendLittleEndian<uint32_t>(static_cast<uint32_t>(path.size()));
+        out.append(path);
+        out.appendLittleEndian<uint32_t>(static_cast<uint32_t>(size));
+
+        std::size_t countOffset{out.size()};
+        out.appendLittleEndian<uint32_t>(0);
+
+        uint32_t count{0};
+        std::size_t address{ORIGIN};
+        while (address < end) {
+            auto addr16 = static_cast<uint16_t>(address);
+            bool isInstruction{graph.isInstruction(addr16)};
+            uint16_t value = isInstruction ? read_opcode(image, address) : image[address - ORIGIN];
+
+            uint8_t flags{0};
+            flags |= isInstruction ? 1 : 0;
+            flags |= labels.jumps.test(addr16) ? 2 : 0;
+            flags |= labels.calls.test(addr16) ? 4 : 0;
+            flags |= isInstruction && (value & 0xF000) == 0xB000 ? 8 : 0;
+
+            out.appendLittleEndian<uint16_t>(addr16);
+            out.appendLittleEndian<uint16_t>(value);
+            out.appendLittleEndian<uint8_t>(static_cast<uint8_t>(graph.kindAt(addr16)));
+            out.appendLittleEndian<uint8_t>(flags);
+
+            count++;
+            address += isInstruction ? 2 : 1;
+        }
+
+        out.patchLittleEndian32(countOffset, count);
+    }
 
-        int address{static_cast<int>(image_file.tellg()) + 0x200 - 2};
+    void disassemble(const Options &options, const std::string &path, const uint8_t *image, std::size_t size,
+                     OutputBuffer &out) {
+        chip8::ControlFlowGraph graph = chip8::analyze_control_flow(image, size, ORIGIN);
+        std::size_t end{std::min<std::size_t>(ORIGIN + size, chip8::MEMORY_SIZE)};
 
-        switch ((opcode & 0xF000) >> 12) {
-            case 1:
-                std::cout << "\t" << "addr_" << std::dec << address << std::dec << std::endl;
+        out.clear();
+        switch (options.format) {
+            case OutputFormat::Text:
+                disassemble_text(graph, image, end, out);
                 break;
 
-            case 2:
-                std::cout << "\t" << "sub_" << std::dec << address << std::dec << std::endl;
+            case OutputFormat::Json:
+                disassemble_json(path, graph, image, size, end, out);
                 break;
 
-            default:
+            case OutputFormat::Binary:
+                disassemble_binary(path, graph, image, size, end, out);
                 break;
         }
+    }
+
+    std::vector<std::vector<uint8_t>> make_synthetic_corpus(std::size_t count) {
+        std::mt19937 rng{0x5eed};
+        std::uniform_int_distribution<unsigned> distribution{0, 0xFFFF};
 
-        std::unique_ptr<chip8::Instruction> instruction = chip8::decode_opcode(opcode);
-        if (!instruction) {
-            std::cerr << "Unknown opcode: " << std::hex << opcode << std::dec << std::endl;
-            return 1;
+        std::vector<std::vector<uint8_t>> corpus(count);
+        for (auto &image : corpus) {
+            image.resize(chip8::MEMORY_SIZE - ORIGIN);
+
+            // Mostly valid opcodes, so that the analysis has real control flow to follow
+            for (std::size_t i = 0; i + 1 < image.size(); i += 2) {
+                uint16_t opcode;
+                do {
+                    opcode = static_cast<uint16_t>(distribution(rng));
+                } while (i % 64 != 62 && !chip8::is_valid_opcode(opcode));
+
+                image[i] = static_cast<uint8_t>(opcode >> 8);
+                image[i + 1] = static_cast<uint8_t>(opcode & 0xFF);
+            }
         }
 
-        std::cout << std::hex<< std::setw(2) << std::setfill('0') << "0x" << opcode << std::dec << "|\t\t"
-                  << instruction->toString()
+        return corpus;
+    }
+
+    bool parse_options(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg{argv[i]};
+
+            if (arg == "--format=text") {
+                options.format = OutputFormat::Text;
+            } else if (arg == "--format=json") {
+                options.format = OutputFormat::Json;
+            } else if (arg == "--format=binary") {
+                options.format = OutputFormat::Binary;
+            } else if (arg.compare(0, 7, "--jobs=") == 0) {
+                options.jobs = std::max(1, std::atoi(arg.c_str() + 7));
+            } else if (arg == "--stats") {
+                options.stats = true;
+            } else if (arg.compare(0, 12, "--synthetic=") == 0) {
+                options.synthetic = std::strtoul(arg.c_str() + 12, nullptr, 10);
+            } else if (arg.compare(0, 2, "--") == 0) {
+                return false;
+            } else {
+                options.paths.push_back(arg);
+            }
+        }
+
+        return !options.paths.empty() || options.synthetic > 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: " << basename(argv[0])
+                  << " [--format=text|json|binary] [--jobs=N] [--stats] [--synthetic=COUNT] IMAGE_FILE|DIRECTORY..."
                   << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> images;
+    for (const auto &path : options.paths) {
+        chip8::collect_files(path, images);
+    }
+
+    // Synthetic images are only used to measure throughput, their output is formatted and then thrown away.
+    std::vector<std::vector<uint8_t>> synthetic = make_synthetic_corpus(options.synthetic);
+    std::size_t total{images.size() + synthetic.size()};
+
+    // Output is formatted into a fixed set of buffers, allocated up front and reused: a worker takes a free one
+    // before it takes an image, and the buffer comes back once the image's output has been written. Taking the buffer
+    // first means the image being waited on always has one, however far ahead the other workers get.
+    unsigned jobs = static_cast<unsigned>(std::min<std::size_t>(options.jobs, std::max<std::size_t>(total, 1)));
+    std::vector<std::unique_ptr<OutputBuffer>> buffers;
+    std::vector<OutputBuffer *> freeBuffers;
+    for (unsigned i = 0; i < jobs * 2; i++) {
+        buffers.emplace_back(new OutputBuffer{chip8::MEMORY_SIZE * MAX_OUTPUT_PER_BYTE + 8 * PATH_MAX});
+        freeBuffers.push_back(buffers.back().get());
+    }
+
+    std::vector<OutputBuffer *> outputs(total, nullptr);
+    std::vector<std::string> errors(total);
+    std::vector<char> done(total, 0);
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> bytes{0};
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]() {
+        while (true) {
+            OutputBuffer *buffer;
+            {
+                std::unique_lock<std::mutex> lock{doneMutex};
+                doneCondition.wait(lock, [&]() { return !freeBuffers.empty(); });
+                buffer = freeBuffers.back();
+                freeBuffers.pop_back();
+            }
+
+            std::size_t i = next++;
+            bool keep{false};
+            if (i < images.size()) {
+                try {
+                    chip8::MappedFile file{images[i]};
+                    file.adviseSequential();
+                    disassemble(options, images[i], file.data(), file.size(), *buffer);
+                    bytes += file.size();
+                    keep = true;
+                } catch (const std::system_error &e) {
+                    errors[i] = e.what();
+                }
+            } else if (i < total) {
+                const auto &image = synthetic[i - images.size()];
+                disassemble(options, "synthetic", image.data(), image.size(), *buffer);
+                bytes += image.size();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock{doneMutex};
+                if (keep) {
+                    outputs[i] = buffer;
+                } else {
+                    freeBuffers.push_back(buffer);
+                }
+                if (i < total) {
+                    done[i] = 1;
+                }
+            }
+            doneCondition.notify_all();
+
+            if (i >= total) {
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < jobs; i++) {
+        workers.emplace_back(worker);
     }
+
+    // Write the results in order as soon as each one is ready, handing its buffer back once it's written.
+    int status{0};
+    bool written{false};
+    if (options.format == OutputFormat::Json) {
+        std::fputs("[", stdout);
+    }
+
+    for (std::size_t i = 0; i < images.size(); i++) {
+        {
+            std::unique_lock<std::mutex> lock{doneMutex};
+            doneCondition.wait(lock, [&]() { return done[i] != 0; });
+        }
+
+        if (!errors[i].empty()) {
+            std::cerr << "ERROR: " << errors[i] << std::endl;
+            status = 1;
+            continue;
+        }
+
+        if (options.format == OutputFormat::Text && images.size() > 1) {
+            std::printf("; %s\n", images[i].c_str());
+        } else if (options.format == OutputFormat::Json && written) {
+            std::fputs(",\n", stdout);
+        }
+
+        std::fwrite(outputs[i]->data(), 1, outputs[i]->size(), stdout);
+        written = true;
+        {
+            std::lock_guard<std::mutex> lock{doneMutex};
+            freeBuffers.push_back(outputs[i]);
+            outputs[i] = nullptr;
+        }
+        doneCondition.notify_all();
+    }
+
+    if (options.format == OutputFormat::Json) {
+        std::fputs("]\n", stdout);
+    }
+    std::fflush(stdout);
+
+    for (auto &thread : workers) {
+        thread.join();
+    }
+
+    if (options.stats) {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double megabytes = bytes / (1024.0 * 1024.0);
+        std::cerr << "images: " << total << ", bytes: " << bytes << ", seconds: " << elapsed.count()
+                  << ", MB/s: " << (elapsed.count() > 0 ? megabytes / elapsed.count() : 0.0) << std::endl;
+    }
+
+    return status;
 }
@@ -0,0 +1,207 @@
+/**
+ * Runs random programs on an engine and on the reference engine in lockstep, and stops at the first divergence.
+ *
+ * Every program comes from its own seed, printed when it diverges, so that it can be run again on its own with
+ * --replay=SEED, which checks after every instruction and dumps both machines.
+ *
+ * Usage: lockstep_fuzz [--engine=cached|decode] [--seed=N] [--programs=N] [--length=N] [--frames=N] [--ipf=N]
+ *                      [--interval=N] [--threads=N] [--replay=SEED]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <libgen.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lockstep.hpp"
+#include "machine.hpp"
+#include "programfuzzer.hpp"
+
+namespace {
+    struct Options {
+        chip8::Engine engine{chip8::Engine::cached};
+        uint64_t seed{1};
+
+        // 0 means run until something diverges
+        uint64_t programs{1000000};
+
+        std::size_t length{32};
+        unsigned frames{8};
+        unsigned instructionsPerFrame{10};
+        uint64_t interval{1};
+        unsigned threads{std::max(1u, std::thread::hardware_concurrency())};
+
+        bool replay{false};
+        uint64_t replaySeed{0};
+    };
+
+    bool parse_options(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg{argv[i]};
+
+            if (arg.compare(0, 9, "--engine=") == 0) {
+                if (!chip8::parse_engine(arg.substr(9), options.engine)) {
+                    return false;
+                }
+            } else if (arg.compare(0, 7, "--seed=") == 0) {
+                options.seed = std::strtoull(arg.c_str() + 7, nullptr, 0);
+            } else if (arg.compare(0, 11, "--programs=") == 0) {
+                options.programs = std::strtoull(arg.c_str() + 11, nullptr, 10);
+            } else if (arg.compare(0, 9, "--length=") == 0) {
+                options.length = std::strtoul(arg.c_str() + 9, nullptr, 10);
+            } else if (arg.compare(0, 9, "--frames=") == 0) {
+                options.frames = static_cast<unsigned>(std::strtoul(arg.c_str() + 9, nullptr, 10));
+            } else if (arg.compare(0, 6, "--ipf=") == 0) {
+                options.instructionsPerFrame = static_cast<unsigned>(std::strtoul(arg.c_str() + 6, nullptr, 10));
+            } else if (arg.compare(0, 11, "--interval=") == 0) {
+                options.interval = std::strtoull(arg.c_str() + 11, nullptr, 10);
+            } else if (arg.compare(0, 10, "--threads=") == 0) {
+                options.threads = static_cast<unsigned>(std::strtoul(arg.c_str() + 10, nullptr, 10));
+            } else if (arg.compare(0, 9, "--replay=") == 0) {
+                options.replay = true;
+                options.replaySeed = std::strtoull(arg.c_str() + 9, nullptr, 0);
+            } else {
+                return false;
+            }
+        }
+
+        return options.length > 0 && options.length <= chip8::MAX_PROGRAM_SIZE / 2 && options.frames > 0
+               && options.instructionsPerFrame > 0 && options.threads > 0;
+    }
+
+    /**
+     * Run the program made from seed, a frame at a time with random keys held.
+     *
+     * @return false if the engines diverged.
+     */
+    bool run_program(const Options &options, uint64_t seed, chip8::Lockstep &lockstep, uint64_t &instructions) {
+        chip8::ProgramFuzzer fuzzer{seed};
+        std::vector<uint8_t> program = fuzzer.program(options.length);
+
+        lockstep.loadProgram(program.data(), program.size());
+        lockstep.seed(fuzzer.seed());
+
+        try {
+            for (unsigned frame = 0; frame < options.frames; frame++) {
+                lockstep.setKeys(fuzzer.keys());
+                if (!lockstep.runFrame(options.instructionsPerFrame)) {
+                    break;
+                }
+            }
+        } catch (const chip8::MachineError &) {
+            // Both engines stopped the program the same way, which is all that is asked of them
+        }
+
+        instructions += lockstep.instructions();
+        return lockstep.check();
+    }
+
+    int replay(const Options &options) {
+        Options exact{options};
+        exact.interval = 1;
+
+        chip8::Lockstep lockstep{options.engine, 1};
+        uint64_t instructions{0};
+        bool agreed = run_program(exact, options.replaySeed, lockstep, instructions);
+
+        chip8::ProgramFuzzer fuzzer{options.replaySeed};
+        std::vector<uint8_t> program = fuzzer.program(options.length);
+        // The program is at the start of the image and in its last few bytes, with nothing in between
+        std::cout << "program:" << std::hex << std::setfill('0');
+        for (std::size_t line = 0; line < program.size(); line += 16) {
+            auto end = program.begin() + std::min(line + 16, program.size());
+            if (std::all_of(program.begin() + line, end, [](uint8_t byte) { return byte == 0; })) {
+                continue;
+            }
+
+            std::cout << "\n  " << std::setw(3) << chip8::PROGRAM_START + line << ":";
+            for (std::size_t i = line; i < line + 16 && i < program.size(); i += 2) {
+                std::cout << " " << std::setw(4) << (program[i] << 8 | program[i + 1]);
+            }
+        }
+        std::cout << std::dec << std::endl << std::endl;
+
+        std::cout << "reference:" << std::endl;
+        lockstep.reference().dumpCore(std::cout);
+        std::cout << std::endl << "candidate (" << chip8::engine_name(options.engine) << "):" << std::endl;
+        lockstep.candidate().dumpCore(std::cout);
+        std::cout << std::endl;
+
+        if (agreed) {
+            std::cout << "No divergence in " << instructions << " instructions" << std::endl;
+            return 0;
+        }
+        std::cout << lockstep.divergence().describe() << std::endl;
+        return 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: " << basename(argv[0])
+                  << " [--engine=cached|decode] [--seed=N] [--programs=N] [--length=N] [--frames=N] [--ipf=N]"
+                  << " [--interval=N] [--threads=N] [--replay=SEED]" << std::endl;
+        return 1;
+    }
+
+    if (options.replay) {
+        return replay(options);
+    }
+
+    std::atomic<uint64_t> next{0};
+    std::atomic<uint64_t> instructions{0};
+    std::atomic<bool> diverged{false};
+    std::mutex reportLock;
+
+    auto worker = [&]() {
+        chip8::Lockstep lockstep{options.engine, options.interval};
+        uint64_t ran{0};
+
+        while (!diverged.load(std::memory_order_relaxed)) {
+            uint64_t index = next++;
+            if (options.programs != 0 && index >= options.programs) {
+                break;
+            }
+
+            // Programs get seeds far apart, so that neighbouring runs share nothing
+            uint64_t seed = options.seed * 0x9E3779B97F4A7C15 + index;
+            if (!run_program(options, seed, lockstep, ran)) {
+                std::lock_guard<std::mutex> lock{reportLock};
+                if (!diverged.exchange(true)) {
+                    std::cout << "Program 0x" << std::hex << seed << std::dec << " diverged: "
+                              << lockstep.divergence().describe() << std::endl;
+                    std::cout << "Run it again with --replay=0x" << std::hex << seed << std::dec << " --length="
+                              << options.length << " --frames=" << options.frames << " --ipf="
+                              << options.instructionsPerFrame << std::endl;
+                }
+            }
+        }
+
+        instructions += ran;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < options.threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    uint64_t programs = std::min(next.load(), options.programs != 0 ? options.programs : next.load());
+    std::cerr << programs << " programs, " << instructions << " instructions in " << elapsed.count() << "s: "
+              << static_cast<uint64_t>(programs / elapsed.count()) << " programs/s, "
+              << static_cast<uint64_t>(instructions / elapsed.count()) << " instructions/s" << std::endl;
+
+    return diverged ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <libgen.h>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "files.hpp"
+#include "rom.hpp"
+#include "rompack.hpp"
+
+namespace {
+    int usage(const char *program) {
+        std::cerr << "Usage: " << program << " build PACK_FILE IMAGE_FILE|DIRECTORY..." << std::endl;
+        std::cerr << "       " << program << " list PACK_FILE" << std::endl;
+        return 1;
+    }
+
+    int build(const std::string &packPath, const std::vector<std::string> &paths) {
+        // Directories are taken to be laid out like data/games, so their documentation and sources are left out;
+        // files named on the command line are packed whatever they are called
+        std::vector<std::string> files;
+        for (const auto &path : paths) {
+            struct stat info{};
+            if (::stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+                std::vector<std::string> roms = chip8::list_roms(path);
+                files.insert(files.end(), roms.begin(), roms.end());
+            } else {
+                files.push_back(path);
+            }
+        }
+
+        chip8::RomCatalog catalog;
+        std::vector<std::shared_ptr<const chip8::Rom>> roms;
+        for (const auto &file : files) {
+            try {
+                roms.push_back(catalog.load(file));
+            } catch (const chip8::RomError &e) {
+                std::cerr << "Skipping " << file << ": " << e.what() << std::endl;
+            } catch (const std::system_error &e) {
+                std::cerr << "Skipping " << file << ": " << e.what() << std::endl;
+            }
+        }
+
+        try {
+            chip8::write_rom_pack(packPath, roms);
+        } catch (const chip8::RomError &e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
+        } catch (const std::system_error &e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
+        }
+
+        std::cout << "Packed " << catalog.size() << " unique ROMs from " << files.size() << " files into "
+                  << packPath << std::endl;
+        return 0;
+    }
+
+    int list(const std::string &packPath) {
+        try {
+            chip8::RomPack pack{packPath};
+            for (std::size_t i = 0; i < pack.size(); i++) {
+                chip8::RomPack::Entry entry = pack.at(i);
+                std::cout << std::hex << std::setw(16) << std::setfill('0') << entry.hash << std::dec
+                          << "\t" << entry.size << "\t0x" << std::hex << entry.quirks << std::dec
+                          << "\t" << entry.title << std::endl;
+            }
+        } catch (const chip8::RomPackError &e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
+        } catch (const std::system_error &e) {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *program = basename(argv[0]);
+
+    if (argc >= 4 && std::strcmp(argv[1], "build") == 0) {
+        return build(argv[2], std::vector<std::string>(argv + 3, argv + argc));
+    }
+
+    if (argc == 3 && std::strcmp(argv[1], "list") == 0) {
+        return list(argv[2]);
+    }
+
+    return usage(program);
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "cpu.hpp"
+#include "decode.hpp"
+
+namespace chip8 {
+    /**
+     * What a byte of a program image is used for, as far as static analysis can tell.
+     */
+    enum class ByteKind : uint8_t {
+        // Never reached by any control flow path and never referenced
+        Unknown,
+        // Part of an instruction that is reachable from the entry point
+        Code,
+        // Read by DXYN after I was loaded with ANNN
+        Sprite,
+        // Read or written by FX33, FX55 or FX65 after I was loaded with ANNN
+        Data
+    };
+
+    struct BasicBlock {
+        uint16_t start{0};
+
+        // One past the last byte of the last instruction in the block
+        uint16_t end{0};
+
+        // Addresses control can continue at once the block is finished. Subroutine calls are not successors, the
+        // instruction following the call is.
+        std::vector<uint16_t> successors;
+
+        // The block ends in BNNN, whose target depends on V0 and can't be resolved statically
+        bool unresolved{false};
+
+        // The block ends in 00EE
+        bool returns{false};
+    };
+
+    /**
+     * The result of a recursive-descent traversal of a program image, starting at its entry point.
+     *
+     * All addresses are absolute (0x200 for the first byte of a normal program), so this can be used directly by
+     * anything that indexes cpu_t::memory.
+     */
+    struct ControlFlowGraph {
+        std::map<uint16_t, BasicBlock> blocks;
+
+        // Targets of 1NNN
+        std::set<uint16_t> jumpTargets;
+
+        // Targets of 2NNN
+        std::set<uint16_t> callTargets;
+
+        // Addresses of BNNN instructions
+        std::vector<uint16_t> unresolvedJumps;
+
+        // Reachable addresses holding something that does not decode to an instruction
+        std::vector<uint16_t> invalidInstructions;
+
+        // Addresses where a reachable instruction starts
+        std::bitset<MEMORY_SIZE> instructions;
+
+        std::vector<ByteKind> kinds = std::vector<ByteKind>(MEMORY_SIZE, ByteKind::Unknown);
+
+        bool isInstruction(uint16_t address) const {
+            return address < MEMORY_SIZE && instructions.test(address);
+        }
+
+        ByteKind kindAt(uint16_t address) const {
+            return address < MEMORY_SIZE ? kinds[address] : ByteKind::Unknown;
+        }
+    };
+
+    namespace detail {
+        const uint16_t UNKNOWN_INDEX{0xFFFF};
+
+        struct PendingPath {
+            uint16_t address;
+
+            // The value of I on entry to this path, if it is known
+            uint16_t index;
+        };
+
+        inline bool is_skip(uint16_t opcode) {
+            switch (opcode & 0xF000) {
+                case 0x3000:
+                case 0x4000:
+                case 0x5000:
+                case 0x9000:
+                    return true;
+
+                case 0xE000:
+                    return (opcode & 0x00FF) == 0x009E || (opcode & 0x00FF) == 0x00A1;
+
+                default:
+                    return false;
+            }
+        }
+
+        inline void mark_range(ControlFlowGraph &graph, uint16_t address, std::size_t length, ByteKind kind) {
+            for (std::size_t i = address; i < address + length && i < MEMORY_SIZE; i++) {
+                if (graph.kinds[i] == ByteKind::Unknown) {
+                    graph.kinds[i] = kind;
+                }
+            }
+        }
+    }
+
+    /**
+     * Recover the control flow graph of a program image loaded at origin.
+     *
+     * Every path reachable from the entry point is followed through jumps, calls, returns and conditional skips.
+     * Bytes that are never reached are left as ByteKind::Unknown, unless a reachable ANNN followed by DXYN, FX33, FX55
+     * or FX65 shows that they hold sprite or other data. BNNN ends a path, since its target depends on V0.
+     */
+    inline ControlFlowGraph analyze_control_flow(const uint8_t *image, std::size_t size, uint16_t origin = 0x200) {
+        using namespace detail;
+
+        ControlFlowGraph graph;
+        std::bitset<MEMORY_SIZE> leaders;
+        std::vector<PendingPath> pending{{origin, UNKNOWN_INDEX}};
+        std::size_t imageEnd{std::min<std::size_t>(origin + size, MEMORY_SIZE)};
+
+        auto readOpcode = [&](uint16_t address) {
+            return static_cast<uint16_t>(image[address - origin] << 8 | image[address - origin + 1]);
+        };
+
+        auto markLeader = [&](std::size_t address) {
+            if (address < MEMORY_SIZE) {
+                leaders.set(address);
+            }
+        };
+
+        markLeader(origin);
+
+        // First pass: find every reachable instruction and every address that has to start a block
+        while (!pending.empty()) {
+            PendingPath path = pending.back();
+            pending.pop_back();
+
+            uint16_t address{path.address};
+            uint16_t index{path.index};
+
+            while (address >= origin && address + 1u < imageEnd && !graph.instructions.test(address)) {
+                uint16_t opcode{readOpcode(address)};
+
+                if (!is_valid_opcode(opcode)) {
+                    graph.invalidInstructions.push_back(address);
+                    break;
+                }
+
+                graph.instructions.set(address);
+                graph.kinds[address] = ByteKind::Code;
+                graph.kinds[address + 1] = ByteKind::Code;
+
+                uint16_t next{static_cast<uint16_t>(address + 2)};
+
+                if (opcode == 0x00EE) {
+                    break;
+                }
+
+                if ((opcode & 0xF000) == 0x1000) {
+                    uint16_t target = opcode & 0x0FFF;
+                    graph.jumpTargets.insert(target);
+                    markLeader(target);
+                    pending.push_back({target, index});
+                    break;
+                }
+
+                if ((opcode & 0xF000) == 0x2000) {
+                    uint16_t target = opcode & 0x0FFF;
+                    graph.callTargets.insert(target);
+                    markLeader(target);
+                    markLeader(next);
+                    pending.push_back({target, UNKNOWN_INDEX});
+
+                    // The subroutine may change I, so the value is unknown once it returns.
+                    index = UNKNOWN_INDEX;
+                    address = next;
+                    continue;
+                }
+
+                if ((opcode & 0xF000) == 0xB000) {
+                    graph.unresolvedJumps.push_back(address);
+                    break;
+                }
+
+                if (is_skip(opcode)) {
+                    uint16_t skipped{static_cast<uint16_t>(address + 4)};
+                    markLeader(next);
+                    markLeader(skipped);
+                    pending.push_back({skipped, index});
+                    pending.push_back({next, index});
+                    break;
+                }
+
+                switch (opcode & 0xF000) {
+                    case 0xA000:
+                        index = opcode & 0x0FFF;
+                        break;
+
+                    case 0xD000:
+                        if (index != UNKNOWN_INDEX) {
+                            mark_range(graph, index, opcode & 0x000F, ByteKind::Sprite);
+                        }
+                        break;
+
+                    case 0xF000: {
+                        auto reg = (opcode & 0x0F00) >> 8;
+                        switch (opcode & 0x00FF) {
+                            case 0x0033:
+                                if (index != UNKNOWN_INDEX) {
+                                    mark_range(graph, index, 3, ByteKind::Data);
+                                }
+                                break;
+
+                            case 0x0055:
+                            case 0x0065:
+                                if (index != UNKNOWN_INDEX) {
+                                    mark_range(graph, index, reg + 1u, ByteKind::Data);
+                                    index = static_cast<uint16_t>(index + reg + 1);
+                                }
+                                break;
+
+                            case 0x001E:
+                            case 0x0029:
+                                index = UNKNOWN_INDEX;
+                                break;
+
+                            default:
+                                break;
+                        }
+                        break;
+                    }
+
+                    default:
+                        break;
+                }
+
+                address = next;
+            }
+        }
+
+        // Second pass: group the reachable instructions into basic blocks
+        for (std::size_t address = origin; address + 1 < imageEnd; address++) {
+            if (!graph.instructions.test(address) || !leaders.test(address)) {
+                continue;
+            }
+
+            BasicBlock block;
+            block.start = static_cast<uint16_t>(address);
+
+            uint16_t current{block.start};
+            while (true) {
+                uint16_t opcode{readOpcode(current)};
+                uint16_t next{static_cast<uint16_t>(current + 2)};
+                block.end = next;
+
+                if (opcode == 0x00EE) {
+                    block.returns = true;
+                    break;
+                }
+
+                if ((opcode & 0xF000) == 0x1000) {
+                    block.successors.push_back(opcode & 0x0FFF);
+                    break;
+                }
+
+                if ((opcode & 0xF000) == 0xB000) {
+                    block.unresolved = true;
+                    break;
+                }
+
+                if (is_skip(opcode)) {
+                    block.successors.push_back(next);
+                    block.successors.push_back(static_cast<uint16_t>(current + 4));
+                    break;
+                }
+
+                if (!graph.isInstruction(next) || leaders.test(next)) {
+                    // Either a call (whose return address is always a leader), the start of another block, or the
+                    // point where the path ran into something that isn't an instruction.
+                    if (graph.isInstruction(next)) {
+                        block.successors.push_back(next);
+                    }
+                    break;
+                }
+
+                current = next;
+            }
+
+            graph.blocks[block.start] = block;
+        }
+
+        return graph;
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace chip8 {
+    /**
+     * A fixed capacity queue that any number of threads can push to and pop from without locking.
+     *
+     * Each slot carries a sequence number that tells producers and consumers whose turn it is to use it, so a thread
+     * only ever contends on the head or tail index, and never waits for another thread to finish (D. Vyukov's bounded
+     * MPMC queue). The capacity is rounded up to a power of two.
+     *
+     * The price of never waiting is that push() and pop() can fail spuriously: a slot another thread has claimed but
+     * not yet finished with reads as full to producers and empty to consumers, for the few instructions it takes that
+     * thread to finish. Callers that need an exact answer must retry.
+     */
+    template <typename T>
+    class BoundedQueue final {
+    public:
+        explicit BoundedQueue(std::size_t capacity)
+            : mMask(roundUp(capacity) - 1),
+              mSlots(new Slot[mMask + 1])
+        {
+            for (std::size_t i = 0; i <= mMask; i++) {
+                mSlots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        BoundedQueue(const BoundedQueue &) = delete;
+        BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+        /**
+         * @return false if the queue is full, or the next slot is still being popped by another thread.
+         */
+        bool push(const T &value) {
+            std::size_t position = mTail.load(std::memory_order_relaxed);
+            for (;;) {
+                Slot &slot = mSlots[position & mMask];
+                std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+                if (difference == 0) {
+                    if (mTail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        slot.value = value;
+                        slot.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (difference < 0) {
+                    return false;
+                } else {
+                    position = mTail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /**
+         * @return false if the queue is empty, or the next slot is still being pushed by another thread.
+         */
+        bool pop(T &value) {
+            std::size_t position = mHead.load(std::memory_order_relaxed);
+            for (;;) {
+                Slot &slot = mSlots[position & mMask];
+                std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+                if (difference == 0) {
+                    if (mHead.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        value = slot.value;
+                        slot.sequence.store(position + mMask + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (difference < 0) {
+                    return false;
+                } else {
+                    position = mHead.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::size_t capacity() const {
+            return mMask + 1;
+        }
+
+        /**
+         * The number of values in the queue. Only a snapshot while other threads are using it.
+         */
+        std::size_t size() const {
+            std::size_t tail = mTail.load(std::memory_order_acquire);
+            std::size_t head = mHead.load(std::memory_order_acquire);
+            return tail > head ? tail - head : 0;
+        }
+
+    private:
+        struct Slot {
+            std::atomic<std::size_t> sequence;
+            T value;
+        };
+
+        static std::size_t roundUp(std::size_t capacity) {
+            std::size_t rounded{1};
+            while (rounded < capacity) {
+                rounded <<= 1;
+            }
+            return rounded;
+        }
+
+        const std::size_t mMask;
+        std::unique_ptr<Slot[]> mSlots;
+
+        // Producers and consumers each hammer their own index, keep them on separate cache lines.
+        alignas(64) std::atomic<std::size_t> mTail{0};
+        alignas(64) std::atomic<std::size_t> mHead{0};
+    };
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <stack>
+#include <type_traits>
 
 namespace chip8 {
 //    template <typename T, std::size_t Capacity>
@@ -78,6 +82,13 @@ namespace chip8 {
             return mData[mIdx - 1];
         }
 
+        /**
+         * The entry index places from the bottom of the stack.
+         */
+        const T& operator[](std::size_t index) const {
+            return mData[index];
+        }
+
         std::size_t size() const {
             return mIdx;
         }
@@ -91,7 +102,10 @@ namespace chip8 {
         }
 
     private:
+        // The index only needs to count up to Capacity, keep it small so the stack packs next to whatever uses it.
+        using index_type = typename std::conditional<Capacity <= UINT8_MAX, uint8_t, std::size_t>::type;
+
         std::array<T, Capacity> mData;
-        std::size_t mIdx{0};
+        index_type mIdx{0};
     };
 }
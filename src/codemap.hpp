@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cstdint>
+
+namespace chip8 {
+    const std::size_t CODE_PAGE_SIZE{64};
+
+    /**
+     * Tracks which bytes of main memory hold code that has been executed or translated.
+     *
+     * Memory is split into pages of PageSize bytes, each with a generation counter. Anything that caches work derived
+     * from code (decoded instructions, translated blocks, ...) records the generation of the page it came from, and is
+     * stale once that generation changes. A write only bumps the generation of a page if it actually lands on a byte
+     * that is marked as code, so ordinary data stores never throw away cached work.
+     *
+     * An instruction that straddles a page boundary is attributed to the page it starts in.
+     *
+     * Separately, every page that has been written to at all is remembered, so that code shared between machines
+     * running the same ROM is only used for pages that still hold the ROM as loaded.
+     */
+    template <std::size_t MemorySize, std::size_t PageSize = CODE_PAGE_SIZE>
+    class CodeMap {
+    public:
+        static_assert(MemorySize % PageSize == 0, "Memory size must be a multiple of the page size");
+
+        /**
+         * Mark length bytes starting at address as code. Like memory, code wraps around from the end to the start.
+         */
+        void markCode(uint16_t address, uint16_t length = 2) {
+            for (std::size_t i = 0; i < length; i++) {
+                mCode.set((address + i) % MemorySize);
+            }
+        }
+
+        bool isCode(uint16_t address) const {
+            return address < MemorySize && mCode.test(address);
+        }
+
+        /**
+         * The generation of the page containing address.
+         */
+        uint32_t generation(uint16_t address) const {
+            return mGenerations[(address % MemorySize) / PageSize];
+        }
+
+        /**
+         * Notify the map that length bytes starting at address are about to be overwritten. Like memory, the range
+         * wraps around from the end to the start.
+         *
+         * Every page holding a code byte in that range gets a new generation, and the overwritten bytes stop being
+         * code until they are executed or translated again.
+         *
+         * @return true if any code was overwritten.
+         */
+        bool invalidate(uint16_t address, uint16_t length) {
+            std::size_t start = address % MemorySize;
+            std::size_t total = std::min<std::size_t>(length, MemorySize);
+            std::size_t first = std::min(total, MemorySize - start);
+
+            bool overwroteCode = invalidateRange(start, start + first);
+            if (total > first) {
+                overwroteCode = invalidateRange(0, total - first) || overwroteCode;
+            }
+            return overwroteCode;
+        }
+
+        /**
+         * Whether anything at all has been written to the page containing address since the map was cleared. Until
+         * then, the page still holds exactly what was loaded.
+         */
+        bool isWritten(uint16_t address) const {
+            return mWritten.test((address % MemorySize) / PageSize);
+        }
+
+        void clear() {
+            mCode.reset();
+            mWritten.reset();
+            std::fill(mGenerations.begin(), mGenerations.end(), 0);
+        }
+
+    private:
+        /**
+         * invalidate() for a range that doesn't wrap, with begin < end <= MemorySize.
+         */
+        bool invalidateRange(std::size_t begin, std::size_t end) {
+            bool overwroteCode{false};
+
+            for (std::size_t page = begin / PageSize; page * PageSize < end; page++) {
+                mWritten.set(page);
+            }
+
+            for (std::size_t i = begin; i < end; i++) {
+                if (!mCode.test(i)) {
+                    continue;
+                }
+
+                mCode.reset(i);
+                overwroteCode = true;
+
+                // The write may cover the second byte of an instruction that starts on the previous page, which for
+                // the first page is the last one.
+                std::size_t previous = (i + MemorySize - 1) % MemorySize;
+                if (i % PageSize == 0 && mCode.test(previous)) {
+                    mGenerations[previous / PageSize]++;
+                }
+
+                mGenerations[i / PageSize]++;
+
+                // Everything else on this page has already been accounted for.
+                auto nextPage = (i / PageSize + 1) * PageSize;
+                for (std::size_t j = i + 1; j < std::min<std::size_t>(end, nextPage); j++) {
+                    mCode.reset(j);
+                }
+                i = nextPage - 1;
+            }
+
+            return overwroteCode;
+        }
+
+        std::bitset<MemorySize> mCode;
+        std::bitset<MemorySize / PageSize> mWritten;
+        std::array<uint32_t, MemorySize / PageSize> mGenerations{};
+    };
+}
@@ -1,42 +1,85 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
 #include <ostream>
 #include <iomanip>
+#include <stdexcept>
 
 #include "boundedstack.hpp"
+#include "codemap.hpp"
+#include "framebuffer.hpp"
+#include "pagedmemory.hpp"
 
 namespace chip8 {
+    /**
+     * The program did something the machine can't carry on from.
+     */
+    class MachineError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
     const uint16_t REGISTER_COUNT{16};
     const uint16_t STACK_SIZE{16};
     const uint16_t MEMORY_SIZE{4096};
-
+    const uint32_t DEFAULT_RNG_SEED{0x2545F491};
+
+    // CPU::keyWait when the machine isn't suspended in FX0A
+    const uint8_t NO_KEY_WAIT{0xFF};
+
+    /**
+     * Machine state, laid out for running many machines per core.
+     *
+     * Everything the interpreter touches on every instruction (registers, pc, I, timers, the keypad, the stack and the
+     * CXNN generator) sits together in the first cache line. Memory, the display and the code map, which are only
+     * touched by the instructions that need them, come after it.
+     */
     template<int RegisterCount, int StackSize, int MemorySize>
-    struct CPU final {
-        std::array<uint8_t, MemorySize> memory;
+    struct alignas(64) CPU final {
+        // Hot
         std::array<uint8_t, RegisterCount> V;
-        boundedstack<uint16_t, StackSize> stack;
 
         uint16_t pc{0x200};
         uint16_t I{0};
 
-        std::array<bool, 64 * 32> fb;
-
         uint8_t delayTimer{0};
         uint8_t soundTimer{0};
 
+        // The register FX0A will store the next key pressed in, while the machine is suspended waiting for it
+        uint8_t keyWait{NO_KEY_WAIT};
+
+        // State of the generator behind CXNN, see next_random()
+        uint32_t rngState{DEFAULT_RNG_SEED};
+
+        // One bit per key on the hex keypad, bit N is set while key N is held down
+        uint16_t keys{0};
+
+        boundedstack<uint16_t, StackSize> stack;
+
+        // Cold
+        alignas(64) PagedMemory<MemorySize> memory;
+
+        FrameBuffer fb;
+
+        CodeMap<MemorySize> code;
+
         void reset() {
             std::fill(V.begin(), V.end(), 0);
-            std::fill(fb.begin(), fb.end(), false);
+            fb.clear();
             stack.clear();
-            std::fill(memory.begin(), memory.end(), 0);
+            memory.clear();
             pc = 0x200;
             I = 0;
             delayTimer = 0;
             soundTimer = 0;
+            keyWait = NO_KEY_WAIT;
+            rngState = DEFAULT_RNG_SEED;
+            keys = 0;
+            code.clear();
         }
 
-        void dumpState(std::ostream& outputStream) {
+        void dumpState(std::ostream& outputStream) const {
             outputStream << "PC:\t0x" << std::hex << pc << std::endl;
             outputStream << "I:\t0x" << std::hex << I << std::endl;
 
@@ -51,6 +94,9 @@ namespace chip8 {
 
             outputStream << "delayTimer:\t" << std::dec << static_cast<int>(delayTimer) << std::endl;
             outputStream << "soundTimer:\t" << std::dec << static_cast<int>(soundTimer) << std::endl;
+            if (keyWait != NO_KEY_WAIT) {
+                outputStream << "Waiting for a key for V" << std::hex << static_cast<int>(keyWait) << std::endl;
+            }
             outputStream << std::endl;
 
 //            outputStream << "Stack:" << std::endl;
@@ -60,7 +106,7 @@ namespace chip8 {
 //            outputStream << std::endl;
 
             outputStream << std::endl << "Frame buffer:" << std::endl;
-            for (int i = 1; i <= fb.size(); i++) {
+            for (std::size_t i = 1; i <= fb.size(); i++) {
                 int pixel = fb[i-1] ? 1 : 0;
                 outputStream << pixel;
                 if (i % 64 == 0) {
@@ -80,4 +126,7 @@ namespace chip8 {
     };
 
     using cpu_t = CPU<REGISTER_COUNT, STACK_SIZE, MEMORY_SIZE>;
+
+    static_assert(offsetof(cpu_t, stack) + sizeof(cpu_t::stack) <= 64, "The hot part of cpu_t must fit a cache line");
+    static_assert(offsetof(cpu_t, memory) == 64, "Memory must start on its own cache line");
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <bitset>
 #include <memory>
 
 #include "instructions.hpp"
@@ -61,7 +62,7 @@ inline std::unique_ptr<Instruction> decode_opcode(uint16_t opcode)
 
         case 0x8000: {
             auto reg_x = static_cast<uint8_t>((opcode & 0x0F00) >> 8);
-            auto reg_y = static_cast<uint8_t>((opcode & 0x0F00) >> 4);
+            auto reg_y = static_cast<uint8_t>((opcode & 0x00F0) >> 4);
 
             switch (opcode & 0x000F) {
                 case 0:
@@ -204,4 +205,20 @@ inline std::unique_ptr<Instruction> decode_opcode(uint16_t opcode)
     return {};
 }
 
+/**
+ * Whether decode_opcode() would return an instruction for this opcode, without decoding (or allocating) anything.
+ */
+inline bool is_valid_opcode(uint16_t opcode)
+{
+    static const std::bitset<0x10000> valid = []() {
+        std::bitset<0x10000> result;
+        for (uint32_t i = 0; i <= 0xFFFF; i++) {
+            result[i] = static_cast<bool>(decode_opcode(static_cast<uint16_t>(i)));
+        }
+        return result;
+    }();
+
+    return valid[opcode];
+}
+
 }
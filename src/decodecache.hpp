@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <memory>
+
+#include "cpu.hpp"
+#include "decode.hpp"
+#include "sharedcode.hpp"
+
+namespace chip8 {
+    /**
+     * Keeps the decoded instruction for every address that has been executed, so that the hot loop does not have to
+     * decode (and allocate) the same opcode over and over again.
+     *
+     * Entries remember the code page generation they were decoded against. If the program overwrites its own code,
+     * the page generation changes and the entry is decoded again the next time it is reached.
+     *
+     * When the machine is running a ROM other machines may be running too, pages it hasn't written to come from the
+     * SharedCode for that ROM instead, and only pages it has modified are decoded here.
+     *
+     * Entries are allocated a page at a time, the first time something on the page is decoded, so a machine that
+     * shares all of its code carries almost nothing here.
+     */
+    class DecodeCache final {
+    public:
+        DecodeCache() = default;
+
+        /**
+         * Copies use the same shared code, but start out without any privately decoded entries, which are decoded
+         * again the first time they are reached.
+         */
+        DecodeCache(const DecodeCache &other)
+            : mShared(other.mShared)
+        {
+        }
+
+        DecodeCache &operator=(const DecodeCache &other) {
+            if (this != &other) {
+                clear();
+                mShared = other.mShared;
+            }
+            return *this;
+        }
+
+        DecodeCache(DecodeCache &&) = default;
+        DecodeCache &operator=(DecodeCache &&) = default;
+
+        /**
+         * Look up the instruction at the current program counter, decoding it if needed.
+         *
+         * @return The instruction, or nullptr if the opcode at the program counter could not be decoded.
+         */
+        const Instruction *fetch(cpu_t &cpu) {
+            if (mShared && !cpu.code.isWritten(cpu.pc) && !cpu.code.isWritten(cpu.pc + 1)) {
+                return mShared->fetch(cpu.pc);
+            }
+
+            Entry &entry = entryFor(cpu.pc);
+            auto generation = cpu.code.generation(cpu.pc);
+
+            if (!entry.instruction || entry.generation != generation) {
+                uint16_t opcode{static_cast<uint16_t>(cpu.memory[cpu.pc] << 8 | cpu.memory[cpu.pc + 1])};
+                entry.instruction = decode_opcode(opcode);
+                entry.generation = generation;
+                cpu.code.markCode(cpu.pc, 2);
+            }
+
+            return entry.instruction.get();
+        }
+
+        /**
+         * Use code shared with other machines running the same ROM for every page this machine hasn't written to.
+         * Pages it has written to are decoded privately. Pass nullptr to stop sharing.
+         */
+        void share(std::shared_ptr<const SharedCode> shared) {
+            mShared = std::move(shared);
+        }
+
+        void clear() {
+            mShared.reset();
+            for (auto &page : mPages) {
+                page.reset();
+            }
+        }
+
+    private:
+        struct Entry {
+            std::unique_ptr<Instruction> instruction;
+            uint32_t generation{0};
+        };
+
+        using Page = std::array<Entry, CODE_PAGE_SIZE>;
+
+        Entry &entryFor(uint16_t address) {
+            std::unique_ptr<Page> &page = mPages[(address % MEMORY_SIZE) / CODE_PAGE_SIZE];
+            if (!page) {
+                page.reset(new Page());
+            }
+            return (*page)[address % CODE_PAGE_SIZE];
+        }
+
+        std::shared_ptr<const SharedCode> mShared;
+        std::array<std::unique_ptr<Page>, MEMORY_SIZE / CODE_PAGE_SIZE> mPages;
+    };
+}
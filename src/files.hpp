@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace chip8 {
+    /**
+     * Expand path into the regular files under it, recursing into directories in sorted order. Hidden entries are
+     * skipped. Anything that isn't a directory is added as is, so that the caller reports it when it fails to open.
+     */
+    inline void collect_files(const std::string &path, std::vector<std::string> &files) {
+        struct stat info{};
+        if (::stat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+            files.push_back(path);
+            return;
+        }
+
+        DIR *dir = ::opendir(path.c_str());
+        if (dir == nullptr) {
+            files.push_back(path);
+            return;
+        }
+
+        std::vector<std::string> children;
+        while (struct dirent *entry = ::readdir(dir)) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            children.push_back(path + "/" + entry->d_name);
+        }
+        ::closedir(dir);
+
+        std::sort(children.begin(), children.end());
+        for (const auto &child : children) {
+            struct stat childInfo{};
+            if (::stat(child.c_str(), &childInfo) != 0) {
+                continue;
+            }
+
+            if (S_ISDIR(childInfo.st_mode)) {
+                collect_files(child, files);
+            } else if (S_ISREG(childInfo.st_mode)) {
+                files.push_back(child);
+            }
+        }
+    }
+
+    /**
+     * The ROMs in a directory laid out like data/games: every regular file directly inside it whose name has no
+     * extension, in sorted order. Documentation (.DOC files) and subdirectories of sources are left out.
+     */
+    inline std::vector<std::string> list_roms(const std::string &directory) {
+        std::vector<std::string> roms;
+
+        DIR *dir = ::opendir(directory.c_str());
+        if (dir == nullptr) {
+            return roms;
+        }
+
+        while (struct dirent *entry = ::readdir(dir)) {
+            std::string name{entry->d_name};
+            struct stat info{};
+            std::string path{directory + "/" + name};
+            if (name.find('.') == std::string::npos && ::stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+                roms.push_back(path);
+            }
+        }
+        ::closedir(dir);
+
+        std::sort(roms.begin(), roms.end());
+        return roms;
+    }
+}
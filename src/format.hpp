@@ -0,0 +1,231 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace chip8 {
+    namespace detail {
+        inline char *append(char *out, const char *text) {
+            std::size_t length{std::strlen(text)};
+            std::memcpy(out, text, length);
+            return out + length;
+        }
+
+        inline char *append_hex(char *out, unsigned value) {
+            static const char DIGITS[] = "0123456789abcdef";
+            char digits[4];
+            int count{0};
+
+            do {
+                digits[count++] = DIGITS[value & 0xF];
+                value >>= 4;
+            } while (value != 0);
+
+            while (count > 0) {
+                *out++ = digits[--count];
+            }
+
+            return out;
+        }
+
+        inline char *append_dec(char *out, unsigned value) {
+            char digits[5];
+            int count{0};
+
+            do {
+                digits[count++] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value != 0);
+
+            while (count > 0) {
+                *out++ = digits[--count];
+            }
+
+            return out;
+        }
+
+        // "NAME 0xNNN"
+        inline char *format_address(char *out, const char *name, unsigned address) {
+            out = append(out, name);
+            out = append(out, " 0x");
+            return append_hex(out, address);
+        }
+
+        // "NAME VX"
+        inline char *format_register(char *out, const char *name, unsigned reg) {
+            out = append(out, name);
+            out = append(out, " V");
+            return append_dec(out, reg);
+        }
+
+        // "NAME VX, 0xNN"
+        inline char *format_register_value(char *out, const char *name, unsigned reg, unsigned value) {
+            out = format_register(out, name, reg);
+            out = append(out, ", 0x");
+            return append_hex(out, value);
+        }
+
+        // "NAME VX, VY"
+        inline char *format_registers(char *out, const char *name, unsigned reg_x, unsigned reg_y) {
+            out = format_register(out, name, reg_x);
+            out = append(out, ", V");
+            return append_dec(out, reg_y);
+        }
+    }
+
+    /**
+     * Longest text format_opcode() can produce, not counting a terminator.
+     */
+    const std::size_t MAX_FORMATTED_OPCODE_LENGTH{16};
+
+    /**
+     * Write the assembly text for an opcode into buffer, without allocating.
+     *
+     * The text is the same as Instruction::toString() for the instruction decode_opcode() returns. Nothing is
+     * written, and 0 is returned, for opcodes that don't decode.
+     *
+     * @param buffer Must have room for at least MAX_FORMATTED_OPCODE_LENGTH characters. It isn't null terminated.
+     * @return The number of characters written.
+     */
+    inline std::size_t format_opcode(uint16_t opcode, char *buffer) {
+        using namespace detail;
+
+        unsigned reg_x = (opcode & 0x0F00u) >> 8;
+        unsigned reg_y = (opcode & 0x00F0u) >> 4;
+        unsigned value = opcode & 0x00FFu;
+        unsigned address = opcode & 0x0FFFu;
+        char *out{buffer};
+
+        switch (opcode & 0xF000) {
+            case 0x0000:
+                if (opcode == 0x00E0) {
+                    out = append(out, "CLS");
+                } else if (opcode == 0x00EE) {
+                    out = append(out, "RET");
+                }
+                break;
+
+            case 0x1000:
+                out = format_address(out, "JMP", address);
+                break;
+
+            case 0x2000:
+                out = format_address(out, "CALL", address);
+                break;
+
+            case 0x3000:
+                out = format_register_value(out, "SKE", reg_x, value);
+                break;
+
+            case 0x4000:
+                out = format_register_value(out, "SKNE", reg_x, value);
+                break;
+
+            case 0x5000:
+                out = format_registers(out, "SKRE", reg_x, reg_y);
+                break;
+
+            case 0x6000:
+                out = format_register_value(out, "MOV", reg_x, value);
+                break;
+
+            case 0x7000:
+                out = format_register_value(out, "INC", reg_x, value);
+                break;
+
+            case 0x8000: {
+                static const char *const NAMES[16] = {
+                    "MOV", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUB",
+                    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr
+                };
+
+                const char *name{NAMES[opcode & 0x000F]};
+                if (name != nullptr) {
+                    out = format_registers(out, name, reg_x, reg_y);
+                }
+                break;
+            }
+
+            case 0x9000:
+                out = format_registers(out, "SKRNE", reg_x, reg_y);
+                break;
+
+            case 0xA000:
+                out = format_address(out, "LOADI", address);
+                break;
+
+            case 0xB000:
+                out = format_address(out, "JUMPI", address);
+                break;
+
+            case 0xC000:
+                out = format_register(out, "RND", reg_x);
+                out = append(out, ", ");
+                out = append_dec(out, value);
+                break;
+
+            case 0xD000:
+                out = format_registers(out, "DRW", reg_x, reg_y);
+                out = append(out, ", ");
+                out = append_dec(out, opcode & 0x000Fu);
+                break;
+
+            case 0xE000:
+                if (value == 0x9E) {
+                    out = format_register(out, "SKP", reg_x);
+                } else if (value == 0xA1) {
+                    out = format_register(out, "SKNP", reg_x);
+                }
+                break;
+
+            case 0xF000:
+                switch (value) {
+                    case 0x07:
+                        out = format_register(out, "MOVED", reg_x);
+                        break;
+
+                    case 0x0A:
+                        out = append(out, "KEYD");
+                        break;
+
+                    case 0x15:
+                        out = format_register(out, "LOADD", reg_x);
+                        break;
+
+                    case 0x18:
+                        out = format_register(out, "LOADS", reg_x);
+                        break;
+
+                    case 0x1E:
+                        out = format_register(out, "ADDI", reg_x);
+                        break;
+
+                    case 0x29:
+                        out = format_register(out, "LOADI", reg_x);
+                        break;
+
+                    case 0x33:
+                        out = format_register(out, "BCD", reg_x);
+                        break;
+
+                    case 0x55:
+                        out = format_register(out, "STOR", reg_x);
+                        break;
+
+                    case 0x65:
+                        out = format_register(out, "READ", reg_x);
+                        break;
+
+                    default:
+                        break;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        return static_cast<std::size_t>(out - buffer);
+    }
+}
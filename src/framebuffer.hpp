@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "hash.hpp"
+
+namespace chip8 {
+    const std::size_t DISPLAY_WIDTH{64};
+    const std::size_t DISPLAY_HEIGHT{32};
+
+    // A dirty row mask with every row set
+    const uint32_t ALL_ROWS{0xFFFFFFFF};
+
+    static_assert(DISPLAY_HEIGHT == 32, "Dirty row masks have one bit per row");
+
+    /**
+     * The 64x32 monochrome display, one bit per pixel.
+     *
+     * Each row is a single 64 bit word with the leftmost pixel in the most significant bit, so a sprite row can be
+     * XORed onto the screen with a shift and a rotate instead of eight separate pixel updates, and the whole screen
+     * is 256 bytes instead of 2 KB.
+     *
+     * The screen also keeps track of which rows have changed since takeDirtyRows() was last called, one bit per row
+     * with bit N for row N, so that whatever shows it only has to redo those. Only changes to what is on screen count:
+     * rows are marked when drawing flips one of their pixels, or clearing blanks them. A new screen has every row
+     * dirty, since nothing has shown it yet. Dirtiness isn't part of the content, and screens compare and hash without
+     * it.
+     */
+    class FrameBuffer final {
+    public:
+        bool get(std::size_t x, std::size_t y) const {
+            return (mRows[y % DISPLAY_HEIGHT] >> (DISPLAY_WIDTH - 1 - x % DISPLAY_WIDTH)) & 1;
+        }
+
+        void set(std::size_t x, std::size_t y, bool on) {
+            uint64_t mask = uint64_t{1} << (DISPLAY_WIDTH - 1 - x % DISPLAY_WIDTH);
+            uint64_t &row = mRows[y % DISPLAY_HEIGHT];
+            uint64_t before = row;
+            row = on ? row | mask : row & ~mask;
+            mDirty |= static_cast<uint32_t>(row != before) << (y % DISPLAY_HEIGHT);
+        }
+
+        /**
+         * The pixel at index in row-major order, i.e. x + y * DISPLAY_WIDTH.
+         */
+        bool operator[](std::size_t index) const {
+            return get(index % DISPLAY_WIDTH, index / DISPLAY_WIDTH);
+        }
+
+        /**
+         * XOR one 8 pixel wide sprite row onto the screen at (x, y), wrapping around the right edge.
+         *
+         * @return true if any pixel that was on got turned off.
+         */
+        bool drawRow(std::size_t x, std::size_t y, uint8_t bits) {
+            uint64_t sprite = static_cast<uint64_t>(bits) << (DISPLAY_WIDTH - 8);
+            unsigned shift = x % DISPLAY_WIDTH;
+            if (shift != 0) {
+                sprite = (sprite >> shift) | (sprite << (DISPLAY_WIDTH - shift));
+            }
+
+            uint64_t &row = mRows[y % DISPLAY_HEIGHT];
+            bool collision = (row & sprite) != 0;
+            row ^= sprite;
+            mDirty |= static_cast<uint32_t>(bits != 0) << (y % DISPLAY_HEIGHT);
+            return collision;
+        }
+
+        /**
+         * Replace a whole row, as when a screen is rebuilt from elsewhere.
+         */
+        void setRow(std::size_t y, uint64_t bits) {
+            uint64_t &row = mRows[y % DISPLAY_HEIGHT];
+            mDirty |= static_cast<uint32_t>(row != bits) << (y % DISPLAY_HEIGHT);
+            row = bits;
+        }
+
+        void clear() {
+            for (std::size_t y = 0; y < DISPLAY_HEIGHT; y++) {
+                mDirty |= static_cast<uint32_t>(mRows[y] != 0) << y;
+                mRows[y] = 0;
+            }
+        }
+
+        /**
+         * Rows changed since the last takeDirtyRows().
+         */
+        uint32_t dirtyRows() const {
+            return mDirty;
+        }
+
+        /**
+         * Rows changed since the last call, which are then counted as clean.
+         */
+        uint32_t takeDirtyRows() {
+            uint32_t dirty = mDirty;
+            mDirty = 0;
+            return dirty;
+        }
+
+        const std::array<uint64_t, DISPLAY_HEIGHT> &rows() const {
+            return mRows;
+        }
+
+        std::size_t size() const {
+            return DISPLAY_WIDTH * DISPLAY_HEIGHT;
+        }
+
+        /**
+         * Content hash of the screen, for checking runs against known output.
+         */
+        uint64_t hash() const {
+            return content_hash(reinterpret_cast<const uint8_t *>(mRows.data()), sizeof(mRows));
+        }
+
+        bool operator==(const FrameBuffer &other) const {
+            return mRows == other.mRows;
+        }
+
+        bool operator!=(const FrameBuffer &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        std::array<uint64_t, DISPLAY_HEIGHT> mRows{};
+        uint32_t mDirty{ALL_ROWS};
+    };
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <ratio>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <ctime>
+#else
+#include <thread>
+#endif
+
+namespace chip8 {
+    /**
+     * Frame periods, in units that hold both a nanosecond and a 60th of a second exactly, so that deadlines worked out
+     * from a period don't drift by a rounded off fraction of a nanosecond every frame.
+     */
+    using FramePeriod = std::chrono::duration<int64_t, std::ratio<1, 3000000000>>;
+
+    // The timers, and so the frame rate, run at 60 Hz
+    const FramePeriod FRAME_DURATION{std::chrono::duration<int64_t, std::ratio<1, 60>>{1}};
+
+    /**
+     * The host's monotonic clock, and a way to sleep until a point on it.
+     */
+    struct MonotonicClock {
+        using time_point = std::chrono::steady_clock::time_point;
+
+        static time_point now() {
+            return std::chrono::steady_clock::now();
+        }
+
+        static void sleep_until(time_point deadline) {
+#ifdef __linux__
+            // steady_clock is CLOCK_MONOTONIC, and an absolute sleep on it can't be stretched by being interrupted
+            auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+            timespec until;
+            until.tv_sec = static_cast<time_t>(since_epoch.count() / 1000000000);
+            until.tv_nsec = static_cast<long>(since_epoch.count() % 1000000000);
+            while (::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR) {
+            }
+#else
+            std::this_thread::sleep_until(deadline);
+#endif
+        }
+    };
+
+    struct PacingStats {
+        uint64_t frames{0};
+
+        // Frames that started more than a whole frame late
+        uint64_t lateFrames{0};
+
+        // Times the pacer fell so far behind that it gave up on the frames it missed
+        uint64_t resyncs{0};
+
+        // Time between the starts of consecutive frames, in nanoseconds. Mean, standard deviation (the jitter) and
+        // maximum are over the whole run, percentiles over the last FramePacer::WINDOW frames.
+        double meanFrameNs{0};
+        double jitterNs{0};
+        double p50FrameNs{0};
+        double p99FrameNs{0};
+        double maxFrameNs{0};
+    };
+
+    /**
+     * Paces a run loop to a fixed frame rate by sleeping until each frame is due, never by spinning.
+     *
+     * Frame N is due N periods after start(), worked out afresh each frame rather than by adding up periods, so time
+     * lost oversleeping one frame is made up by sleeping less before the next, and drift never builds up. If the loop
+     * falls more than maxLag frames behind, because the host stalled or the loop was suspended, the missed frames are
+     * dropped and pacing restarts from now, rather than running them back to back to catch up.
+     *
+     * Clock is MonotonicClock, or anything else with now() and sleep_until().
+     */
+    template <typename Clock = MonotonicClock>
+    class FramePacer final {
+    public:
+        using time_point = typename Clock::time_point;
+
+        // Frame times kept for percentiles
+        static const std::size_t WINDOW{1024};
+
+        explicit FramePacer(FramePeriod period = FRAME_DURATION, unsigned maxLag = 6)
+            : mPeriod(period),
+              mMaxLag(maxLag)
+        {
+            mWindow.reserve(WINDOW);
+        }
+
+        /**
+         * Start pacing from now. The first frame is due one period from now.
+         */
+        void start() {
+            restart(Clock::now());
+            mLastFrame = mStart;
+            mStats = PacingStats();
+            mMean = 0;
+            mSquaredDeviations = 0;
+            mWindow.clear();
+        }
+
+        /**
+         * Wait until the next frame is due. Call at the end of every frame.
+         */
+        void wait() {
+            mFrame++;
+            mDeadline = mStart + std::chrono::duration_cast<typename time_point::duration>(mPeriod * mFrame);
+
+            time_point now = Clock::now();
+            if (now < mDeadline) {
+                Clock::sleep_until(mDeadline);
+                now = Clock::now();
+            } else if (now - mDeadline > mPeriod * mMaxLag) {
+                restart(now);
+                mStats.resyncs++;
+            }
+
+            if (now - mDeadline > mPeriod) {
+                mStats.lateFrames++;
+            }
+
+            record(std::chrono::duration<double, std::nano>(now - mLastFrame).count());
+            mLastFrame = now;
+        }
+
+        PacingStats stats() const {
+            PacingStats stats{mStats};
+            if (stats.frames == 0) {
+                return stats;
+            }
+
+            stats.meanFrameNs = mMean;
+            stats.jitterNs = std::sqrt(mSquaredDeviations / static_cast<double>(stats.frames));
+
+            std::vector<double> window{mWindow};
+            std::sort(window.begin(), window.end());
+            stats.p50FrameNs = window[window.size() / 2];
+            stats.p99FrameNs = window[std::min(window.size() - 1, window.size() * 99 / 100)];
+            return stats;
+        }
+
+    private:
+        void restart(time_point now) {
+            mStart = now;
+            mDeadline = now;
+            mFrame = 0;
+        }
+
+        void record(double frameNs) {
+            // Welford's update, which unlike the mean of the squares less the square of the mean doesn't lose the
+            // variance to rounding when frame times are large and nearly all the same
+            double delta = frameNs - mMean;
+            mMean += delta / static_cast<double>(mStats.frames + 1);
+            mSquaredDeviations += delta * (frameNs - mMean);
+            mStats.maxFrameNs = std::max(mStats.maxFrameNs, frameNs);
+
+            if (mWindow.size() < WINDOW) {
+                mWindow.push_back(frameNs);
+            } else {
+                mWindow[mStats.frames % WINDOW] = frameNs;
+            }
+            mStats.frames++;
+        }
+
+        FramePeriod mPeriod;
+        unsigned mMaxLag;
+
+        // Frames are due a whole number of periods after mStart, and mFrame is the last one due
+        time_point mStart{};
+        int64_t mFrame{0};
+        time_point mDeadline{};
+        time_point mLastFrame{};
+
+        PacingStats mStats;
+        double mMean{0};
+        double mSquaredDeviations{0};
+        std::vector<double> mWindow;
+    };
+
+    template <typename Clock>
+    const std::size_t FramePacer<Clock>::WINDOW;
+}
@@ -0,0 +1,476 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "framebuffer.hpp"
+
+namespace chip8 {
+    /**
+     * A frame stream is a screen a frame at a time, each frame as small as possible, for viewers and archives:
+     *
+     *   FRAME_STREAM_MAGIC
+     *   version, one byte
+     *   records, one per frame
+     *
+     * Each record starts with its kind. A keyframe stands on its own; a delta is XORed onto the frame before it, and
+     * only makes sense to a reader that has that frame. Keyframes come at regular intervals, so that a reader can
+     * start from one, and after frames are dropped.
+     *
+     * Keyframes and deltas carry the 256 bytes of the screen, rows in order, each row's 8 bytes with the leftmost
+     * pixels first, run length encoded as tokens until all 256 are covered:
+     *
+     *   0x00 to 0x7F   a run of token + 1 zero bytes
+     *   0x80 to 0xFF   token - 0x7F literal bytes, which follow
+     *
+     * Since most frames change a few bytes of a few rows, a delta is mostly one long run of zeroes, and a frame that
+     * hasn't changed at all is a single byte.
+     */
+    const char FRAME_STREAM_MAGIC[8] = {'C', 'H', 'I', 'P', '8', 'F', 'R', 'M'};
+    const uint8_t FRAME_STREAM_VERSION{1};
+
+    enum FrameRecord : uint8_t {
+        // The same as the frame before
+        FRAME_SAME = 0,
+        FRAME_KEY = 1,
+        FRAME_DELTA = 2,
+    };
+
+    const std::size_t FRAME_BYTES{DISPLAY_HEIGHT * 8};
+
+    // The longest a record can be: its kind, and bytes that alternate between zero and not, each pair of which takes a
+    // literal token, the literal and a zero run token
+    const std::size_t MAX_FRAME_RECORD{1 + FRAME_BYTES + FRAME_BYTES / 2};
+
+    class FrameStreamError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * Turns frames into records, each against the one before.
+     */
+    class FrameEncoder final {
+    public:
+        /**
+         * @param keyframeInterval A keyframe every this many frames. 0 means only the first frame is one.
+         */
+        explicit FrameEncoder(unsigned keyframeInterval = 300)
+            : mKeyframeInterval(keyframeInterval)
+        {
+        }
+
+        /**
+         * Write the stream's header into out, which must hold sizeof(FRAME_STREAM_MAGIC) + 1 bytes.
+         *
+         * @return the number of bytes written.
+         */
+        static std::size_t header(uint8_t *out) {
+            std::memcpy(out, FRAME_STREAM_MAGIC, sizeof(FRAME_STREAM_MAGIC));
+            out[sizeof(FRAME_STREAM_MAGIC)] = FRAME_STREAM_VERSION;
+            return sizeof(FRAME_STREAM_MAGIC) + 1;
+        }
+
+        /**
+         * Write the record for the next frame into out, which must hold MAX_FRAME_RECORD bytes.
+         *
+         * @return the number of bytes written.
+         */
+        std::size_t encode(const FrameBuffer &frame, uint8_t *out) {
+            bool key = mSinceKeyframe == 0;
+            mSinceKeyframe = mKeyframeInterval != 0 && mSinceKeyframe + 1 >= mKeyframeInterval
+                             ? 0 : mSinceKeyframe + 1;
+
+            if (!key && frame == mPrevious) {
+                out[0] = FRAME_SAME;
+                return 1;
+            }
+
+            out[0] = key ? FRAME_KEY : FRAME_DELTA;
+            std::size_t size{1};
+            Runs runs{out, size};
+            for (std::size_t y = 0; y < DISPLAY_HEIGHT; y++) {
+                uint64_t bits = key ? frame.rows()[y] : frame.rows()[y] ^ mPrevious.rows()[y];
+                if (bits == 0) {
+                    runs.zeroes(8);
+                    continue;
+                }
+                for (int shift = 56; shift >= 0; shift -= 8) {
+                    runs.byte(static_cast<uint8_t>(bits >> shift));
+                }
+            }
+            runs.finish();
+
+            mPrevious = frame;
+            return size;
+        }
+
+        /**
+         * Make the next frame a keyframe, as after a frame has been dropped instead of written.
+         */
+        void restart() {
+            mSinceKeyframe = 0;
+        }
+
+    private:
+        /**
+         * Tokens being built up, with the literal run still open so that neighbouring bytes can join it.
+         */
+        struct Runs {
+            uint8_t *out;
+            std::size_t &size;
+            std::size_t zeroRun{0};
+            std::size_t literalStart{0};
+            std::size_t literals{0};
+
+            void zeroes(std::size_t count) {
+                closeLiterals();
+                zeroRun += count;
+            }
+
+            void byte(uint8_t value) {
+                if (value == 0) {
+                    zeroes(1);
+                    return;
+                }
+
+                closeZeroes();
+                if (literals == 128) {
+                    closeLiterals();
+                }
+                if (literals == 0) {
+                    literalStart = size++;
+                }
+                out[size++] = value;
+                literals++;
+            }
+
+            void finish() {
+                closeLiterals();
+                closeZeroes();
+            }
+
+            void closeZeroes() {
+                while (zeroRun > 0) {
+                    std::size_t run = std::min<std::size_t>(zeroRun, 128);
+                    out[size++] = static_cast<uint8_t>(run - 1);
+                    zeroRun -= run;
+                }
+            }
+
+            void closeLiterals() {
+                if (literals > 0) {
+                    out[literalStart] = static_cast<uint8_t>(0x7F + literals);
+                    literals = 0;
+                }
+            }
+        };
+
+        unsigned mKeyframeInterval;
+        unsigned mSinceKeyframe{0};
+        FrameBuffer mPrevious;
+    };
+
+    /**
+     * Turns records back into frames.
+     */
+    class FrameDecoder final {
+    public:
+        /**
+         * Check the stream's header at the start of data.
+         *
+         * @return the size of the header, or 0 if there isn't all of it yet.
+         * @throws FrameStreamError if it isn't a frame stream this can read.
+         */
+        static std::size_t header(const uint8_t *data, std::size_t size) {
+            if (size < sizeof(FRAME_STREAM_MAGIC) + 1) {
+                return 0;
+            }
+            if (std::memcmp(data, FRAME_STREAM_MAGIC, sizeof(FRAME_STREAM_MAGIC)) != 0) {
+                throw FrameStreamError("Not a frame stream");
+            }
+            if (data[sizeof(FRAME_STREAM_MAGIC)] != FRAME_STREAM_VERSION) {
+                throw FrameStreamError("Frame stream version " + std::to_string(data[sizeof(FRAME_STREAM_MAGIC)])
+                                       + " isn't supported");
+            }
+            return sizeof(FRAME_STREAM_MAGIC) + 1;
+        }
+
+        /**
+         * Decode the record at the start of data into frame().
+         *
+         * @return the size of the record, or 0 if there isn't all of it yet.
+         * @throws FrameStreamError if the record is malformed, or is a delta with no keyframe before it.
+         */
+        std::size_t decode(const uint8_t *data, std::size_t size) {
+            if (size == 0) {
+                return 0;
+            }
+
+            uint8_t kind = data[0];
+            if (kind == FRAME_SAME || kind == FRAME_DELTA) {
+                if (!mStarted) {
+                    throw FrameStreamError("Frame stream doesn't start with a keyframe");
+                }
+                if (kind == FRAME_SAME) {
+                    return 1;
+                }
+            } else if (kind != FRAME_KEY) {
+                throw FrameStreamError("Unknown frame record " + std::to_string(kind));
+            }
+
+            uint8_t bytes[FRAME_BYTES];
+            std::size_t position{1};
+            std::size_t filled{0};
+            while (filled < FRAME_BYTES) {
+                if (position >= size) {
+                    return 0;
+                }
+
+                uint8_t token = data[position++];
+                std::size_t run = token < 0x80 ? token + 1u : token - 0x7Fu;
+                if (filled + run > FRAME_BYTES) {
+                    throw FrameStreamError("Frame record runs past the end of the frame");
+                }
+
+                if (token < 0x80) {
+                    std::memset(bytes + filled, 0, run);
+                } else {
+                    if (position + run > size) {
+                        return 0;
+                    }
+                    std::memcpy(bytes + filled, data + position, run);
+                    position += run;
+                }
+                filled += run;
+            }
+
+            for (std::size_t y = 0; y < DISPLAY_HEIGHT; y++) {
+                uint64_t bits{0};
+                for (std::size_t i = 0; i < 8; i++) {
+                    bits = bits << 8 | bytes[y * 8 + i];
+                }
+                mFrame.setRow(y, kind == FRAME_KEY ? bits : mFrame.rows()[y] ^ bits);
+            }
+            mStarted = true;
+            return position;
+        }
+
+        /**
+         * The frame decoded by the last call to decode().
+         */
+        const FrameBuffer &frame() const {
+            return mFrame;
+        }
+
+    private:
+        FrameBuffer mFrame;
+        bool mStarted{false};
+    };
+
+    /**
+     * Decode a whole stream held in memory.
+     *
+     * @throws FrameStreamError if it is malformed or cut short.
+     */
+    inline std::vector<FrameBuffer> decode_frame_stream(const std::vector<uint8_t> &stream) {
+        std::size_t position = FrameDecoder::header(stream.data(), stream.size());
+        if (position == 0) {
+            throw FrameStreamError("Frame stream is cut short");
+        }
+
+        FrameDecoder decoder;
+        std::vector<FrameBuffer> frames;
+        while (position < stream.size()) {
+            std::size_t record = decoder.decode(stream.data() + position, stream.size() - position);
+            if (record == 0) {
+                throw FrameStreamError("Frame stream is cut short");
+            }
+            position += record;
+            frames.push_back(decoder.frame());
+        }
+        return frames;
+    }
+
+    struct FrameStreamOptions {
+        unsigned keyframeInterval{300};
+
+        // Bytes held back for a sink that can't take them yet. Frames that don't fit are dropped.
+        std::size_t bufferSize{64 * 1024};
+
+        // Hand what has been encoded to the sink once this much is waiting, so 1 sends every frame straight away
+        std::size_t flushBytes{1};
+    };
+
+    struct FrameStreamStats {
+        uint64_t frames{0};
+        uint64_t keyframes{0};
+
+        // Frames that didn't fit in the buffer because the sink wasn't keeping up
+        uint64_t dropped{0};
+
+        // Bytes encoded, header included
+        uint64_t bytes{0};
+    };
+
+    /**
+     * Writes a frame stream to a file, or to a Unix domain socket for a viewer.
+     *
+     * Records go through a buffer of bounded size. Files take everything they are given, but a socket is written
+     * without blocking, so a viewer that falls behind only fills the buffer. Once it is full, frames are dropped
+     * rather than held up or buffered without limit, and the next frame that fits is a keyframe, so the viewer
+     * picks up again from there.
+     */
+    class FrameStreamWriter final {
+    public:
+        /**
+         * @param destination A file, which is created or truncated, or unix:PATH for a Unix domain socket listening
+         *                    at PATH.
+         * @throws std::system_error if the file can't be created, or the socket can't be connected to.
+         */
+        explicit FrameStreamWriter(const std::string &destination, const FrameStreamOptions &options = {})
+            : mOptions(options),
+              mEncoder(options.keyframeInterval)
+        {
+            mBuffer.reserve(std::max(options.bufferSize, MAX_FRAME_RECORD));
+
+            if (destination.compare(0, 5, "unix:") == 0) {
+                connect(destination.substr(5));
+            } else {
+                mFd = ::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (mFd < 0) {
+                    throw std::system_error(errno, std::generic_category(), "Unable to create " + destination);
+                }
+            }
+
+            uint8_t header[sizeof(FRAME_STREAM_MAGIC) + 1];
+            append(header, FrameEncoder::header(header));
+        }
+
+        FrameStreamWriter(const FrameStreamWriter &) = delete;
+        FrameStreamWriter &operator=(const FrameStreamWriter &) = delete;
+
+        /**
+         * Flushes what is left, as far as the sink takes it.
+         */
+        ~FrameStreamWriter() {
+            try {
+                flush();
+            } catch (const std::system_error &) {
+            }
+            ::close(mFd);
+        }
+
+        /**
+         * Encode the next frame and send it on, or drop it if the buffer is full.
+         *
+         * @return false if the frame was dropped.
+         * @throws std::system_error if the sink fails, other than by being full.
+         */
+        bool write(const FrameBuffer &frame) {
+            mStats.frames++;
+            if (mBuffer.size() + MAX_FRAME_RECORD > mBuffer.capacity()) {
+                flush();
+                if (mBuffer.size() + MAX_FRAME_RECORD > mBuffer.capacity()) {
+                    mStats.dropped++;
+                    mEncoder.restart();
+                    return false;
+                }
+            }
+
+            uint8_t record[MAX_FRAME_RECORD];
+            std::size_t size = mEncoder.encode(frame, record);
+            if (record[0] == FRAME_KEY) {
+                mStats.keyframes++;
+            }
+            append(record, size);
+
+            if (mBuffer.size() >= mOptions.flushBytes) {
+                flush();
+            }
+            return true;
+        }
+
+        /**
+         * Hand everything buffered to the sink, or as much as a socket will take without blocking.
+         *
+         * @throws std::system_error if the sink fails, other than by being full.
+         */
+        void flush() {
+            std::size_t written{0};
+            while (written < mBuffer.size()) {
+                ssize_t result = mSocket
+                                 ? ::send(mFd, mBuffer.data() + written, mBuffer.size() - written, MSG_NOSIGNAL)
+                                 : ::write(mFd, mBuffer.data() + written, mBuffer.size() - written);
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        break;
+                    }
+                    throw std::system_error(errno, std::generic_category(), "Unable to write frame stream");
+                }
+                written += static_cast<std::size_t>(result);
+            }
+            mBuffer.erase(mBuffer.begin(), mBuffer.begin() + static_cast<std::ptrdiff_t>(written));
+        }
+
+        /**
+         * Bytes encoded but not yet taken by the sink.
+         */
+        std::size_t buffered() const {
+            return mBuffer.size();
+        }
+
+        const FrameStreamStats &stats() const {
+            return mStats;
+        }
+
+    private:
+        void connect(const std::string &path) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(address.sun_path)) {
+                throw std::system_error(ENAMETOOLONG, std::generic_category(), "Unable to connect to " + path);
+            }
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+            mFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (mFd < 0) {
+                throw std::system_error(errno, std::generic_category(), "Unable to create a socket");
+            }
+            if (::connect(mFd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+                int error = errno;
+                ::close(mFd);
+                throw std::system_error(error, std::generic_category(), "Unable to connect to " + path);
+            }
+
+            ::fcntl(mFd, F_SETFL, ::fcntl(mFd, F_GETFL) | O_NONBLOCK);
+            mSocket = true;
+        }
+
+        void append(const uint8_t *data, std::size_t size) {
+            mBuffer.insert(mBuffer.end(), data, data + size);
+            mStats.bytes += size;
+        }
+
+        FrameStreamOptions mOptions;
+        FrameEncoder mEncoder;
+        int mFd{-1};
+        bool mSocket{false};
+        std::vector<uint8_t> mBuffer;
+        FrameStreamStats mStats;
+    };
+}
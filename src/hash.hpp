@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace chip8 {
+    /**
+     * 64-bit FNV-1a hash of a block of memory. Used to identify ROM images by their contents.
+     */
+    inline uint64_t content_hash(const uint8_t *data, std::size_t size) {
+        uint64_t hash{0xcbf29ce484222325ULL};
+        for (std::size_t i = 0; i < size; i++) {
+            hash ^= data[i];
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+}
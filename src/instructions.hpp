@@ -1,6 +1,8 @@
 #pragma once
 
+#include <iomanip>
 #include <sstream>
+#include <string>
 
 #include "cpu.hpp"
 #include "random.hpp"
@@ -16,6 +18,15 @@ namespace chip8 {
     };
 #pragma clang diagnostic pop
 
+    /**
+     * Stop the program because the instruction being executed can't be. pc has already moved past it.
+     */
+    [[noreturn]] inline void throw_at(const cpu_t &cpu, const std::string &problem) {
+        std::ostringstream s;
+        s << problem << " at 0x" << std::hex << std::setw(3) << std::setfill('0') << static_cast<uint16_t>(cpu.pc - 2);
+        throw MachineError(s.str());
+    }
+
     /**
      * 0NNN	Execute machine language subroutine at address NNN
      */
@@ -44,7 +55,7 @@ namespace chip8 {
     class ClearScreenInstruction : public Instruction {
     public:
         void execute(cpu_t& cpu) const override {
-            std::fill(cpu.fb.begin(), cpu.fb.end(), false);
+            cpu.fb.clear();
         }
 
         std::string toString() const override {
@@ -58,6 +69,9 @@ namespace chip8 {
     class ReturnInstruction : public Instruction {
     public:
         void execute(cpu_t& cpu) const override {
+            if (cpu.stack.size() == 0) {
+                throw_at(cpu, "Return with an empty stack");
+            }
             cpu.pc = cpu.stack.top();
             cpu.stack.pop();
         }
@@ -108,6 +122,9 @@ namespace chip8 {
         }
 
         void execute(cpu_t &cpu) const override {
+            if (cpu.stack.size() == cpu.stack.max_size()) {
+                throw_at(cpu, "Stack overflow");
+            }
             cpu.stack.push(cpu.pc);
             // FIXME: Validate target address and throw an error?
             cpu.pc = mTargetAddress;
@@ -568,10 +585,12 @@ namespace chip8 {
      */
     class StoreRandomWithMaskInstruction : public Instruction {
     public:
+        /**
+         * Draw from the machine's own generator, see cpu_t::rngState.
+         */
         StoreRandomWithMaskInstruction(uint8_t reg, uint8_t mask)
             : mRegister(reg),
-              mMask(mask),
-              mRNG(std::make_shared<RealRandomNumberGenerator<uint8_t>>())
+              mMask(mask)
         {
         }
 
@@ -584,7 +603,8 @@ namespace chip8 {
 
         void execute(cpu_t &cpu) const override
         {
-            cpu.V[mRegister] = mRNG->getNext() & mMask;
+            uint8_t value = mRNG ? mRNG->getNext() : next_random(cpu.rngState);
+            cpu.V[mRegister] = value & mMask;
         }
 
         std::string toString() const override
@@ -625,27 +645,12 @@ namespace chip8 {
             auto x = cpu.V[mRegisterX];
             auto y = cpu.V[mRegisterY];
 
-            auto iter = cpu.memory.begin() + cpu.I;
-            auto end = cpu.memory.begin() + cpu.I + mLength + 1;
-            auto line = 0;
-            while (iter != end) {
-                auto row = *iter;
-
-                for (int pixel = 0; pixel < 8; pixel++) {
-                    if (row & (0x80 >> pixel)) {
-                        int fbIdx = x + pixel + ((y + line) * 64);
-
-                        if (cpu.fb[fbIdx]) {
-                            cpu.V[15] = 0x1;
-                        }
-
-                        cpu.fb[fbIdx] ^= true;
-                    }
-                }
-
-                ++iter;
-                ++line;
+            bool collision{false};
+            for (uint8_t line = 0; line < mLength; line++) {
+                collision |= cpu.fb.drawRow(x, y + line, cpu.memory[cpu.I + line]);
             }
+
+            cpu.V[15] = collision ? 0x1 : 0x0;
         }
 
         std::string toString() const override {
@@ -672,7 +677,9 @@ namespace chip8 {
         }
 
         void execute(cpu_t &cpu) const override {
-            assert(false);
+            if ((cpu.keys >> (cpu.V[mRegister] & 0xF)) & 1) {
+                cpu.pc += 2;
+            }
         }
 
         std::string toString() const override {
@@ -695,7 +702,9 @@ namespace chip8 {
         }
 
         void execute(cpu_t &cpu) const override {
-            assert(false);
+            if (!((cpu.keys >> (cpu.V[mRegister] & 0xF)) & 1)) {
+                cpu.pc += 2;
+            }
         }
 
         std::string toString() const override {
@@ -729,6 +738,10 @@ namespace chip8 {
 
     /**
      * FX0A	Wait for a keypress and store the result in register VX
+     *
+     * If a key is already held it is stored straight away. Otherwise the machine suspends until one is, see
+     * Machine::step(), rather than running this instruction over and over. If several keys are held, the lowest one
+     * is stored.
      */
     class WaitForKeypressInstruction : public Instruction {
     public:
@@ -738,13 +751,33 @@ namespace chip8 {
         }
 
         void execute(cpu_t &cpu) const override {
-            assert(false);
+            cpu.keyWait = mRegister;
+            resume(cpu);
         }
 
         std::string toString() const override {
             return "KEYD";
         }
 
+        /**
+         * Finish waiting, if a key is held.
+         *
+         * @return false if the machine is still waiting.
+         */
+        static bool resume(cpu_t &cpu) {
+            if (cpu.keys == 0) {
+                return false;
+            }
+
+            uint8_t key{0};
+            while (!((cpu.keys >> key) & 1)) {
+                key++;
+            }
+            cpu.V[cpu.keyWait] = key;
+            cpu.keyWait = NO_KEY_WAIT;
+            return true;
+        }
+
     private:
         uint8_t mRegister;
     };
@@ -848,9 +881,10 @@ namespace chip8 {
 
         void execute(cpu_t &cpu) const override
         {
-            cpu.memory[cpu.I] = cpu.V[mRegister] / static_cast<uint8_t>(100) % static_cast<uint8_t>(10);
-            cpu.memory[cpu.I + 1] = cpu.V[mRegister] / static_cast<uint8_t>(10) % static_cast<uint8_t>(10);
-            cpu.memory[cpu.I + 2] = cpu.V[mRegister] % static_cast<uint8_t>(10);
+            cpu.code.invalidate(cpu.I, 3);
+            cpu.memory.write(cpu.I, cpu.V[mRegister] / static_cast<uint8_t>(100) % static_cast<uint8_t>(10));
+            cpu.memory.write(cpu.I + 1, cpu.V[mRegister] / static_cast<uint8_t>(10) % static_cast<uint8_t>(10));
+            cpu.memory.write(cpu.I + 2, cpu.V[mRegister] % static_cast<uint8_t>(10));
         }
 
         std::string toString() const override
@@ -875,7 +909,8 @@ namespace chip8 {
 
         void execute(cpu_t &cpu) const override {
             auto byte_count = mUpToRegister + static_cast<uint16_t>(1);
-            std::copy_n(cpu.V.begin(), byte_count, cpu.memory.begin() + cpu.I);
+            cpu.code.invalidate(cpu.I, byte_count);
+            cpu.memory.write(cpu.I, cpu.V.data(), byte_count);
             cpu.I = cpu.I + byte_count;
         }
 
@@ -900,7 +935,7 @@ namespace chip8 {
 
         void execute(cpu_t &cpu) const override {
             auto byte_count = mUpToRegister + static_cast<uint16_t>(1);
-            std::copy_n(cpu.memory.begin() + cpu.I, byte_count, cpu.V.begin());
+            cpu.memory.read(cpu.I, cpu.V.data(), byte_count);
             cpu.I = cpu.I + byte_count + static_cast<uint16_t>(1);
         }
 
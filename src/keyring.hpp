@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace chip8 {
+    /**
+     * A change to the keypad, from the input thread to a running machine.
+     */
+    struct KeyEvent {
+        // The emulated cycle the keys change on: the instruction slot, counting ipf slots per frame from the first
+        // frame, before which they are applied. Events stamped in the past apply at the next slot.
+        uint64_t cycle;
+
+        // The state of the whole keypad from then on, one bit per key as in cpu_t::keys
+        uint16_t keys;
+    };
+
+    /**
+     * A fixed capacity ring carrying key events from one producer thread to one consumer thread without locking.
+     *
+     * Each side owns one index and only reads the other's, so there is no read-modify-write on either path. Each also
+     * keeps a copy of the other's index and only reloads it when the ring looks full or empty, so in the common case a
+     * push or pop touches no cache line the other side is writing. The capacity is rounded up to a power of two.
+     */
+    class KeyRing final {
+    public:
+        explicit KeyRing(std::size_t capacity = 64)
+            : mMask(roundUp(capacity) - 1),
+              mEvents(new KeyEvent[mMask + 1])
+        {
+        }
+
+        KeyRing(const KeyRing &) = delete;
+        KeyRing &operator=(const KeyRing &) = delete;
+
+        /**
+         * Producer only.
+         *
+         * @return false if the ring is full.
+         */
+        bool push(const KeyEvent &event) {
+            std::size_t tail = mTail.load(std::memory_order_relaxed);
+            if (tail - mHeadCache > mMask) {
+                mHeadCache = mHead.load(std::memory_order_acquire);
+                if (tail - mHeadCache > mMask) {
+                    return false;
+                }
+            }
+
+            mEvents[tail & mMask] = event;
+            mTail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Consumer only.
+         *
+         * @return the oldest event, which stays in the ring until pop(), or nullptr if the ring is empty.
+         */
+        const KeyEvent *front() {
+            std::size_t head = mHead.load(std::memory_order_relaxed);
+            if (head == mTailCache) {
+                mTailCache = mTail.load(std::memory_order_acquire);
+                if (head == mTailCache) {
+                    return nullptr;
+                }
+            }
+            return &mEvents[head & mMask];
+        }
+
+        /**
+         * Consumer only. Drop the event front() returned.
+         */
+        void pop() {
+            mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        std::size_t capacity() const {
+            return mMask + 1;
+        }
+
+    private:
+        static std::size_t roundUp(std::size_t capacity) {
+            std::size_t rounded{1};
+            while (rounded < capacity) {
+                rounded <<= 1;
+            }
+            return rounded;
+        }
+
+        const std::size_t mMask;
+        std::unique_ptr<KeyEvent[]> mEvents;
+
+        // Written by the producer, with its copy of the consumer's index
+        alignas(64) std::atomic<std::size_t> mTail{0};
+        std::size_t mHeadCache{0};
+
+        // Written by the consumer, with its copy of the producer's index
+        alignas(64) std::atomic<std::size_t> mHead{0};
+        std::size_t mTailCache{0};
+    };
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "cpu.hpp"
+#include "machine.hpp"
+#include "rom.hpp"
+
+namespace chip8 {
+    /**
+     * Where two machines running the same program stopped agreeing.
+     */
+    struct Divergence {
+        // Instructions both machines had executed when the difference was seen
+        uint64_t instructions{0};
+
+        // The last instruction executed before the difference was seen
+        uint16_t pc{0};
+        uint16_t opcode{0};
+
+        // The first part of the machine state that differs, like "V[3]" or "memory[0x2a4]", and its value on either
+        // machine
+        std::string field;
+        std::string reference;
+        std::string candidate;
+
+        std::string describe() const {
+            std::ostringstream s;
+            s << field << " is " << reference << " on the reference but " << candidate << " on the candidate, after "
+              << instructions << " instructions; the last was 0x" << std::hex << std::setw(4) << std::setfill('0')
+              << opcode << " at 0x" << std::setw(3) << pc;
+            return s.str();
+        }
+    };
+
+    namespace detail {
+        template <typename T>
+        std::string hex(T value) {
+            std::ostringstream s;
+            s << "0x" << std::hex << static_cast<uint64_t>(value);
+            return s.str();
+        }
+
+        /**
+         * Fill in divergence if a and b differ. The field is named field, or field[index] when there is an index, and
+         * the name is only built when it is needed.
+         */
+        template <typename T>
+        bool differ(const char *field, T a, T b, Divergence &divergence, long index = -1) {
+            if (a == b) {
+                return false;
+            }
+            divergence.field = index < 0 ? field : std::string(field) + "[" + std::to_string(index) + "]";
+            divergence.reference = hex(a);
+            divergence.candidate = hex(b);
+            return true;
+        }
+
+        /**
+         * Whether everything find_difference() compares is the same, as fast as possible, since machines mostly are.
+         */
+        inline bool same(const cpu_t &a, const cpu_t &b) {
+            if (a.pc != b.pc || a.I != b.I || a.V != b.V || a.delayTimer != b.delayTimer
+                || a.soundTimer != b.soundTimer || a.keyWait != b.keyWait || a.rngState != b.rngState
+                || a.keys != b.keys || a.stack.size() != b.stack.size()) {
+                return false;
+            }
+
+            for (std::size_t i = 0; i < a.stack.size(); i++) {
+                if (a.stack[i] != b.stack[i]) {
+                    return false;
+                }
+            }
+
+            return a.fb == b.fb && a.memory == b.memory;
+        }
+    }
+
+    /**
+     * Compare everything a program can observe about two machines: registers, timers, the keypad, the stack, memory
+     * and the screen. Bookkeeping that engines keep for themselves, like which memory has been run as code, isn't
+     * compared.
+     *
+     * @return true, with the field, reference and candidate of divergence filled in for the first difference, if the
+     *         states differ.
+     */
+    inline bool find_difference(const cpu_t &reference, const cpu_t &candidate, Divergence &divergence) {
+        if (detail::same(reference, candidate)) {
+            return false;
+        }
+
+        if (detail::differ("pc", reference.pc, candidate.pc, divergence)
+            || detail::differ("I", reference.I, candidate.I, divergence)) {
+            return true;
+        }
+
+        for (std::size_t i = 0; i < reference.V.size(); i++) {
+            if (detail::differ("V", reference.V[i], candidate.V[i], divergence, static_cast<long>(i))) {
+                return true;
+            }
+        }
+
+        if (detail::differ("delayTimer", reference.delayTimer, candidate.delayTimer, divergence)
+            || detail::differ("soundTimer", reference.soundTimer, candidate.soundTimer, divergence)
+            || detail::differ("keyWait", reference.keyWait, candidate.keyWait, divergence)
+            || detail::differ("rngState", reference.rngState, candidate.rngState, divergence)
+            || detail::differ("keys", reference.keys, candidate.keys, divergence)
+            || detail::differ("stack.size()", reference.stack.size(), candidate.stack.size(), divergence)) {
+            return true;
+        }
+
+        for (std::size_t i = 0; i < reference.stack.size(); i++) {
+            if (detail::differ("stack", reference.stack[i], candidate.stack[i], divergence, static_cast<long>(i))) {
+                return true;
+            }
+        }
+
+        if (reference.memory != candidate.memory) {
+            for (std::size_t address = 0; address < reference.memory.size(); address++) {
+                if (reference.memory[address] != candidate.memory[address]) {
+                    detail::differ("memory", reference.memory[address], candidate.memory[address], divergence);
+                    divergence.field += "[" + detail::hex(address) + "]";
+                    return true;
+                }
+            }
+        }
+
+        for (std::size_t y = 0; y < DISPLAY_HEIGHT; y++) {
+            if (detail::differ("fb.rows", reference.fb.rows()[y], candidate.fb.rows()[y], divergence,
+                               static_cast<long>(y))) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Runs a program on a reference machine, which decodes every instruction afresh, and on a candidate machine using
+     * the engine under test, side by side with the same seed and input, and compares their whole state every interval
+     * instructions. This is how a new engine qualifies: it must never diverge from the reference.
+     *
+     * With an interval of 1, a divergence names the instruction that caused it. With longer intervals checking is
+     * cheaper, but the cause may be up to interval instructions before the one named; run again with 1 to pin it down.
+     *
+     * Errors count as state: if one machine throws a MachineError, the other must throw the same one, which is then
+     * passed on.
+     */
+    class Lockstep final {
+    public:
+        explicit Lockstep(Engine candidate, uint64_t interval = 1)
+            : mInterval(interval > 0 ? interval : 1)
+        {
+            mReference.setEngine(Engine::decode);
+            mCandidate.setEngine(candidate);
+        }
+
+        void loadProgram(const uint8_t *data, std::size_t size) {
+            mReference.loadProgram(data, size);
+            mCandidate.loadProgram(data, size);
+            restart();
+        }
+
+        void loadProgram(const Rom &rom) {
+            mReference.loadProgram(rom);
+            mCandidate.loadProgram(rom);
+            restart();
+        }
+
+        void seed(uint32_t seed) {
+            mReference.seed(seed);
+            mCandidate.seed(seed);
+        }
+
+        void setKeys(uint16_t keys) {
+            mReference.setKeys(keys);
+            mCandidate.setKeys(keys);
+        }
+
+        void tickTimers() {
+            mReference.tickTimers();
+            mCandidate.tickTimers();
+        }
+
+        /**
+         * Execute one instruction on both machines, and compare them if it is time to.
+         *
+         * @return false if the machines have diverged, now or before.
+         * @throws MachineError if both machines failed the same way, and are otherwise still in agreement.
+         */
+        bool step() {
+            if (mDiverged) {
+                return false;
+            }
+
+            mLastPc = mReference.cpu().pc;
+            mLastOpcode = static_cast<uint16_t>(mReference.cpu().memory[mLastPc] << 8
+                                                | mReference.cpu().memory[mLastPc + 1]);
+
+            std::string referenceError{run(mReference)};
+            std::string candidateError{run(mCandidate)};
+            mInstructions++;
+
+            if (referenceError != candidateError) {
+                return diverge("error", referenceError.empty() ? "none" : referenceError,
+                               candidateError.empty() ? "none" : candidateError);
+            }
+            if (!referenceError.empty()) {
+                if (!check()) {
+                    return false;
+                }
+                throw MachineError(referenceError);
+            }
+
+            if (++mSinceCheck >= mInterval) {
+                return check();
+            }
+            return true;
+        }
+
+        /**
+         * Run one 60 Hz frame on both machines: instructionsPerFrame instructions, then a timer tick.
+         *
+         * @return false if the machines have diverged.
+         * @throws MachineError if both machines failed the same way.
+         */
+        bool runFrame(unsigned instructionsPerFrame) {
+            for (unsigned i = 0; i < instructionsPerFrame && !mReference.waitingForKey(); i++) {
+                if (!step()) {
+                    return false;
+                }
+            }
+            tickTimers();
+            return true;
+        }
+
+        /**
+         * Compare the machines now, whatever the interval.
+         *
+         * @return false if they have diverged.
+         */
+        bool check() {
+            mSinceCheck = 0;
+            if (mDiverged) {
+                return false;
+            }
+
+            Divergence divergence;
+            if (find_difference(mReference.cpu(), mCandidate.cpu(), divergence)) {
+                return diverge(divergence.field, divergence.reference, divergence.candidate);
+            }
+            return true;
+        }
+
+        bool diverged() const {
+            return mDiverged;
+        }
+
+        /**
+         * Where the machines diverged. Only meaningful once diverged() is true.
+         */
+        const Divergence &divergence() const {
+            return mDivergence;
+        }
+
+        uint64_t instructions() const {
+            return mInstructions;
+        }
+
+        const Machine &reference() const {
+            return mReference;
+        }
+
+        const Machine &candidate() const {
+            return mCandidate;
+        }
+
+    private:
+        static std::string run(Machine &machine) {
+            try {
+                machine.step();
+            } catch (const MachineError &e) {
+                return e.what();
+            }
+            return std::string();
+        }
+
+        void restart() {
+            mInstructions = 0;
+            mSinceCheck = 0;
+            mLastPc = PROGRAM_START;
+            mLastOpcode = 0;
+            mDiverged = false;
+            mDivergence = Divergence();
+        }
+
+        bool diverge(const std::string &field, const std::string &reference, const std::string &candidate) {
+            mDiverged = true;
+            mDivergence.instructions = mInstructions;
+            mDivergence.pc = mLastPc;
+            mDivergence.opcode = mLastOpcode;
+            mDivergence.field = field;
+            mDivergence.reference = reference;
+            mDivergence.candidate = candidate;
+            return false;
+        }
+
+        Machine mReference;
+        Machine mCandidate;
+        uint64_t mInterval;
+
+        uint64_t mInstructions{0};
+        uint64_t mSinceCheck{0};
+        uint16_t mLastPc{PROGRAM_START};
+        uint16_t mLastOpcode{0};
+        bool mDiverged{false};
+        Divergence mDivergence;
+    };
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "cpu.hpp"
+#include "decode.hpp"
+#include "decodecache.hpp"
+#include "font.hpp"
+#include "rom.hpp"
+#include "translationcache.hpp"
+
+namespace chip8 {
+    /**
+     * How a machine gets from an opcode to something it can execute.
+     */
+    enum class Engine {
+        // Decode each instruction once, and keep it in the decode cache
+        cached,
+
+        // Decode every instruction afresh each time it runs. Slow, but it has no state to get wrong, so it is the
+        // reference the cache is checked against and the baseline it is measured against.
+        decode,
+    };
+
+    inline const char *engine_name(Engine engine) {
+        return engine == Engine::decode ? "decode" : "cached";
+    }
+
+    /**
+     * @return false if name isn't the name of an engine.
+     */
+    inline bool parse_engine(const std::string &name, Engine &engine) {
+        for (Engine candidate : {Engine::cached, Engine::decode}) {
+            if (name == engine_name(candidate)) {
+                engine = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    class Machine final {
+    public:
+        void reset() {
+            mCpu.reset();
+            mDecodeCache.clear();
+
+            // Load the font
+            mCpu.memory.write(FONT_DATA_OFFSET, FONT_DATA.data(), FONT_DATA.size());
+        }
+
+        /**
+         * Reset the machine and copy a program image into memory at PROGRAM_START.
+         *
+         * @throws RomError if the image does not fit.
+         */
+        void loadProgram(const uint8_t *data, std::size_t size) {
+            checkProgramSize(size);
+            reset();
+            mCpu.memory.write(PROGRAM_START, data, size);
+        }
+
+        /**
+         * Reset the machine and load a ROM, sharing decoded code and unmodified memory pages with every other
+         * machine in the process running the same ROM. The image is only read while loading: it is copied into
+         * memory once, by the first machine to load it, and only compared by the rest.
+         *
+         * The first machine to load the ROM decodes everything reachable in it up front. Given a TranslationCache,
+         * the control flow analysis that takes is loaded from the cache, and stored there if it isn't in it yet.
+         */
+        void loadProgram(const RomImage &rom, const TranslationCache *cache = nullptr) {
+            checkProgramSize(rom.size);
+            mCpu.reset();
+            mDecodeCache.clear();
+
+            std::shared_ptr<const SharedCode> shared = SharedCodeRegistry::global().acquire(rom, cache);
+            mCpu.memory.share(std::shared_ptr<const uint8_t>(shared, shared->image()));
+            mDecodeCache.share(std::move(shared));
+        }
+
+        /**
+         * Execute one instruction.
+         *
+         * While the machine is suspended in FX0A, waiting for a key, this does nothing until one is held; then
+         * storing the key finishes the FX0A and counts as the instruction.
+         *
+         * @return false if nothing was executed, because the machine is still waiting for a key.
+         * @throws MachineError if the instruction at the program counter can't be decoded, or can't be executed.
+         */
+        bool step() {
+            if (mCpu.keyWait != NO_KEY_WAIT) {
+                return WaitForKeypressInstruction::resume(mCpu);
+            }
+
+            if (mEngine == Engine::decode) {
+                std::unique_ptr<Instruction> decoded = decode_opcode(opcodeAtPc());
+                execute(decoded.get());
+            } else {
+                // Fetch the decoded instruction, decoding it only if this code has not been seen before
+                execute(mDecodeCache.fetch(mCpu));
+            }
+            return true;
+        }
+
+        /**
+         * Whether the machine is suspended in FX0A with no key held, so that stepping it would do nothing until
+         * setKeys() presses one. Schedulers can park it until then, only catching its timers up when it wakes.
+         */
+        bool waitingForKey() const {
+            return mCpu.keyWait != NO_KEY_WAIT && mCpu.keys == 0;
+        }
+
+        /**
+         * Whether the program has stopped in a jump to itself, which is how most programs end. Nothing but the timers
+         * will ever change again, so schedulers can park it for good.
+         */
+        bool halted() const {
+            return mCpu.keyWait == NO_KEY_WAIT && opcodeAtPc() == (0x1000 | mCpu.pc);
+        }
+
+        /**
+         * Whether the machine is spinning in the usual loop waiting for the delay timer to run out, and if so for how
+         * many more whole frames:
+         *
+         *   loop: FX07     ; VX = delay timer
+         *         3X00     ; if VX == 0 skip the jump
+         *         1loop
+         *
+         * The loop can only get out in the frame after the timer reads 0, so if it reads d now, the next d frames are
+         * spent spinning, whatever the number of instructions per frame.
+         *
+         * @return the number of frames spent spinning, or 0 if the machine isn't in the loop.
+         */
+        unsigned delayWaitFrames() const {
+            uint16_t loop;
+            uint8_t x;
+            if (mCpu.delayTimer == 0 || !findDelayWait(loop, x)) {
+                return 0;
+            }
+
+            // Sitting on the skip, VX is what will be tested next
+            if (mCpu.pc == loop + 2 && mCpu.V[x] == 0) {
+                return 0;
+            }
+            return mCpu.delayTimer;
+        }
+
+        /**
+         * Fast forward frames (at most delayWaitFrames()) of the delay timer loop, leaving the machine exactly as if
+         * they had been run at instructionsPerFrame.
+         */
+        void skipDelayWait(uint64_t frames, unsigned instructionsPerFrame) {
+            uint16_t loop;
+            uint8_t x;
+            if (frames == 0 || !findDelayWait(loop, x)) {
+                return;
+            }
+
+            // Steps go round the three instructions. The last FX07 to run read the timer as it was in its frame.
+            uint64_t steps{frames * instructionsPerFrame};
+            uint64_t position{static_cast<uint64_t>(mCpu.pc - loop) / 2};
+            if (steps > (3 - position) % 3) {
+                uint64_t lastRead{steps - 1 - (steps - 1 + position) % 3};
+                mCpu.V[x] = static_cast<uint8_t>(mCpu.delayTimer - lastRead / instructionsPerFrame);
+            }
+            mCpu.pc = static_cast<uint16_t>(loop + 2 * ((position + steps) % 3));
+            tickTimers(frames);
+        }
+
+        /**
+         * Count the delay and sound timers down, by one per frame. Call at 60 Hz, or with the number of frames that
+         * have gone by since the last call.
+         */
+        void tickTimers(uint64_t frames = 1) {
+            mCpu.delayTimer = static_cast<uint8_t>(mCpu.delayTimer - std::min<uint64_t>(mCpu.delayTimer, frames));
+            mCpu.soundTimer = static_cast<uint8_t>(mCpu.soundTimer - std::min<uint64_t>(mCpu.soundTimer, frames));
+        }
+
+        /**
+         * Run one 60 Hz frame: instructionsPerFrame instructions, or fewer if the machine starts waiting for a key,
+         * then a timer tick.
+         */
+        void runFrame(unsigned instructionsPerFrame) {
+            for (unsigned i = 0; i < instructionsPerFrame; i++) {
+                if (!step()) {
+                    break;
+                }
+            }
+            tickTimers();
+        }
+
+        /**
+         * Rows of the screen that have changed since the last call, one bit per row, for presenting only those.
+         */
+        uint32_t takeDirtyRows() {
+            return mCpu.fb.takeDirtyRows();
+        }
+
+        /**
+         * Set which keys are held down, one bit per key.
+         */
+        void setKeys(uint16_t keys) {
+            mCpu.keys = keys;
+        }
+
+        /**
+         * Seed the generator behind CXNN. Zero would get it stuck, so it stands for the default seed.
+         */
+        void seed(uint32_t seed) {
+            mCpu.rngState = seed != 0 ? seed : DEFAULT_RNG_SEED;
+        }
+
+        void dumpCore(std::ostream& outputStream) const {
+            mCpu.dumpState(outputStream);
+        }
+
+        const cpu_t &cpu() const {
+            return mCpu;
+        }
+
+        Engine engine() const {
+            return mEngine;
+        }
+
+        void setEngine(Engine engine) {
+            mEngine = engine;
+        }
+
+    private:
+        static void checkProgramSize(std::size_t size) {
+            if (size > MAX_PROGRAM_SIZE) {
+                throw RomError("Program is " + std::to_string(size) + " bytes, but only "
+                               + std::to_string(MAX_PROGRAM_SIZE) + " bytes are available");
+            }
+        }
+
+        uint16_t opcodeAtPc() const {
+            return opcodeAt(mCpu.pc);
+        }
+
+        uint16_t opcodeAt(uint16_t address) const {
+            return static_cast<uint16_t>(mCpu.memory[address] << 8 | mCpu.memory[address + 1]);
+        }
+
+        /**
+         * Find the delay timer loop (see delayWaitFrames()) that pc is in, if it is in one.
+         */
+        bool findDelayWait(uint16_t &loop, uint8_t &x) const {
+            if (mCpu.keyWait != NO_KEY_WAIT) {
+                return false;
+            }
+
+            for (uint16_t back = 0; back <= 4 && back <= mCpu.pc; back += 2) {
+                auto start = static_cast<uint16_t>(mCpu.pc - back);
+                if (start + 6 > MEMORY_SIZE) {
+                    continue;
+                }
+
+                uint16_t read = opcodeAt(start);
+                x = static_cast<uint8_t>((read >> 8) & 0xF);
+                if ((read & 0xF0FF) == 0xF007 && opcodeAt(start + 2) == (0x3000 | x << 8)
+                    && opcodeAt(start + 4) == (0x1000 | start)) {
+                    loop = start;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void execute(const Instruction *instruction) {
+            if (!instruction) {
+                std::ostringstream s;
+                s << "Unable to decode instruction 0x" << std::hex << std::setw(4) << std::setfill('0')
+                  << opcodeAtPc() << " at 0x" << std::setw(3) << mCpu.pc;
+                throw MachineError(s.str());
+            }
+
+            // Each instruction is two bytes long, so we need to advance by two bytes. This happens before executing it,
+            // so that jumps land on their target, calls push the return address and skips skip the next instruction.
+            mCpu.pc += 2;
+
+            // Actually execute the instruction
+            instruction->execute(mCpu);
+        }
+
+        cpu_t mCpu;
+        DecodeCache mDecodeCache;
+        Engine mEngine{Engine::cached};
+    };
+}
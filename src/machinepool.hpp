@@ -0,0 +1,95 @@
+#pragma once
+
+#include <memory>
+
+#include "boundedqueue.hpp"
+#include "machine.hpp"
+#include "rom.hpp"
+#include "translationcache.hpp"
+
+namespace chip8 {
+    /**
+     * Ready-to-run machines for one ROM, so that starting a session is a pop from a queue instead of a reset and a
+     * program load.
+     *
+     * The pool keeps a golden machine with the ROM freshly loaded. Every machine it hands out is a copy of it, which
+     * thanks to shared pages and shared code is a copy of a couple of KB with no decoding at all. Sessions return
+     * their machine when they are destroyed; it is restored from the golden copy right away, so the next session
+     * gets it without doing any work.
+     *
+     * acquire() and release never lock. When the pool runs dry, a new machine is allocated instead; when it is full,
+     * returned machines are freed. Since the queue never waits, it can also look dry or full for a moment while
+     * another thread is part way through handing out or returning a machine, which costs an allocation or a free but
+     * is never wrong. The pool must outlive every session it hands out.
+     */
+    class MachinePool final {
+    public:
+        struct Recycler {
+            MachinePool *pool;
+
+            void operator()(Machine *machine) const {
+                pool->recycle(machine);
+            }
+        };
+
+        using Session = std::unique_ptr<Machine, Recycler>;
+
+        /**
+         * @param capacity The number of machines kept ready, all of which are created up front.
+         * @param cache Where to load the ROM's control flow analysis from, if anywhere. See Machine::loadProgram().
+         */
+        MachinePool(const RomImage &rom, std::size_t capacity, const TranslationCache *cache = nullptr)
+            : mReady(capacity)
+        {
+            mGolden.loadProgram(rom, cache);
+
+            for (std::size_t i = 0; i < mReady.capacity(); i++) {
+                mReady.push(new Machine(mGolden));
+            }
+        }
+
+        MachinePool(const MachinePool &) = delete;
+        MachinePool &operator=(const MachinePool &) = delete;
+
+        ~MachinePool() {
+            Machine *machine;
+            while (mReady.pop(machine)) {
+                delete machine;
+            }
+        }
+
+        /**
+         * @return A machine with the ROM loaded, ready to run, that goes back to the pool when the session is
+         * destroyed.
+         */
+        Session acquire() {
+            Machine *machine;
+            if (!mReady.pop(machine)) {
+                machine = new Machine(mGolden);
+            }
+            return Session(machine, Recycler{this});
+        }
+
+        /**
+         * The number of machines ready to be handed out. Only a snapshot while sessions are being created.
+         */
+        std::size_t available() const {
+            return mReady.size();
+        }
+
+        std::size_t capacity() const {
+            return mReady.capacity();
+        }
+
+    private:
+        void recycle(Machine *machine) {
+            *machine = mGolden;
+            if (!mReady.push(machine)) {
+                delete machine;
+            }
+        }
+
+        Machine mGolden;
+        BoundedQueue<Machine *> mReady;
+    };
+}
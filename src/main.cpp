@@ -4,85 +4,319 @@
  *  - http://mattmik.com/files/chip8/mastering/chip8.html
  *  - http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
  */
-#include <algorithm>
-#include <array>
-#include <fstream>
-#include <iostream>
+#include <chrono>
+#include <cstdlib>
 #include <iomanip>
-#include <iterator>
-#include <cstring>
+#include <iostream>
+#include <libgen.h>
+#include <memory>
+#include <system_error>
+#include <vector>
 
-#include "cpu.hpp"
-#include "decode.hpp"
-#include "font.hpp"
+#include "framepacer.hpp"
+#include "framestream.hpp"
+#include "machine.hpp"
+#include "movie.hpp"
+#include "perfcounters.hpp"
+#include "presenter.hpp"
+#include "rom.hpp"
+#include "rompack.hpp"
+#include "runner.hpp"
+#include "sharedstate.hpp"
+#include "translationcache.hpp"
+#include "upscaler.hpp"
 
-namespace chip8 {
-    class Machine final {
-    public:
-        void reset() {
-            mCpu.reset();
+namespace {
+    struct Options {
+        std::string rom;
 
-            // Load the font
-            std::copy(FONT_DATA.begin(), FONT_DATA.end(), mCpu.memory.begin() + FONT_DATA_OFFSET);
-        }
+        // Load the ROM, by title or content hash, from this pack instead of from a file
+        std::string pack;
 
-        void loadProgram(std::ifstream &inputStream) {
-            reset();
-            std::copy(
-                std::istream_iterator<uint8_t>(inputStream),
-                std::istream_iterator<uint8_t>(),
-                mCpu.memory.begin() + 0x200);
-        }
+        // Stop after this many instructions or frames, whichever comes first. 0 means no limit.
+        uint64_t instructions{0};
+        uint64_t frames{0};
 
-        /**
-         * Execute one instruction.
-         */
-        void step() {
-            // Read the next opcode from main memory
-            uint16_t opcode{static_cast<uint16_t>(mCpu.memory[mCpu.pc] << 8 | mCpu.memory[mCpu.pc + 1])};
-
-            // Decode the instruction
-            std::unique_ptr<Instruction> instruction = decode_opcode(opcode);
-            if (!instruction) {
-                std::cerr << "Unable to decode instruction: " << std::hex << opcode << std::endl;
-                exit(1); // TODO: Use an exception here instead?
-            }
+        unsigned instructionsPerFrame{10};
 
-            // Actually execute the instruction
-            instruction->execute(mCpu);
+        // Run as fast as possible instead of at 60 frames per second
+        bool turbo{false};
 
-            // Each instruction is two bytes long, so we need to advance by two bytes.
-            mCpu.pc += 2;
-        }
+        uint32_t seed{chip8::DEFAULT_RNG_SEED};
+        std::string movie;
+        chip8::Engine engine{chip8::Engine::cached};
 
-        void dumpCore(std::ostream& outputStream) {
-            mCpu.dumpState(outputStream);
-        }
+        // Keep the ROM's control flow analysis in this directory, so later runs don't have to redo it
+        std::string cache;
+
+        // Read the host's hardware performance counters around the run
+        bool counters{false};
 
-    private:
-        cpu_t mCpu;
+        // Show every frame through a headless presenter on its own thread, and report what it saw
+        bool present{false};
+
+        // The image the presenter makes of each frame it shows
+        unsigned scale{8};
+        chip8::PixelFormat format{chip8::PixelFormat::rgba8};
+
+        // Write every frame as a frame stream, to a file or unix:PATH
+        std::string stream;
+
+        // Publish the machine's state at the end of every frame in this POSIX shared memory segment
+        std::string shm;
+
+        bool hash{false};
+        bool dumpCore{false};
     };
+
+    bool parse_options(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg{argv[i]};
+
+            if (arg.compare(0, 7, "--pack=") == 0) {
+                options.pack = arg.substr(7);
+            } else if (arg.compare(0, 15, "--instructions=") == 0) {
+                options.instructions = std::strtoull(arg.c_str() + 15, nullptr, 10);
+            } else if (arg.compare(0, 9, "--frames=") == 0) {
+                options.frames = std::strtoull(arg.c_str() + 9, nullptr, 10);
+            } else if (arg.compare(0, 6, "--ipf=") == 0) {
+                options.instructionsPerFrame = static_cast<unsigned>(std::strtoul(arg.c_str() + 6, nullptr, 10));
+            } else if (arg == "--turbo") {
+                options.turbo = true;
+            } else if (arg.compare(0, 7, "--seed=") == 0) {
+                options.seed = static_cast<uint32_t>(std::strtoul(arg.c_str() + 7, nullptr, 0));
+            } else if (arg.compare(0, 8, "--movie=") == 0) {
+                options.movie = arg.substr(8);
+            } else if (arg.compare(0, 9, "--engine=") == 0) {
+                if (!chip8::parse_engine(arg.substr(9), options.engine)) {
+                    return false;
+                }
+            } else if (arg.compare(0, 8, "--cache=") == 0) {
+                options.cache = arg.substr(8);
+            } else if (arg == "--counters") {
+                options.counters = true;
+            } else if (arg == "--present") {
+                options.present = true;
+            } else if (arg.compare(0, 8, "--scale=") == 0) {
+                options.scale = static_cast<unsigned>(std::strtoul(arg.c_str() + 8, nullptr, 10));
+            } else if (arg.compare(0, 9, "--format=") == 0) {
+                if (!chip8::parse_format(arg.substr(9), options.format)) {
+                    return false;
+                }
+            } else if (arg.compare(0, 9, "--stream=") == 0) {
+                options.stream = arg.substr(9);
+            } else if (arg.compare(0, 6, "--shm=") == 0) {
+                options.shm = arg.substr(6);
+            } else if (arg == "--hash") {
+                options.hash = true;
+            } else if (arg == "--dump-core") {
+                options.dumpCore = true;
+            } else if (arg.compare(0, 2, "--") == 0 || !options.rom.empty()) {
+                return false;
+            } else {
+                options.rom = arg;
+            }
+        }
+
+        return !options.rom.empty() && options.instructionsPerFrame > 0 && options.scale > 0
+               && options.scale <= chip8::Upscaler::MAX_SCALE;
+    }
+
+    /**
+     * @param name The ROM's title, or its content hash as 16 hex digits.
+     * @return The ROM's index in the pack.
+     * @throws RomError if the pack has no such ROM.
+     */
+    std::size_t find_in_pack(const chip8::RomPack &pack, const std::string &path, const std::string &name) {
+        std::size_t index{pack.findTitle(name)};
+        if (index == pack.size() && name.size() == 16
+            && name.find_first_not_of("0123456789abcdefABCDEF") == std::string::npos) {
+            index = pack.find(std::strtoull(name.c_str(), nullptr, 16));
+        }
+        if (index == pack.size()) {
+            throw chip8::RomError(path + " has no ROM called " + name);
+        }
+        return index;
+    }
 }
 
-int main() {
-    const std::string program{"data/games/BREAKOUT"};
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: " << basename(argv[0])
+                  << " [--instructions=N] [--frames=N] [--ipf=N] [--turbo] [--seed=N] [--movie=FILE]"
+                  << " [--engine=cached|decode] [--cache=DIR] [--counters] [--present] [--scale=N]"
+                  << " [--format=rgba|gray] [--stream=FILE|unix:PATH] [--shm=NAME] [--hash] [--dump-core]"
+                  << " ROM|--pack=FILE TITLE|HASH" << std::endl;
+        return 1;
+    }
 
-    // 64 x 32 pixel display
-    // sprites are 8 pixels wide and 1-15 pixels tall
-    //const int GRAPHICS_SCALE_FACTOR{3};
+    chip8::RomCatalog catalog;
+    std::shared_ptr<const chip8::Rom> rom;
 
-    std::ifstream inputStream;
-    inputStream.open(program, std::ios::binary);
-    if (!inputStream.is_open()) {
-        std::cerr << "Unable to open file: " << std::strerror(errno) << std::endl;
+    // ROMs in a pack are loaded straight out of its mapping
+    std::unique_ptr<chip8::RomPack> pack;
+    std::size_t packIndex{0};
+    chip8::Movie movie;
+    std::unique_ptr<chip8::FrameStreamWriter> stream;
+    std::unique_ptr<chip8::SharedStateWriter> shared;
+    try {
+        if (options.pack.empty()) {
+            rom = catalog.load(options.rom);
+        } else {
+            pack.reset(new chip8::RomPack(options.pack));
+            packIndex = find_in_pack(*pack, options.pack, options.rom);
+        }
+        if (!options.movie.empty()) {
+            movie = chip8::load_movie(options.movie);
+        }
+        if (!options.stream.empty()) {
+            stream.reset(new chip8::FrameStreamWriter(options.stream));
+        }
+        if (!options.shm.empty()) {
+            shared.reset(new chip8::SharedStateWriter(options.shm));
+        }
+    } catch (const std::system_error &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const chip8::RomError &e) {
+        std::cerr << e.what() << std::endl;
         return 1;
+    } catch (const chip8::RomPackError &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (const chip8::MovieError &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<chip8::TranslationCache> cache;
+    if (!options.cache.empty()) {
+        cache.reset(new chip8::TranslationCache(options.cache));
     }
 
     chip8::Machine machine;
-    machine.loadProgram(inputStream);
-    machine.step();
+    machine.loadProgram(pack ? pack->image(packIndex) : chip8::RomImage(*rom), cache.get());
+    machine.seed(options.seed);
+    machine.setEngine(options.engine);
+
+    chip8::RunLimits limits;
+    limits.instructions = options.instructions;
+    limits.frames = options.frames;
+    limits.instructionsPerFrame = options.instructionsPerFrame;
+
+    chip8::RunStats stats;
+    int status{0};
+
+    chip8::PerfCounters counters;
+    if (options.counters) {
+        counters.start();
+    }
 
-    machine.dumpCore(std::cout);
+    // The display refreshes at 60 Hz whatever the machine does, so in turbo it skips most frames. Only the rows that
+    // changed in new frames that are shown are converted into the image, which only exists when presenting.
+    std::unique_ptr<chip8::Upscaler> upscaler;
+    std::vector<uint8_t> image;
+    uint64_t presentedHash{0};
+    std::unique_ptr<chip8::Presenter<>> presenter;
+    if (options.present) {
+        upscaler.reset(new chip8::Upscaler(options.scale, options.format));
+        image.resize(upscaler->size());
+        presenter.reset(new chip8::Presenter<>([&upscaler, &image, &presentedHash](const chip8::FrameBuffer &frame,
+                                                                                  bool fresh, uint32_t dirtyRows) {
+            if (fresh) {
+                upscaler->convert(frame, image.data(), dirtyRows);
+                presentedHash = chip8::content_hash(image.data(), image.size());
+            }
+        }));
+        presenter->start();
+    }
+
+    chip8::FramePacer<> pacer;
+    auto start = std::chrono::steady_clock::now();
+    pacer.start();
+    try {
+        chip8::run(machine, limits, movie, stats, [&options, &pacer, &presenter, &stream, &shared,
+                                                     &machine](uint64_t frame) {
+            if (presenter) {
+                presenter->publish(machine.cpu().fb, machine.takeDirtyRows());
+            }
+            if (stream) {
+                stream->write(machine.cpu().fb);
+            }
+            if (shared) {
+                shared->publish(machine.cpu(), frame + 1);
+            }
+            if (!options.turbo) {
+                pacer.wait();
+            }
+            return true;
+        });
+    } catch (const chip8::MachineError &e) {
+        std::cerr << e.what() << std::endl;
+        status = 1;
+    } catch (const std::system_error &e) {
+        std::cerr << e.what() << std::endl;
+        status = 1;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    chip8::PerfSample sample = counters.stop();
+    if (presenter) {
+        presenter->stop();
+    }
+
+    if (options.dumpCore) {
+        machine.dumpCore(std::cout);
+    }
+
+    std::cout << "instructions: " << std::dec << stats.instructions << std::endl;
+    std::cout << "frames: " << stats.frames << std::endl;
+    if (stats.waitingForKey) {
+        std::cout << "stopped: waiting for a key" << std::endl;
+    }
+    std::cout << "seconds: " << elapsed.count() << std::endl;
+    std::cout << "mips: " << (elapsed.count() > 0 ? stats.instructions / elapsed.count() / 1e6 : 0) << std::endl;
+    if (!options.turbo) {
+        chip8::PacingStats pacing = pacer.stats();
+        std::cout << "frame_ms: mean " << pacing.meanFrameNs / 1e6 << ", jitter " << pacing.jitterNs / 1e6
+                  << ", p50 " << pacing.p50FrameNs / 1e6 << ", p99 " << pacing.p99FrameNs / 1e6
+                  << ", max " << pacing.maxFrameNs / 1e6 << std::endl;
+        std::cout << "late_frames: " << pacing.lateFrames << std::endl;
+        std::cout << "resyncs: " << pacing.resyncs << std::endl;
+    }
+    if (presenter) {
+        chip8::PresentStats presented = presenter->stats();
+        std::cout << "presented: " << presented.presented << " (" << presented.duplicated << " duplicated)"
+                  << std::endl;
+        std::cout << "published: " << presented.published << " (" << presented.dropped << " dropped)" << std::endl;
+        std::cout << "converted_rows: " << presented.dirtyRows << " of "
+                  << (presented.presented - presented.duplicated) * chip8::DISPLAY_HEIGHT << std::endl;
+        std::cout << "presented_image: " << upscaler->width() << "x" << upscaler->height() << " "
+                  << chip8::format_name(upscaler->format()) << " (" << chip8::kernel_name(upscaler->kernel())
+                  << "), hash " << std::hex << std::setw(16) << std::setfill('0') << presentedHash << std::dec
+                  << std::endl;
+    }
+    if (stream) {
+        chip8::FrameStreamStats streamed = stream->stats();
+        std::cout << "streamed: " << streamed.frames << " frames (" << streamed.keyframes << " keyframes, "
+                  << streamed.dropped << " dropped), " << streamed.bytes << " bytes" << std::endl;
+    }
+    if (options.counters) {
+        if (!counters.available()) {
+            std::cout << "counters: unavailable (" << counters.error() << ")" << std::endl;
+        }
+        for (std::size_t i = 0; i < chip8::PERF_COUNTER_COUNT; i++) {
+            if (sample.valid[i]) {
+                std::cout << "perf_" << chip8::PERF_COUNTER_NAMES[i] << ": " << sample.values[i] << " ("
+                          << (stats.instructions > 0 ? static_cast<double>(sample.values[i]) / stats.instructions : 0)
+                          << " per instruction)" << std::endl;
+            }
+        }
+    }
+    if (options.hash) {
+        std::cout << "framebuffer: " << std::hex << std::setw(16) << std::setfill('0')
+                  << machine.cpu().fb.hash() << std::endl;
+    }
 
-    return 0;
+    return status;
 }
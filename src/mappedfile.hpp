@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace chip8 {
+    /**
+     * A read-only memory mapping of a whole file. The mapping is private, so the pages are shared with the page cache
+     * and with every other process mapping the same file.
+     */
+    class MappedFile final {
+    public:
+        MappedFile() = default;
+
+        /**
+         * @throws std::system_error if the file can't be opened or mapped.
+         */
+        explicit MappedFile(const std::string &path) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "Unable to open " + path);
+            }
+
+            struct stat info{};
+            if (::fstat(fd, &info) != 0) {
+                int error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "Unable to stat " + path);
+            }
+
+            if (!S_ISREG(info.st_mode)) {
+                ::close(fd);
+                throw std::system_error(EINVAL, std::generic_category(), path + " is not a regular file");
+            }
+
+            mSize = static_cast<std::size_t>(info.st_size);
+
+            // Mapping zero bytes isn't allowed, an empty file is just an empty range.
+            if (mSize > 0) {
+                void *data = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED) {
+                    int error = errno;
+                    ::close(fd);
+                    throw std::system_error(error, std::generic_category(), "Unable to map " + path);
+                }
+
+                mData = static_cast<const uint8_t *>(data);
+            }
+
+            ::close(fd);
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        MappedFile(MappedFile &&other) noexcept
+            : mData(other.mData),
+              mSize(other.mSize)
+        {
+            other.mData = nullptr;
+            other.mSize = 0;
+        }
+
+        MappedFile &operator=(MappedFile &&other) noexcept {
+            if (this != &other) {
+                unmap();
+                mData = other.mData;
+                mSize = other.mSize;
+                other.mData = nullptr;
+                other.mSize = 0;
+            }
+            return *this;
+        }
+
+        ~MappedFile() {
+            unmap();
+        }
+
+        const uint8_t *data() const {
+            return mData;
+        }
+
+        std::size_t size() const {
+            return mSize;
+        }
+
+        /**
+         * Tell the kernel the whole file is about to be read front to back.
+         */
+        void adviseSequential() const {
+            if (mData != nullptr) {
+                ::madvise(const_cast<uint8_t *>(mData), mSize, MADV_SEQUENTIAL);
+                ::madvise(const_cast<uint8_t *>(mData), mSize, MADV_WILLNEED);
+            }
+        }
+
+    private:
+        void unmap() {
+            if (mData != nullptr) {
+                ::munmap(const_cast<uint8_t *>(mData), mSize);
+                mData = nullptr;
+                mSize = 0;
+            }
+        }
+
+        const uint8_t *mData{nullptr};
+        std::size_t mSize{0};
+    };
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <istream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace chip8 {
+    class MovieError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * Recorded keypad input, played back frame by frame so that runs are reproducible.
+     *
+     * The text format has one event per line, giving the frame from which it applies and the state of the keypad as
+     * a hex mask (bit N set while key N is held) until the next event:
+     *
+     *   # Hold 5 for two seconds, then let go
+     *   0    0020
+     *   120  0000
+     *
+     * Frames must be in increasing order. Blank lines and lines starting with # are ignored.
+     */
+    class Movie final {
+    public:
+        struct Event {
+            uint64_t frame;
+            uint16_t keys;
+        };
+
+        Movie() = default;
+
+        /**
+         * @throws MovieError if the events are not in increasing frame order.
+         */
+        explicit Movie(std::vector<Event> events)
+            : mEvents(std::move(events))
+        {
+            for (std::size_t i = 1; i < mEvents.size(); i++) {
+                if (mEvents[i].frame <= mEvents[i - 1].frame) {
+                    throw MovieError("Movie events must be in increasing frame order, frame "
+                                     + std::to_string(mEvents[i].frame) + " is out of order");
+                }
+            }
+        }
+
+        /**
+         * The keypad state during frame.
+         */
+        uint16_t keysAt(uint64_t frame) const {
+            auto next = std::upper_bound(mEvents.begin(), mEvents.end(), frame, [](uint64_t f, const Event &event) {
+                return f < event.frame;
+            });
+            return next == mEvents.begin() ? 0 : std::prev(next)->keys;
+        }
+
+        /**
+         * Whether the keypad state may change after frame. Once it can't, a machine waiting for a key with none held
+         * will wait forever.
+         */
+        bool changesAfter(uint64_t frame) const {
+            return !mEvents.empty() && mEvents.back().frame > frame;
+        }
+
+        const std::vector<Event> &events() const {
+            return mEvents;
+        }
+
+        bool empty() const {
+            return mEvents.empty();
+        }
+
+    private:
+        std::vector<Event> mEvents;
+    };
+
+    namespace detail {
+        inline bool parse_number(const std::string &text, int base, unsigned long long &value) {
+            if (text.empty() || text[0] == '-' || text[0] == '+') {
+                return false;
+            }
+
+            char *end{nullptr};
+            errno = 0;
+            value = std::strtoull(text.c_str(), &end, base);
+            return errno == 0 && end == text.c_str() + text.size();
+        }
+    }
+
+    /**
+     * @throws MovieError if the input isn't a valid movie.
+     */
+    inline Movie parse_movie(std::istream &input, const std::string &name = "movie") {
+        std::vector<Movie::Event> events;
+        std::string line;
+        for (std::size_t lineNumber = 1; std::getline(input, line); lineNumber++) {
+            std::istringstream fields{line};
+            std::string frame;
+            std::string keys;
+            if (!(fields >> frame) || frame[0] == '#') {
+                continue;
+            }
+
+            std::string rest;
+            unsigned long long frameValue{0};
+            unsigned long long keysValue{0};
+            if (!(fields >> keys) || (fields >> rest)
+                || !detail::parse_number(frame, 10, frameValue)
+                || !detail::parse_number(keys, 16, keysValue)
+                || keysValue > 0xFFFF) {
+                throw MovieError(name + ":" + std::to_string(lineNumber) + ": expected FRAME KEYS, got \""
+                                 + line + "\"");
+            }
+
+            events.push_back(Movie::Event{frameValue, static_cast<uint16_t>(keysValue)});
+        }
+
+        return Movie(std::move(events));
+    }
+
+    /**
+     * @throws MovieError if the file can't be read or isn't a valid movie.
+     */
+    inline Movie load_movie(const std::string &path) {
+        std::ifstream file{path};
+        if (!file) {
+            throw MovieError("Unable to open movie " + path);
+        }
+        return parse_movie(file, path);
+    }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "codemap.hpp"
+
+namespace chip8 {
+    /**
+     * Main memory, split into pages that are shared read-only until they are first written to.
+     *
+     * Every page starts out pointing either at a shared zero page or, after share(), into an image of memory as
+     * loaded (the font plus the ROM) that every machine running the same ROM points at. The first write to a page
+     * copies it into storage owned by this machine. Most programs only ever write a handful of pages (FX33 and FX55
+     * are the only instructions that store to memory), so most of a machine's memory is never copied.
+     *
+     * Addresses wrap around at MemorySize, as on the original interpreter.
+     */
+    template <std::size_t MemorySize, std::size_t PageSize = CODE_PAGE_SIZE>
+    class PagedMemory final {
+    public:
+        static_assert(MemorySize % PageSize == 0, "Memory size must be a multiple of the page size");
+
+        PagedMemory() {
+            clear();
+        }
+
+        PagedMemory(const PagedMemory &other) {
+            *this = other;
+        }
+
+        PagedMemory &operator=(const PagedMemory &other) {
+            if (this == &other) {
+                return *this;
+            }
+
+            mImage = other.mImage;
+            for (std::size_t page = 0; page < PAGE_COUNT; page++) {
+                if (other.mPrivate[page]) {
+                    if (!mPrivate[page]) {
+                        mPrivate[page].reset(new Page());
+                    }
+                    *mPrivate[page] = *other.mPrivate[page];
+                    mPages[page] = mPrivate[page]->data();
+                } else {
+                    mPrivate[page].reset();
+                    mPages[page] = other.mPages[page];
+                }
+            }
+
+            return *this;
+        }
+
+        uint8_t operator[](std::size_t address) const {
+            address %= MemorySize;
+            return mPages[address / PageSize][address % PageSize];
+        }
+
+        /**
+         * Copy size bytes starting at address into out.
+         */
+        void read(std::size_t address, uint8_t *out, std::size_t size) const {
+            for (std::size_t i = 0; i < size; i++) {
+                out[i] = (*this)[address + i];
+            }
+        }
+
+        void write(std::size_t address, uint8_t value) {
+            address %= MemorySize;
+            writablePage(address / PageSize)[address % PageSize] = value;
+        }
+
+        void write(std::size_t address, const uint8_t *data, std::size_t size) {
+            while (size > 0) {
+                address %= MemorySize;
+                std::size_t offset = address % PageSize;
+                std::size_t count = std::min(size, PageSize - offset);
+
+                std::memcpy(writablePage(address / PageSize) + offset, data, count);
+
+                address += count;
+                data += count;
+                size -= count;
+            }
+        }
+
+        /**
+         * Zero all of memory, dropping every private page and any shared image.
+         */
+        void clear() {
+            mImage.reset();
+            for (std::size_t page = 0; page < PAGE_COUNT; page++) {
+                mPrivate[page].reset();
+                mPages[page] = zeroPage();
+            }
+        }
+
+        /**
+         * Replace the contents of memory with image, which must be MemorySize bytes and is never written to. Pages
+         * point into the image until they are written, and keep it alive until then.
+         */
+        void share(std::shared_ptr<const uint8_t> image) {
+            mImage = std::move(image);
+            for (std::size_t page = 0; page < PAGE_COUNT; page++) {
+                mPrivate[page].reset();
+                mPages[page] = mImage.get() + page * PageSize;
+            }
+        }
+
+        /**
+         * Whether the page containing address has been copied into storage owned by this memory.
+         */
+        bool isPrivate(std::size_t address) const {
+            return static_cast<bool>(mPrivate[(address % MemorySize) / PageSize]);
+        }
+
+        std::size_t privatePageCount() const {
+            return static_cast<std::size_t>(std::count_if(mPrivate.begin(), mPrivate.end(),
+                                                          [](const std::unique_ptr<Page> &page) {
+                                                              return static_cast<bool>(page);
+                                                          }));
+        }
+
+        std::size_t size() const {
+            return MemorySize;
+        }
+
+        bool operator==(const PagedMemory &other) const {
+            for (std::size_t page = 0; page < PAGE_COUNT; page++) {
+                if (mPages[page] != other.mPages[page]
+                    && std::memcmp(mPages[page], other.mPages[page], PageSize) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool operator!=(const PagedMemory &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        static const std::size_t PAGE_COUNT{MemorySize / PageSize};
+
+        using Page = std::array<uint8_t, PageSize>;
+
+        static const uint8_t *zeroPage() {
+            static const Page zero{};
+            return zero.data();
+        }
+
+        uint8_t *writablePage(std::size_t page) {
+            if (!mPrivate[page]) {
+                mPrivate[page].reset(new Page());
+                std::memcpy(mPrivate[page]->data(), mPages[page], PageSize);
+                mPages[page] = mPrivate[page]->data();
+            }
+            return mPrivate[page]->data();
+        }
+
+        std::array<const uint8_t *, PAGE_COUNT> mPages;
+        std::array<std::unique_ptr<Page>, PAGE_COUNT> mPrivate;
+        std::shared_ptr<const uint8_t> mImage;
+    };
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace chip8 {
+    enum PerfCounter {
+        PERF_CYCLES,
+        PERF_INSTRUCTIONS,
+        PERF_BRANCH_MISSES,
+        PERF_L1D_MISSES,
+        PERF_COUNTER_COUNT
+    };
+
+    const std::array<const char *, PERF_COUNTER_COUNT> PERF_COUNTER_NAMES = {
+        "cycles",
+        "instructions",
+        "branch_misses",
+        "l1d_misses",
+    };
+
+    /**
+     * What the counters counted between PerfCounters::start() and stop(). Counters that could not be opened, or never
+     * got onto the hardware while they were enabled, are not valid, and read 0.
+     */
+    struct PerfSample {
+        std::array<uint64_t, PERF_COUNTER_COUNT> values{};
+        std::array<bool, PERF_COUNTER_COUNT> valid{};
+    };
+
+    /**
+     * The host CPU's hardware performance counters for the calling thread, in user space only, read through Linux's
+     * perf_event_open.
+     *
+     * Each counter is opened on its own, so a CPU or hypervisor that lacks one of them only loses that one. Where
+     * there are no counters at all (containers, virtual machines without a PMU, perf_event_paranoid, other operating
+     * systems) nothing is available, start() and stop() do nothing, and callers fall back on wall-clock time.
+     *
+     * If the kernel has to multiplex the counters, values are scaled up to the whole time they were enabled.
+     */
+    class PerfCounters final {
+    public:
+        PerfCounters() {
+            mFds.fill(-1);
+
+#ifdef __linux__
+            const std::array<std::pair<uint32_t, uint64_t>, PERF_COUNTER_COUNT> events = {{
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+                {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+                                     | PERF_COUNT_HW_CACHE_OP_READ << 8
+                                     | PERF_COUNT_HW_CACHE_RESULT_MISS << 16},
+            }};
+
+            for (std::size_t i = 0; i < events.size(); i++) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = events[i].first;
+                attr.config = events[i].second;
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+                mFds[i] = static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+                if (mFds[i] < 0 && mError.empty()) {
+                    mError = std::string("perf_event_open for ") + PERF_COUNTER_NAMES[i] + ": " + std::strerror(errno);
+                }
+            }
+#else
+            mError = "hardware counters are only supported on Linux";
+#endif
+        }
+
+        ~PerfCounters() {
+#ifdef __linux__
+            for (int fd : mFds) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+#endif
+        }
+
+        PerfCounters(const PerfCounters &) = delete;
+        PerfCounters &operator=(const PerfCounters &) = delete;
+
+        /**
+         * @return true if at least one counter is available.
+         */
+        bool available() const {
+            for (int fd : mFds) {
+                if (fd >= 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool available(PerfCounter counter) const {
+            return mFds[counter] >= 0;
+        }
+
+        /**
+         * Why the first counter that could not be opened wasn't, or empty if they all were.
+         */
+        const std::string &error() const {
+            return mError;
+        }
+
+        /**
+         * Zero the counters and start counting.
+         */
+        void start() {
+#ifdef __linux__
+            for (int fd : mFds) {
+                if (fd >= 0) {
+                    ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+#endif
+        }
+
+        /**
+         * Stop counting.
+         *
+         * @return what was counted since start().
+         */
+        PerfSample stop() {
+            PerfSample sample;
+
+#ifdef __linux__
+            for (int fd : mFds) {
+                if (fd >= 0) {
+                    ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                }
+            }
+
+            for (std::size_t i = 0; i < mFds.size(); i++) {
+                // value, time enabled, time running
+                uint64_t values[3];
+                if (mFds[i] < 0 || ::read(mFds[i], values, sizeof(values)) != sizeof(values)) {
+                    continue;
+                }
+
+                // A counter the kernel never got to schedule counted nothing, and there is nothing to scale up
+                if (values[2] == 0) {
+                    continue;
+                }
+
+                sample.valid[i] = true;
+                sample.values[i] = values[2] >= values[1]
+                                   ? values[0]
+                                   : static_cast<uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+            }
+#endif
+
+            return sample;
+        }
+
+    private:
+        std::array<int, PERF_COUNTER_COUNT> mFds;
+        std::string mError;
+    };
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+
+#include "framebuffer.hpp"
+#include "framepacer.hpp"
+#include "triplebuffer.hpp"
+
+namespace chip8 {
+    struct PresentStats {
+        // Frames the machine published, and how many of them were replaced by a newer one before being shown
+        uint64_t published{0};
+        uint64_t dropped{0};
+
+        // Refreshes of the display, and how many of them showed the same frame as the one before
+        uint64_t presented{0};
+        uint64_t duplicated{0};
+
+        // Rows of the screen the sink was told had changed, over all refreshes
+        uint64_t dirtyRows{0};
+    };
+
+    /**
+     * Shows a machine's screen from a thread of its own, so that running the machine never waits on the display.
+     *
+     * The machine's thread calls publish() at the end of every frame, which copies the screen into a triple buffer
+     * and returns straight away. The presenter thread refreshes every period, taking the latest complete frame, and
+     * hands it to the sink along with whether it is new and which of its rows have changed since the last frame the
+     * sink was given. A sink can draw to a real display, or, headless, hash or record what it is given; either way it
+     * only needs to redo the dirty rows.
+     *
+     * Dirty rows are carried over frames that are dropped, so they are never lost: each frame published carries the
+     * rows of every frame before it that the presenter isn't known to have taken.
+     *
+     * Clock is MonotonicClock, or anything else FramePacer accepts.
+     */
+    template <typename Clock = MonotonicClock>
+    class Presenter final {
+    public:
+        using Sink = std::function<void(const FrameBuffer &, bool fresh, uint32_t dirtyRows)>;
+
+        explicit Presenter(Sink sink, FramePeriod period = FRAME_DURATION)
+            : mSink(std::move(sink)),
+              mPeriod(period)
+        {
+        }
+
+        Presenter(const Presenter &) = delete;
+        Presenter &operator=(const Presenter &) = delete;
+
+        ~Presenter() {
+            stop();
+        }
+
+        /**
+         * Start refreshing the display, on a new thread.
+         */
+        void start() {
+            if (mThread.joinable()) {
+                return;
+            }
+            mRunning.store(true, std::memory_order_relaxed);
+            mThread = std::thread([this]() {
+                present();
+            });
+        }
+
+        /**
+         * Stop refreshing, after showing the last frame published if it hasn't been shown yet.
+         */
+        void stop() {
+            if (!mThread.joinable()) {
+                return;
+            }
+            mRunning.store(false, std::memory_order_relaxed);
+            mThread.join();
+        }
+
+        /**
+         * Publish a complete frame, with the rows that have changed since the last one published. Machine thread only;
+         * never blocks.
+         */
+        void publish(const FrameBuffer &frame, uint32_t dirtyRows = ALL_ROWS) {
+            Frame &back = mBuffer.back();
+            back.screen = frame;
+            back.dirtyRows = dirtyRows | mUnseenRows;
+
+            if (mBuffer.publish()) {
+                // The presenter has taken the frame before, and with it all the rows before that
+                mUnseenRows = dirtyRows;
+            } else {
+                mUnseenRows = back.dirtyRows;
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            mPublished.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /**
+         * Only a snapshot while the presenter is running. A frame still waiting to be shown isn't counted as dropped.
+         */
+        PresentStats stats() const {
+            PresentStats stats;
+            stats.published = mPublished.load(std::memory_order_relaxed);
+            stats.dropped = mDropped.load(std::memory_order_relaxed);
+            stats.presented = mPresented.load(std::memory_order_relaxed);
+            stats.duplicated = mDuplicated.load(std::memory_order_relaxed);
+            stats.dirtyRows = mDirtyRows.load(std::memory_order_relaxed);
+            return stats;
+        }
+
+    private:
+        struct Frame {
+            FrameBuffer screen;
+            uint32_t dirtyRows{ALL_ROWS};
+        };
+
+        void present() {
+            // Refresh half a period out of step with the machine, which publishes on the same period, so that the two
+            // don't race for every frame
+            Clock::sleep_until(Clock::now() + std::chrono::duration_cast<std::chrono::nanoseconds>(mPeriod / 2));
+
+            FramePacer<Clock> pacer{mPeriod};
+            pacer.start();
+
+            while (mRunning.load(std::memory_order_relaxed)) {
+                pacer.wait();
+                refresh(false);
+            }
+            refresh(true);
+        }
+
+        void refresh(bool onlyIfFresh) {
+            bool fresh = mBuffer.update();
+            if (!fresh && onlyIfFresh) {
+                return;
+            }
+
+            uint32_t dirtyRows = fresh ? mBuffer.front().dirtyRows : 0;
+            mSink(mBuffer.front().screen, fresh, dirtyRows);
+            mPresented.fetch_add(1, std::memory_order_relaxed);
+            if (!fresh) {
+                mDuplicated.fetch_add(1, std::memory_order_relaxed);
+            }
+            mDirtyRows.fetch_add(std::bitset<DISPLAY_HEIGHT>(dirtyRows).count(), std::memory_order_relaxed);
+        }
+
+        Sink mSink;
+        FramePeriod mPeriod;
+
+        TripleBuffer<Frame> mBuffer;
+        std::thread mThread;
+        std::atomic<bool> mRunning{false};
+
+        // Written by the machine's thread
+        alignas(64) std::atomic<uint64_t> mPublished{0};
+        std::atomic<uint64_t> mDropped{0};
+        uint32_t mUnseenRows{0};
+
+        // Written by the presenter's thread
+        alignas(64) std::atomic<uint64_t> mPresented{0};
+        std::atomic<uint64_t> mDuplicated{0};
+        std::atomic<uint64_t> mDirtyRows{0};
+    };
+}
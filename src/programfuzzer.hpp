@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu.hpp"
+#include "decode.hpp"
+#include "rom.hpp"
+
+namespace chip8 {
+    /**
+     * Makes random programs to run different engines against each other.
+     *
+     * Programs are made of valid opcodes. Most jumps, calls and I loads are aimed back into the program itself, so
+     * that runs stay in code, loop, recurse and overwrite themselves rather than wandering off into empty memory. Some
+     * are aimed at the last few bytes of memory instead, so that stores through I and instructions run off the end
+     * and wrap around to the start. The rest go anywhere. The same seed always makes the same programs.
+     */
+    class ProgramFuzzer final {
+    public:
+        explicit ProgramFuzzer(uint64_t seed)
+            : mState(seed),
+              mOpcodes(valid_opcodes())
+        {
+        }
+
+        /**
+         * A program of instructionCount instructions, as it would be loaded at PROGRAM_START, followed by a few more
+         * in the last MEMORY_END_WINDOW bytes of memory, where runs and stores wrap around to the start.
+         */
+        std::vector<uint8_t> program(std::size_t instructionCount) {
+            std::vector<uint8_t> image(MEMORY_SIZE - PROGRAM_START);
+
+            for (std::size_t i = 0; i < instructionCount; i++) {
+                write(image, 2 * i, instruction(instructionCount));
+            }
+            for (std::size_t offset = image.size() - MEMORY_END_WINDOW; offset < image.size(); offset += 2) {
+                write(image, offset, instruction(instructionCount));
+            }
+
+            return image;
+        }
+
+        /**
+         * A random set of held keys, usually none or one.
+         */
+        uint16_t keys() {
+            uint64_t r = next();
+            switch (r % 4) {
+                case 0:
+                case 1:
+                    return 0;
+                case 2:
+                    return static_cast<uint16_t>(1 << ((r >> 8) % 16));
+                default:
+                    return static_cast<uint16_t>(r >> 16);
+            }
+        }
+
+        uint32_t seed() {
+            return static_cast<uint32_t>(next());
+        }
+
+    private:
+        // Addresses aimed at the end of memory land in its last this many bytes
+        static const uint16_t MEMORY_END_WINDOW{16};
+
+        uint16_t instruction(std::size_t instructionCount) {
+            // Stores through I, I loads aimed at the end of memory, and additions to I, which take it past the end,
+            // are rare among all the opcodes, so some of each are made on purpose
+            auto reg = static_cast<uint16_t>((next() % 16) << 8);
+            switch (next() % 16) {
+                case 0:
+                    return static_cast<uint16_t>(0xF055 | reg);
+                case 1:
+                    return static_cast<uint16_t>(0xF033 | reg);
+                case 2:
+                    return static_cast<uint16_t>(0xF01E | reg);
+                case 3:
+                    return static_cast<uint16_t>(0xA000 | end_address());
+                default:
+                    break;
+            }
+
+            uint16_t opcode = mOpcodes[next() % mOpcodes.size()];
+
+            // 1NNN, 2NNN, ANNN and BNNN
+            uint16_t kind = opcode & 0xF000;
+            bool addresses = kind == 0x1000 || kind == 0x2000 || kind == 0xA000 || kind == 0xB000;
+            if (addresses) {
+                uint64_t aim = next() % 8;
+                if (aim < 6) {
+                    auto target = static_cast<uint16_t>(PROGRAM_START + 2 * (next() % instructionCount));
+                    opcode = static_cast<uint16_t>(kind | target);
+                } else if (aim < 7) {
+                    opcode = static_cast<uint16_t>(kind | end_address());
+                }
+            }
+            return opcode;
+        }
+
+        uint16_t end_address() {
+            return static_cast<uint16_t>(MEMORY_SIZE - 1 - next() % MEMORY_END_WINDOW);
+        }
+
+        static void write(std::vector<uint8_t> &image, std::size_t offset, uint16_t opcode) {
+            image[offset] = static_cast<uint8_t>(opcode >> 8);
+            image[offset + 1] = static_cast<uint8_t>(opcode);
+        }
+
+        static const std::vector<uint16_t> &valid_opcodes() {
+            static const std::vector<uint16_t> opcodes = []() {
+                std::vector<uint16_t> valid;
+                for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++) {
+                    if (is_valid_opcode(static_cast<uint16_t>(opcode))) {
+                        valid.push_back(static_cast<uint16_t>(opcode));
+                    }
+                }
+                return valid;
+            }();
+            return opcodes;
+        }
+
+        // splitmix64
+        uint64_t next() {
+            uint64_t z = (mState += 0x9E3779B97F4A7C15);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+            return z ^ (z >> 31);
+        }
+
+        uint64_t mState;
+        const std::vector<uint16_t> &mOpcodes;
+    };
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include <boost/random.hpp>
 
 namespace chip8 {
@@ -24,4 +26,16 @@ namespace chip8 {
         boost::random::mt19937 mImpl;
         boost::random::uniform_int_distribution<> mDistribution{0, 255};
     };
+
+    /**
+     * xorshift32. Small enough to keep its whole state in cpu_t, so that instructions don't need a generator of their
+     * own and can be shared between machines.
+     */
+    inline uint8_t next_random(uint32_t &state)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return static_cast<uint8_t>(state >> 24);
+    }
 }
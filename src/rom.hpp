@@ -0,0 +1,244 @@
+#pragma once
+
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "analysis.hpp"
+#include "cpu.hpp"
+#include "hash.hpp"
+#include "mappedfile.hpp"
+
+namespace chip8 {
+    const uint16_t PROGRAM_START{0x200};
+    const std::size_t MAX_PROGRAM_SIZE{MEMORY_SIZE - PROGRAM_START};
+
+    class RomError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * Behaviours a ROM depends on that interpreters famously disagree about. Detected statically, so a flag means
+     * the ROM contains a reachable instruction whose result depends on the quirk.
+     */
+    enum Quirk : uint32_t {
+        // 8XY6 / 8XYE: shift VX in place, or shift VY into VX
+        QUIRK_SHIFT = 1 << 0,
+
+        // FX55 / FX65: whether I is left pointing past the last register
+        QUIRK_LOAD_STORE = 1 << 1,
+
+        // BNNN: jump to NNN + V0, or to XNN + VX
+        QUIRK_JUMP = 1 << 2,
+    };
+
+    inline uint32_t detect_quirks(const uint8_t *data, std::size_t size) {
+        ControlFlowGraph graph = analyze_control_flow(data, size, PROGRAM_START);
+        uint32_t quirks{0};
+
+        for (std::size_t address = PROGRAM_START; address + 1 < PROGRAM_START + size; address++) {
+            if (!graph.isInstruction(static_cast<uint16_t>(address))) {
+                continue;
+            }
+
+            uint16_t opcode{static_cast<uint16_t>(data[address - PROGRAM_START] << 8 |
+                                                  data[address - PROGRAM_START + 1])};
+
+            if ((opcode & 0xF00F) == 0x8006 || (opcode & 0xF00F) == 0x800E) {
+                quirks |= QUIRK_SHIFT;
+            } else if ((opcode & 0xF0FF) == 0xF055 || (opcode & 0xF0FF) == 0xF065) {
+                quirks |= QUIRK_LOAD_STORE;
+            } else if ((opcode & 0xF000) == 0xB000) {
+                quirks |= QUIRK_JUMP;
+            }
+        }
+
+        return quirks;
+    }
+
+    struct RomInfo {
+        uint64_t hash{0};
+        std::size_t size{0};
+        std::string title;
+        uint32_t quirks{0};
+    };
+
+    /**
+     * A validated ROM image, ready to be copied into memory at PROGRAM_START.
+     */
+    struct Rom {
+        RomInfo info;
+        std::vector<uint8_t> bytes;
+    };
+
+    /**
+     * A ROM image and its content hash, borrowed from wherever the bytes live: a Rom, or a pack's mapping (see
+     * RomPack::image()). Only valid for as long as they are.
+     */
+    struct RomImage {
+        const uint8_t *data;
+        std::size_t size;
+        uint64_t hash;
+
+        RomImage(const uint8_t *data, std::size_t size, uint64_t hash)
+            : data(data),
+              size(size),
+              hash(hash)
+        {
+        }
+
+        /**
+         * Implicit, so that anything taking an image can be given a Rom.
+         */
+        RomImage(const Rom &rom)
+            : RomImage(rom.bytes.data(), rom.bytes.size(), rom.info.hash)
+        {
+        }
+    };
+
+    /**
+     * Build a Rom from an image that is already in memory.
+     *
+     * @throws RomError if the image does not fit in the memory above PROGRAM_START.
+     */
+    inline std::shared_ptr<const Rom> make_rom(const uint8_t *data, std::size_t size, const std::string &title) {
+        if (size > MAX_PROGRAM_SIZE) {
+            throw RomError(title + " is " + std::to_string(size) + " bytes, but only "
+                           + std::to_string(MAX_PROGRAM_SIZE) + " bytes are available for programs");
+        }
+
+        auto rom = std::make_shared<Rom>();
+        rom->bytes.assign(data, data + size);
+        rom->info.hash = content_hash(data, size);
+        rom->info.size = size;
+        rom->info.title = title;
+        rom->info.quirks = detect_quirks(data, size);
+        return rom;
+    }
+
+    /**
+     * Map a ROM file and validate it.
+     *
+     * @throws RomError if the file does not fit in memory, std::system_error if it can't be read.
+     */
+    inline std::shared_ptr<const Rom> load_rom(const std::string &path) {
+        MappedFile file{path};
+        auto slash = path.find_last_of('/');
+        return make_rom(file.data(), file.size(), slash == std::string::npos ? path : path.substr(slash + 1));
+    }
+
+    /**
+     * Every ROM loaded by this process, keyed by content hash.
+     *
+     * A path that has been loaded before, and has not changed on disk since, is served straight from the catalog
+     * without reading the file again. Different paths with the same contents share a single Rom. The content hash only
+     * narrows the search: images are compared byte for byte, so two different images that happen to hash the same are
+     * kept apart.
+     *
+     * Safe to use from multiple threads.
+     */
+    class RomCatalog final {
+    public:
+        /**
+         * @throws RomError if the file does not fit in memory, std::system_error if it can't be read.
+         */
+        std::shared_ptr<const Rom> load(const std::string &path) {
+            struct stat info{};
+            if (::stat(path.c_str(), &info) != 0) {
+                throw std::system_error(errno, std::generic_category(), "Unable to stat " + path);
+            }
+
+            FileIdentity identity{
+                static_cast<uint64_t>(info.st_dev),
+                static_cast<uint64_t>(info.st_ino),
+                static_cast<uint64_t>(info.st_size),
+                static_cast<uint64_t>(info.st_mtim.tv_sec) * 1000000000ULL
+                    + static_cast<uint64_t>(info.st_mtim.tv_nsec)
+            };
+
+            {
+                std::lock_guard<std::mutex> lock{mMutex};
+                auto cached = mByPath.find(path);
+                if (cached != mByPath.end() && cached->second.identity == identity) {
+                    return cached->second.rom;
+                }
+            }
+
+            std::shared_ptr<const Rom> rom = load_rom(path);
+
+            std::lock_guard<std::mutex> lock{mMutex};
+            rom = intern(rom);
+            mByPath[path] = PathEntry{identity, rom};
+            return rom;
+        }
+
+        /**
+         * Add an image that is already in memory.
+         */
+        std::shared_ptr<const Rom> add(const uint8_t *data, std::size_t size, const std::string &title) {
+            std::shared_ptr<const Rom> rom = make_rom(data, size, title);
+
+            std::lock_guard<std::mutex> lock{mMutex};
+            return intern(rom);
+        }
+
+        /**
+         * @return A ROM with this content hash, or nullptr if none has been loaded.
+         */
+        std::shared_ptr<const Rom> find(uint64_t hash) const {
+            std::lock_guard<std::mutex> lock{mMutex};
+            auto rom = mByHash.find(hash);
+            return rom == mByHash.end() ? nullptr : rom->second;
+        }
+
+        std::size_t size() const {
+            std::lock_guard<std::mutex> lock{mMutex};
+            return mByHash.size();
+        }
+
+    private:
+        struct FileIdentity {
+            uint64_t device;
+            uint64_t inode;
+            uint64_t size;
+            uint64_t modified;
+
+            bool operator==(const FileIdentity &other) const {
+                return device == other.device && inode == other.inode && size == other.size
+                       && modified == other.modified;
+            }
+        };
+
+        struct PathEntry {
+            FileIdentity identity;
+            std::shared_ptr<const Rom> rom;
+        };
+
+        /**
+         * The ROM already in the catalog with the same bytes as rom, or rom itself once it has been added. Must be
+         * called with mMutex held.
+         */
+        std::shared_ptr<const Rom> intern(const std::shared_ptr<const Rom> &rom) {
+            auto candidates = mByHash.equal_range(rom->info.hash);
+            for (auto candidate = candidates.first; candidate != candidates.second; ++candidate) {
+                if (candidate->second->bytes == rom->bytes) {
+                    return candidate->second;
+                }
+            }
+            mByHash.emplace(rom->info.hash, rom);
+            return rom;
+        }
+
+        mutable std::mutex mMutex;
+        std::unordered_multimap<uint64_t, std::shared_ptr<const Rom>> mByHash;
+        std::unordered_map<std::string, PathEntry> mByPath;
+    };
+}
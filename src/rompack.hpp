@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mappedfile.hpp"
+#include "rom.hpp"
+
+namespace chip8 {
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Pack files are read in place, as little endian");
+
+    /**
+     * On-disk layout of a ROM pack. Everything is little endian and read in place from the mapping.
+     *
+     *   RomPackHeader
+     *   RomPackEntry[count], sorted by hash
+     *   titles, not null terminated
+     *   ROM images, each aligned to ROM_PACK_ALIGNMENT
+     */
+    const char ROM_PACK_MAGIC[8] = {'C', 'H', 'I', 'P', '8', 'P', 'A', 'K'};
+    const uint32_t ROM_PACK_VERSION{1};
+    const std::size_t ROM_PACK_ALIGNMENT{64};
+
+    struct RomPackHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+        uint64_t fileSize;
+        uint64_t entriesOffset;
+        uint64_t titlesOffset;
+        uint64_t imagesOffset;
+        uint8_t reserved[16];
+    };
+    static_assert(sizeof(RomPackHeader) == 64, "RomPackHeader is part of the file format");
+
+    struct RomPackEntry {
+        uint64_t hash;
+        uint64_t imageOffset;
+        uint32_t size;
+        uint32_t quirks;
+        uint32_t titleOffset;
+        uint32_t titleLength;
+    };
+    static_assert(sizeof(RomPackEntry) == 32, "RomPackEntry is part of the file format");
+
+    class RomPackError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    /**
+     * Write the given ROMs into a pack file. ROMs with the same content are stored once, under the first title.
+     *
+     * The pack is written to a uniquely named file next to path and renamed into place, so readers never see a partial
+     * file, even with several builders writing the same pack at once.
+     *
+     * Packs are looked up by content hash, so they can't hold two different images with the same hash.
+     *
+     * @throws RomError if two different images have the same content hash, std::system_error if the file can't be
+     *         written.
+     */
+    inline void write_rom_pack(const std::string &path, std::vector<std::shared_ptr<const Rom>> roms) {
+        std::stable_sort(roms.begin(), roms.end(), [](const std::shared_ptr<const Rom> &a,
+                                                      const std::shared_ptr<const Rom> &b) {
+            return a->info.hash < b->info.hash;
+        });
+        roms.erase(std::unique(roms.begin(), roms.end(), [](const std::shared_ptr<const Rom> &a,
+                                                            const std::shared_ptr<const Rom> &b) {
+            if (a->info.hash != b->info.hash) {
+                return false;
+            }
+            if (a->bytes != b->bytes) {
+                std::ostringstream message;
+                message << a->info.title << " and " << b->info.title << " are different images with the same "
+                        << "content hash " << std::hex << std::setw(16) << std::setfill('0') << a->info.hash
+                        << ", and a pack can only hold one of them";
+                throw RomError(message.str());
+            }
+            return true;
+        }), roms.end());
+
+        auto align = [](std::size_t offset) {
+            return (offset + ROM_PACK_ALIGNMENT - 1) / ROM_PACK_ALIGNMENT * ROM_PACK_ALIGNMENT;
+        };
+
+        RomPackHeader header{};
+        std::memcpy(header.magic, ROM_PACK_MAGIC, sizeof(header.magic));
+        header.version = ROM_PACK_VERSION;
+        header.count = static_cast<uint32_t>(roms.size());
+        header.entriesOffset = sizeof(RomPackHeader);
+        header.titlesOffset = header.entriesOffset + roms.size() * sizeof(RomPackEntry);
+
+        std::vector<RomPackEntry> entries(roms.size());
+        std::string titles;
+        for (std::size_t i = 0; i < roms.size(); i++) {
+            entries[i].hash = roms[i]->info.hash;
+            entries[i].size = static_cast<uint32_t>(roms[i]->bytes.size());
+            entries[i].quirks = roms[i]->info.quirks;
+            entries[i].titleOffset = static_cast<uint32_t>(titles.size());
+            entries[i].titleLength = static_cast<uint32_t>(roms[i]->info.title.size());
+            titles += roms[i]->info.title;
+        }
+
+        header.imagesOffset = align(header.titlesOffset + titles.size());
+
+        std::size_t offset{header.imagesOffset};
+        for (std::size_t i = 0; i < roms.size(); i++) {
+            entries[i].imageOffset = offset;
+            offset = align(offset + entries[i].size);
+        }
+        header.fileSize = offset;
+
+        std::vector<uint8_t> contents(header.fileSize, 0);
+        std::memcpy(contents.data(), &header, sizeof(header));
+        std::memcpy(contents.data() + header.entriesOffset, entries.data(), entries.size() * sizeof(RomPackEntry));
+        std::memcpy(contents.data() + header.titlesOffset, titles.data(), titles.size());
+        for (std::size_t i = 0; i < roms.size(); i++) {
+            std::memcpy(contents.data() + entries[i].imageOffset, roms[i]->bytes.data(), entries[i].size);
+        }
+
+        std::vector<char> temporary(path.begin(), path.end());
+        const char suffix[] = ".XXXXXX";
+        temporary.insert(temporary.end(), suffix, suffix + sizeof(suffix));
+        int fd = ::mkstemp(temporary.data());
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Unable to create a temporary file for " + path);
+        }
+
+        // mkstemp() makes the file private to its owner, but packs are meant to be shared
+        std::FILE *file = ::fchmod(fd, 0644) == 0 ? ::fdopen(fd, "wb") : nullptr;
+        if (file == nullptr) {
+            int error = errno;
+            ::close(fd);
+            std::remove(temporary.data());
+            throw std::system_error(error, std::generic_category(),
+                                    "Unable to create " + std::string(temporary.data()));
+        }
+
+        bool written = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        written = std::fclose(file) == 0 && written;
+        if (!written || std::rename(temporary.data(), path.c_str()) != 0) {
+            int error = errno;
+            std::remove(temporary.data());
+            throw std::system_error(error, std::generic_category(), "Unable to write " + path);
+        }
+    }
+
+    /**
+     * A read-only view of a pack file.
+     *
+     * The file is mapped once and ROM images are handed out as pointers into the mapping, so they are served from
+     * the page cache without copying, and are shared with every other reader of the same pack. All methods are const
+     * and the view can be shared freely between threads.
+     */
+    class RomPack final {
+    public:
+        struct Entry {
+            uint64_t hash;
+            uint32_t quirks;
+            std::string title;
+            const uint8_t *data;
+            std::size_t size;
+        };
+
+        /**
+         * @throws std::system_error if the file can't be mapped, RomPackError if it isn't a valid pack.
+         */
+        explicit RomPack(const std::string &path)
+            : mFile(path)
+        {
+            if (mFile.size() < sizeof(RomPackHeader)) {
+                throw RomPackError(path + " is too small to be a ROM pack");
+            }
+
+            std::memcpy(&mHeader, mFile.data(), sizeof(mHeader));
+            if (std::memcmp(mHeader.magic, ROM_PACK_MAGIC, sizeof(mHeader.magic)) != 0) {
+                throw RomPackError(path + " is not a ROM pack");
+            }
+
+            if (mHeader.version != ROM_PACK_VERSION) {
+                throw RomPackError(path + " has unsupported version " + std::to_string(mHeader.version));
+            }
+
+            if (mHeader.fileSize != mFile.size()
+                || mHeader.entriesOffset > mHeader.titlesOffset
+                || mHeader.titlesOffset - mHeader.entriesOffset
+                   < static_cast<uint64_t>(mHeader.count) * sizeof(RomPackEntry)
+                || mHeader.titlesOffset > mHeader.imagesOffset
+                || mHeader.imagesOffset > mHeader.fileSize
+                || mHeader.entriesOffset % alignof(RomPackEntry) != 0) {
+                throw RomPackError(path + " is truncated or corrupt");
+            }
+
+            mEntries = reinterpret_cast<const RomPackEntry *>(mFile.data() + mHeader.entriesOffset);
+
+            for (std::size_t i = 0; i < mHeader.count; i++) {
+                const RomPackEntry &entry = mEntries[i];
+                if (entry.size > MAX_PROGRAM_SIZE
+                    || entry.imageOffset < mHeader.imagesOffset
+                    || entry.imageOffset > mHeader.fileSize
+                    || entry.size > mHeader.fileSize - entry.imageOffset
+                    || mHeader.titlesOffset + entry.titleOffset + entry.titleLength > mHeader.imagesOffset
+                    || (i > 0 && mEntries[i - 1].hash >= entry.hash)) {
+                    throw RomPackError(path + " has a corrupt entry at index " + std::to_string(i));
+                }
+            }
+        }
+
+        std::size_t size() const {
+            return mHeader.count;
+        }
+
+        /**
+         * @throws RomPackError if there is no ROM at index.
+         */
+        Entry at(std::size_t index) const {
+            const RomPackEntry &entry = entryAt(index);
+            const char *titles = reinterpret_cast<const char *>(mFile.data() + mHeader.titlesOffset);
+
+            return Entry{
+                entry.hash,
+                entry.quirks,
+                std::string(titles + entry.titleOffset, entry.titleLength),
+                mFile.data() + entry.imageOffset,
+                entry.size
+            };
+        }
+
+        /**
+         * The image of the ROM at index, pointing straight into the mapping, to load into a Machine or a MachinePool.
+         * Nothing is copied or hashed again; it is valid for as long as the pack is.
+         *
+         * @throws RomPackError if there is no ROM at index.
+         */
+        RomImage image(std::size_t index) const {
+            const RomPackEntry &entry = entryAt(index);
+            return RomImage(mFile.data() + entry.imageOffset, entry.size, entry.hash);
+        }
+
+        /**
+         * @return The index of the first ROM with this title, or size() if the pack doesn't have one.
+         */
+        std::size_t findTitle(const std::string &title) const {
+            const char *titles = reinterpret_cast<const char *>(mFile.data() + mHeader.titlesOffset);
+            for (std::size_t i = 0; i < size(); i++) {
+                if (title.compare(0, std::string::npos, titles + mEntries[i].titleOffset, mEntries[i].titleLength)
+                    == 0) {
+                    return i;
+                }
+            }
+            return size();
+        }
+
+        /**
+         * @return The index of the ROM with this content hash, or size() if the pack doesn't have it.
+         */
+        std::size_t find(uint64_t hash) const {
+            const RomPackEntry *end = mEntries + mHeader.count;
+            const RomPackEntry *entry = std::lower_bound(mEntries, end, hash, [](const RomPackEntry &e, uint64_t h) {
+                return e.hash < h;
+            });
+
+            return entry != end && entry->hash == hash ? static_cast<std::size_t>(entry - mEntries) : size();
+        }
+
+    private:
+        const RomPackEntry &entryAt(std::size_t index) const {
+            if (index >= size()) {
+                throw RomPackError("ROM " + std::to_string(index) + " is past the end of a pack of "
+                                   + std::to_string(size()));
+            }
+            return mEntries[index];
+        }
+
+        MappedFile mFile;
+        RomPackHeader mHeader{};
+        const RomPackEntry *mEntries{nullptr};
+    };
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "keyring.hpp"
+#include "machine.hpp"
+#include "movie.hpp"
+
+namespace chip8 {
+    struct RunLimits {
+        // Stop after this many instructions or frames, whichever comes first. 0 means no limit.
+        uint64_t instructions{0};
+        uint64_t frames{0};
+
+        unsigned instructionsPerFrame{10};
+    };
+
+    struct RunStats {
+        uint64_t instructions{0};
+        uint64_t frames{0};
+
+        // The run stopped early because the machine is waiting for a key that the movie never presses
+        bool waitingForKey{false};
+    };
+
+    /**
+     * Run a machine headlessly, one 60 Hz frame at a time, with the keypad driven by movie, until a limit is
+     * reached.
+     *
+     * A machine waiting for a key (FX0A) sits out the rest of the frame, and every frame after it until the movie
+     * presses one, costing only its timer tick. If there is no frame limit and the movie never will press one, the run
+     * stops there.
+     *
+     * afterFrame(frame) is called after every complete frame, where frame counts from 0. It can pace the run, take
+     * measurements or look at the screen, and returns false to stop early. stats is kept up to date as the run goes,
+     * so it is accurate even if the machine throws.
+     *
+     * @throws MachineError if the program hits an instruction that can't be decoded or executed.
+     */
+    template <typename AfterFrame>
+    void run(Machine &machine, const RunLimits &limits, const Movie &movie, RunStats &stats, AfterFrame afterFrame) {
+        while ((limits.frames == 0 || stats.frames < limits.frames)
+               && (limits.instructions == 0 || stats.instructions < limits.instructions)) {
+            machine.setKeys(movie.keysAt(stats.frames));
+
+            uint64_t count{limits.instructionsPerFrame};
+            if (limits.instructions != 0) {
+                count = std::min(count, limits.instructions - stats.instructions);
+            }
+
+            for (uint64_t i = 0; i < count; i++) {
+                if (!machine.step()) {
+                    break;
+                }
+                stats.instructions++;
+            }
+
+            // Ran out of instructions part way through the frame
+            if (count < limits.instructionsPerFrame) {
+                return;
+            }
+
+            machine.tickTimers();
+            if (!afterFrame(stats.frames++)) {
+                return;
+            }
+
+            if (limits.frames == 0 && machine.waitingForKey() && !movie.changesAfter(stats.frames - 1)) {
+                stats.waitingForKey = true;
+                return;
+            }
+        }
+    }
+
+    inline void run(Machine &machine, const RunLimits &limits, const Movie &movie, RunStats &stats) {
+        run(machine, limits, movie, stats, [](uint64_t) {
+            return true;
+        });
+    }
+
+    /**
+     * Run a machine as above, but with the keypad driven live from input, which another thread pushes to.
+     *
+     * Each event is applied just before the instruction slot it is stamped with, so input lands on the same cycle
+     * however the host schedules the two threads, as long as it arrives in time. Between events instructions run in
+     * straight batches, and the ring is only looked at once per batch. A machine waiting for a key skips ahead to the
+     * next event in the frame, or sits out the frame if there isn't one. With live input a key can always still come,
+     * so the run never stops for waiting.
+     */
+    template <typename AfterFrame>
+    void run(Machine &machine, const RunLimits &limits, KeyRing &input, RunStats &stats, AfterFrame afterFrame) {
+        while ((limits.frames == 0 || stats.frames < limits.frames)
+               && (limits.instructions == 0 || stats.instructions < limits.instructions)) {
+            uint64_t count{limits.instructionsPerFrame};
+            if (limits.instructions != 0) {
+                count = std::min(count, limits.instructions - stats.instructions);
+            }
+
+            uint64_t cycle{stats.frames * limits.instructionsPerFrame};
+            uint64_t end{cycle + count};
+            while (cycle < end) {
+                const KeyEvent *event;
+                while ((event = input.front()) != nullptr && event->cycle <= cycle) {
+                    machine.setKeys(event->keys);
+                    input.pop();
+                }
+
+                uint64_t until{event != nullptr ? std::min(end, event->cycle) : end};
+                for (; cycle < until; cycle++) {
+                    if (!machine.step()) {
+                        cycle = until;
+                        break;
+                    }
+                    stats.instructions++;
+                }
+            }
+
+            if (count < limits.instructionsPerFrame) {
+                return;
+            }
+
+            machine.tickTimers();
+            if (!afterFrame(stats.frames++)) {
+                return;
+            }
+        }
+    }
+}
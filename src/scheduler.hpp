@@ -0,0 +1,309 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "machine.hpp"
+
+namespace chip8 {
+    enum class SessionState {
+        // Runs a frame every frame
+        ready,
+
+        // Parked in FX0A until setKeys() presses a key
+        waitingForKey,
+
+        // Parked in a delay timer loop until the frame the timer lets it out
+        waitingForTimer,
+
+        // Parked for good in a jump to itself
+        halted,
+
+        // Stopped by a MachineError, see Scheduler::error()
+        failed,
+    };
+
+    struct SchedulerStats {
+        // Frames run for sessions, one per session per frame
+        uint64_t framesRun{0};
+
+        // Frames sessions spent parked, which cost nothing
+        uint64_t framesParked{0};
+
+        // Times a parked session was woken up
+        uint64_t wakeups{0};
+    };
+
+    /**
+     * Runs any number of machines on one thread, each as a stackless coroutine: a session runs for one frame, yields
+     * to the next, and carries on from the same instruction when its turn comes round again. The machine's own state
+     * is the coroutine's state, so there is no stack or thread per session.
+     *
+     * A session that can't make progress parks, and costs nothing at all until it is woken: waiting for a key in FX0A
+     * until setKeys() presses one, spinning in the usual delay timer loop (see Machine::delayWaitFrames()) until the
+     * frame the timer runs out, or stopped in a jump to itself for good. Its timers and, in a delay loop, its place in
+     * the loop are caught up when it wakes, or when machine() looks at it, so a scheduled machine is always exactly
+     * where Machine::runFrame() would have left it.
+     *
+     * Machines are owned by the caller and must outlive their sessions. The id of a removed session is given to the
+     * next session added; until then, calls with it are ignored.
+     */
+    class Scheduler final {
+    public:
+        using SessionId = uint32_t;
+
+        explicit Scheduler(unsigned instructionsPerFrame = 10)
+            : mInstructionsPerFrame(instructionsPerFrame)
+        {
+        }
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        /**
+         * Start running machine, from the next frame.
+         */
+        SessionId add(Machine &machine) {
+            SessionId id;
+            if (!mFree.empty()) {
+                id = mFree.back();
+                mFree.pop_back();
+            } else {
+                id = static_cast<SessionId>(mSessions.size());
+                mSessions.emplace_back();
+            }
+
+            Session &session = mSessions[id];
+            session.machine = &machine;
+            session.state = SessionState::ready;
+            session.synced = mFrame;
+            session.error.clear();
+            mLive++;
+            mReady.push_back(Entry{mFrame, id, session.generation});
+            return id;
+        }
+
+        /**
+         * Stop running a session. Its machine is left as it is, caught up to now.
+         *
+         * @return false, doing nothing, if there is no such session.
+         */
+        bool remove(SessionId id) {
+            if (!contains(id)) {
+                return false;
+            }
+
+            sync(id);
+            Session &session = mSessions[id];
+            if (session.state != SessionState::failed) {
+                mLive--;
+            }
+            session.machine = nullptr;
+            session.generation++;
+            mFree.push_back(id);
+            return true;
+        }
+
+        /**
+         * Set which keys the session's machine has held down, waking it if it was waiting for one.
+         *
+         * @return false, doing nothing, if there is no such session.
+         */
+        bool setKeys(SessionId id, uint16_t keys) {
+            if (!contains(id)) {
+                return false;
+            }
+
+            Session &session = mSessions[id];
+            session.machine->setKeys(keys);
+
+            if (session.state == SessionState::waitingForKey && keys != 0) {
+                sync(id);
+                session.state = SessionState::ready;
+                mReady.push_back(Entry{mFrame, id, session.generation});
+                mStats.wakeups++;
+            }
+            return true;
+        }
+
+        /**
+         * Whether id is a session that has been added and not removed since. Failed sessions still count.
+         */
+        bool contains(SessionId id) const {
+            return id < mSessions.size() && mSessions[id].machine != nullptr;
+        }
+
+        /**
+         * Run one 60 Hz frame: one frame of every session that isn't parked, after waking those whose timer ran out.
+         */
+        void runFrame() {
+            while (!mSleeping.empty() && mSleeping.top().frame <= mFrame) {
+                Entry entry{mSleeping.top()};
+                mSleeping.pop();
+                if (current(entry)) {
+                    sync(entry.id);
+                    mSessions[entry.id].state = SessionState::ready;
+                    mReady.push_back(entry);
+                    mStats.wakeups++;
+                }
+            }
+
+            mRunning.swap(mReady);
+            mReady.clear();
+            std::size_t parked{mLive};
+            for (const Entry &entry : mRunning) {
+                if (current(entry)) {
+                    parked--;
+                    run(entry);
+                }
+            }
+            mStats.framesParked += parked;
+
+            mFrame++;
+        }
+
+        SessionState state(SessionId id) const {
+            return mSessions[id].state;
+        }
+
+        /**
+         * The MachineError that stopped a failed session.
+         */
+        const std::string &error(SessionId id) const {
+            return mSessions[id].error;
+        }
+
+        /**
+         * The session's machine, caught up to now.
+         *
+         * @throws std::out_of_range if there is no such session.
+         */
+        const Machine &machine(SessionId id) {
+            if (!contains(id)) {
+                throw std::out_of_range("No scheduler session " + std::to_string(id));
+            }
+            sync(id);
+            return *mSessions[id].machine;
+        }
+
+        /**
+         * Frames run so far.
+         */
+        uint64_t frame() const {
+            return mFrame;
+        }
+
+        /**
+         * The number of sessions that will run in the next frame, not counting any woken before it.
+         */
+        std::size_t ready() const {
+            return mReady.size();
+        }
+
+        const SchedulerStats &stats() const {
+            return mStats;
+        }
+
+    private:
+        struct Session {
+            Machine *machine{nullptr};
+            SessionState state{SessionState::ready};
+
+            // The machine is exactly as it would be after this many frames
+            uint64_t synced{0};
+
+            // Bumped whenever the id is given up, so that entries left behind in the queues can be told apart
+            uint32_t generation{0};
+
+            std::string error;
+        };
+
+        struct Entry {
+            // For sleeping sessions, the frame they wake up for
+            uint64_t frame;
+            SessionId id;
+            uint32_t generation;
+
+            bool operator>(const Entry &other) const {
+                return frame > other.frame;
+            }
+        };
+
+        bool current(const Entry &entry) const {
+            return mSessions[entry.id].generation == entry.generation;
+        }
+
+        void run(const Entry &entry) {
+            Session &session = mSessions[entry.id];
+            Machine &machine = *session.machine;
+
+            try {
+                machine.runFrame(mInstructionsPerFrame);
+            } catch (const MachineError &e) {
+                session.state = SessionState::failed;
+                session.error = e.what();
+                session.synced = mFrame + 1;
+                mLive--;
+                return;
+            }
+            session.synced = mFrame + 1;
+            mStats.framesRun++;
+
+            unsigned spinning;
+            if (machine.waitingForKey()) {
+                session.state = SessionState::waitingForKey;
+            } else if (machine.halted()) {
+                session.state = SessionState::halted;
+            } else if ((spinning = machine.delayWaitFrames()) > 0) {
+                session.state = SessionState::waitingForTimer;
+                mSleeping.push(Entry{session.synced + spinning, entry.id, entry.generation});
+            } else {
+                mReady.push_back(entry);
+            }
+        }
+
+        /**
+         * Bring a parked session's machine up to the current frame.
+         */
+        void sync(SessionId id) {
+            Session &session = mSessions[id];
+            uint64_t frames{mFrame - session.synced};
+            if (frames == 0) {
+                return;
+            }
+
+            switch (session.state) {
+                case SessionState::waitingForKey:
+                case SessionState::halted:
+                    session.machine->tickTimers(frames);
+                    break;
+                case SessionState::waitingForTimer:
+                    session.machine->skipDelayWait(frames, mInstructionsPerFrame);
+                    break;
+                case SessionState::ready:
+                case SessionState::failed:
+                    return;
+            }
+            session.synced = mFrame;
+        }
+
+        unsigned mInstructionsPerFrame;
+        uint64_t mFrame{0};
+
+        std::vector<Session> mSessions;
+        std::vector<SessionId> mFree;
+
+        // Sessions added and not yet removed or failed
+        std::size_t mLive{0};
+
+        std::vector<Entry> mReady;
+        std::vector<Entry> mRunning;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> mSleeping;
+
+        SchedulerStats mStats;
+    };
+}
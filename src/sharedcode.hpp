@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "analysis.hpp"
+#include "cpu.hpp"
+#include "decode.hpp"
+#include "font.hpp"
+#include "rom.hpp"
+#include "translationcache.hpp"
+
+namespace chip8 {
+    /**
+     * Decoded instructions for a ROM exactly as it was loaded, shared read-only between every machine running it.
+     *
+     * Machines only use it for pages they haven't written to (see CodeMap::isWritten()), so whatever is decoded here
+     * is valid for all of them. Lookups never lock: an address that hasn't been decoded yet is decoded by whichever
+     * thread gets there first, and published with a compare-and-swap.
+     */
+    class SharedCode final {
+    public:
+        explicit SharedCode(const RomImage &rom)
+            : SharedCode(rom, analyze_control_flow(rom.data, rom.size, PROGRAM_START))
+        {
+        }
+
+        /**
+         * Decode everything graph, the control flow analysis of rom, found up front, so that sessions start out warm.
+         */
+        SharedCode(const RomImage &rom, const ControlFlowGraph &graph)
+            : mHash(rom.hash),
+              mSize(rom.size)
+        {
+            std::copy(FONT_DATA.begin(), FONT_DATA.end(), mImage.begin() + FONT_DATA_OFFSET);
+            std::memcpy(mImage.data() + PROGRAM_START, rom.data, rom.size);
+
+            for (auto &entry : mEntries) {
+                entry.store(nullptr, std::memory_order_relaxed);
+            }
+
+            for (std::size_t address = PROGRAM_START; address < MEMORY_SIZE - 1; address++) {
+                if (graph.isInstruction(static_cast<uint16_t>(address))) {
+                    fetch(static_cast<uint16_t>(address));
+                }
+            }
+        }
+
+        SharedCode(const SharedCode &) = delete;
+        SharedCode &operator=(const SharedCode &) = delete;
+
+        ~SharedCode() {
+            for (auto &entry : mEntries) {
+                delete entry.load(std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * @return The instruction at address in the ROM as loaded, or nullptr if it doesn't decode.
+         */
+        const Instruction *fetch(uint16_t address) const {
+            std::atomic<const Instruction *> &entry = mEntries[address % MEMORY_SIZE];
+
+            const Instruction *instruction = entry.load(std::memory_order_acquire);
+            if (instruction != nullptr) {
+                return instruction;
+            }
+
+            uint16_t opcode{static_cast<uint16_t>(mImage[address % MEMORY_SIZE] << 8
+                                                  | mImage[(address + 1) % MEMORY_SIZE])};
+            std::unique_ptr<Instruction> decoded = decode_opcode(opcode);
+            if (!decoded) {
+                return nullptr;
+            }
+
+            const Instruction *expected{nullptr};
+            if (entry.compare_exchange_strong(expected, decoded.get(), std::memory_order_acq_rel)) {
+                return decoded.release();
+            }
+
+            // Somebody else decoded it first, use theirs.
+            return expected;
+        }
+
+        /**
+         * Memory as loaded, font and ROM, MEMORY_SIZE bytes. See PagedMemory::share().
+         */
+        const uint8_t *image() const {
+            return mImage.data();
+        }
+
+        uint64_t hash() const {
+            return mHash;
+        }
+
+        /**
+         * Whether this was built from exactly this ROM, and not just one with the same hash.
+         */
+        bool matches(const RomImage &rom) const {
+            return rom.hash == mHash
+                   && rom.size == mSize
+                   && std::memcmp(mImage.data() + PROGRAM_START, rom.data, rom.size) == 0;
+        }
+
+    private:
+        uint64_t mHash;
+        std::size_t mSize;
+        std::array<uint8_t, MEMORY_SIZE> mImage{};
+        mutable std::array<std::atomic<const Instruction *>, MEMORY_SIZE> mEntries;
+    };
+
+    /**
+     * Hands out the SharedCode for each ROM, creating it for the first machine that runs the ROM and dropping it once
+     * the last one is done with it.
+     *
+     * Acquiring takes a lock, but only happens when a program is loaded. Fetching instructions from what it returns
+     * doesn't. Given a TranslationCache, the analysis behind new shared code is loaded from it instead of being done
+     * again, and stored there when it isn't.
+     */
+    class SharedCodeRegistry final {
+    public:
+        static SharedCodeRegistry &global() {
+            static SharedCodeRegistry registry;
+            return registry;
+        }
+
+        std::shared_ptr<const SharedCode> acquire(const RomImage &rom, const TranslationCache *cache = nullptr) {
+            std::lock_guard<std::mutex> lock{mMutex};
+
+            std::weak_ptr<const SharedCode> &slot = mCode[rom.hash];
+            std::shared_ptr<const SharedCode> code = slot.lock();
+            if (!code) {
+                code = create(rom, cache);
+                slot = code;
+            } else if (!code->matches(rom)) {
+                // A hash collision. Still correct, just not shared.
+                return create(rom, cache);
+            }
+
+            // Forget ROMs nobody is running any more
+            for (auto entry = mCode.begin(); entry != mCode.end();) {
+                entry = entry->second.expired() ? mCode.erase(entry) : std::next(entry);
+            }
+
+            return code;
+        }
+
+        /**
+         * @return The number of ROMs that currently have shared code.
+         */
+        std::size_t size() const {
+            std::lock_guard<std::mutex> lock{mMutex};
+            return static_cast<std::size_t>(std::count_if(mCode.begin(), mCode.end(), [](const Entry &entry) {
+                return !entry.second.expired();
+            }));
+        }
+
+    private:
+        using Entry = std::pair<const uint64_t, std::weak_ptr<const SharedCode>>;
+
+        static std::shared_ptr<const SharedCode> create(const RomImage &rom, const TranslationCache *cache) {
+            if (cache == nullptr) {
+                return std::make_shared<const SharedCode>(rom);
+            }
+            return std::make_shared<const SharedCode>(rom, cache->analyze(rom));
+        }
+
+        mutable std::mutex mMutex;
+        std::unordered_map<uint64_t, std::weak_ptr<const SharedCode>> mCode;
+    };
+}
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpu.hpp"
+#include "framebuffer.hpp"
+
+namespace chip8 {
+    /**
+     * A machine's state at the end of a frame, as it is laid out in shared memory for other processes to read.
+     *
+     * Only fixed size fields, so that a reader built separately from the emulator agrees on the layout.
+     */
+    struct SharedSnapshot {
+        // Frames run, so that readers can tell whether they have missed any
+        uint64_t frame;
+
+        // The screen, laid out as FrameBuffer::rows()
+        uint64_t rows[DISPLAY_HEIGHT];
+
+        uint8_t V[REGISTER_COUNT];
+        uint16_t stack[STACK_SIZE];
+        uint16_t pc;
+        uint16_t I;
+        uint16_t keys;
+        uint8_t stackDepth;
+        uint8_t delayTimer;
+        uint8_t soundTimer;
+
+        // The register FX0A is waiting to store a key in, or NO_KEY_WAIT
+        uint8_t keyWait;
+        uint8_t reserved[6];
+    };
+
+    static_assert(sizeof(SharedSnapshot) == 328, "The shared snapshot layout must not change within a version");
+    static_assert(sizeof(SharedSnapshot) % sizeof(uint64_t) == 0, "Snapshots are copied a word at a time");
+
+    const char SHARED_STATE_MAGIC[8] = {'C', 'H', 'I', 'P', '8', 'S', 'H', 'M'};
+    const uint32_t SHARED_STATE_VERSION{2};
+
+    /**
+     * The shared memory segment: a header, then the latest snapshot under a seqlock.
+     *
+     * The writer makes the sequence odd, stores the snapshot, and makes it even again; a reader copies the snapshot
+     * between two reads of the sequence, and only keeps the copy if both were the same even number. The writer never
+     * waits for readers and readers never write, so any number of them can watch without slowing the machine down,
+     * and reading the latest frame takes no system calls. The snapshot is held as atomic words, copied with relaxed
+     * loads and stores, so that the racing copies are well defined; they compile to plain moves.
+     *
+     * A writer that dies part way through publishing leaves the sequence odd, and it stays odd until another writer
+     * takes the segment over and publishes.
+     */
+    struct SharedStateSegment {
+        char magic[8];
+        uint32_t version;
+        uint32_t size;
+
+        // The process publishing into the segment, so that a new writer can tell whether it is still running
+        std::atomic<int32_t> writer;
+
+        // Odd while the writer is storing a snapshot, and 0 until the first one
+        alignas(64) std::atomic<uint64_t> sequence;
+
+        alignas(64) std::atomic<uint64_t> words[sizeof(SharedSnapshot) / sizeof(uint64_t)];
+    };
+
+    static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "Shared words must be plain words");
+
+    /**
+     * Makes a POSIX shared memory segment and publishes a machine's state into it at the end of every frame.
+     *
+     * The segment is removed again when the writer goes, though readers that already have it mapped can carry on
+     * reading the last snapshot. A writer that crashes leaves its segment behind; the next writer with the same name
+     * takes it over, in place, so readers that have it mapped see the new writer's snapshots too.
+     */
+    class SharedStateWriter final {
+    public:
+        /**
+         * @param name The segment's name, as for shm_open(): a slash followed by up to 254 other characters.
+         * @throws std::system_error if the segment can't be created, which includes there already being one by that
+         *         name whose writer is still running. The segment of a writer that has exited, without removing it,
+         *         is taken over instead. A writer is judged to be running if its process ID is, so a writer whose ID
+         *         has been reused, or that is in another PID namespace, still counts as running.
+         */
+        explicit SharedStateWriter(const std::string &name)
+            : mName(name)
+        {
+            int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+            bool created = fd >= 0;
+            if (!created && errno == EEXIST) {
+                fd = ::shm_open(name.c_str(), O_RDWR, 0);
+            }
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "Unable to create " + name);
+            }
+
+            struct stat info{};
+            if (created && ::ftruncate(fd, sizeof(SharedStateSegment)) != 0) {
+                int error = errno;
+                ::close(fd);
+                ::shm_unlink(name.c_str());
+                throw std::system_error(error, std::generic_category(), "Unable to size " + name);
+            }
+            if (!created && (::fstat(fd, &info) != 0
+                             || static_cast<std::size_t>(info.st_size) != sizeof(SharedStateSegment))) {
+                ::close(fd);
+                throw std::system_error(EEXIST, std::generic_category(), "Unable to create " + name);
+            }
+
+            void *data = ::mmap(nullptr, sizeof(SharedStateSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED) {
+                int error = errno;
+                if (created) {
+                    ::shm_unlink(name.c_str());
+                }
+                throw std::system_error(error, std::generic_category(), "Unable to map " + name);
+            }
+            mSegment = static_cast<SharedStateSegment *>(data);
+
+            if (!created) {
+                if (!takeOver()) {
+                    ::munmap(mSegment, sizeof(SharedStateSegment));
+                    throw std::system_error(EEXIST, std::generic_category(),
+                                            "Unable to create " + name + ", another writer is using it");
+                }
+                return;
+            }
+
+            // The segment starts out zeroed, so the sequence is already 0
+            std::memcpy(mSegment->magic, SHARED_STATE_MAGIC, sizeof(SHARED_STATE_MAGIC));
+            mSegment->version = SHARED_STATE_VERSION;
+            mSegment->size = sizeof(SharedStateSegment);
+            mSegment->writer.store(static_cast<int32_t>(::getpid()), std::memory_order_release);
+        }
+
+        SharedStateWriter(const SharedStateWriter &) = delete;
+        SharedStateWriter &operator=(const SharedStateWriter &) = delete;
+
+        ~SharedStateWriter() {
+            ::munmap(mSegment, sizeof(SharedStateSegment));
+            ::shm_unlink(mName.c_str());
+        }
+
+        /**
+         * Publish the machine's state after the given number of frames. Never blocks.
+         */
+        void publish(const cpu_t &cpu, uint64_t frame) {
+            SharedSnapshot snapshot{};
+            snapshot.frame = frame;
+            std::memcpy(snapshot.rows, cpu.fb.rows().data(), sizeof(snapshot.rows));
+            std::memcpy(snapshot.V, cpu.V.data(), sizeof(snapshot.V));
+            for (std::size_t i = 0; i < cpu.stack.size(); i++) {
+                snapshot.stack[i] = cpu.stack[i];
+            }
+            snapshot.stackDepth = static_cast<uint8_t>(cpu.stack.size());
+            snapshot.pc = cpu.pc;
+            snapshot.I = cpu.I;
+            snapshot.keys = cpu.keys;
+            snapshot.delayTimer = cpu.delayTimer;
+            snapshot.soundTimer = cpu.soundTimer;
+            snapshot.keyWait = cpu.keyWait;
+            publish(snapshot);
+        }
+
+        void publish(const SharedSnapshot &snapshot) {
+            uint64_t words[sizeof(SharedSnapshot) / sizeof(uint64_t)];
+            std::memcpy(words, &snapshot, sizeof(words));
+
+            // Odd while storing. It already is if a writer this took over died while publishing.
+            uint64_t sequence = mSegment->sequence.load(std::memory_order_relaxed) | 1;
+            mSegment->sequence.store(sequence, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (std::size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+                mSegment->words[i].store(words[i], std::memory_order_relaxed);
+            }
+            mSegment->sequence.store(sequence + 1, std::memory_order_release);
+        }
+
+        const std::string &name() const {
+            return mName;
+        }
+
+    private:
+        /**
+         * Take over the segment if it is a shared state segment whose writer has exited. Of several new writers
+         * trying at once, only one succeeds.
+         */
+        bool takeOver() {
+            if (std::memcmp(mSegment->magic, SHARED_STATE_MAGIC, sizeof(SHARED_STATE_MAGIC)) != 0
+                || mSegment->version != SHARED_STATE_VERSION || mSegment->size != sizeof(SharedStateSegment)) {
+                return false;
+            }
+
+            // 0 while the writer that created it is still setting it up
+            int32_t writer = mSegment->writer.load(std::memory_order_acquire);
+            if (writer <= 0 || writer == ::getpid() || ::kill(writer, 0) == 0 || errno != ESRCH) {
+                return false;
+            }
+            return mSegment->writer.compare_exchange_strong(writer, static_cast<int32_t>(::getpid()),
+                                                            std::memory_order_acq_rel);
+        }
+
+        std::string mName;
+        SharedStateSegment *mSegment{nullptr};
+    };
+
+    /**
+     * Reads snapshots another process publishes with SharedStateWriter.
+     */
+    class SharedStateReader final {
+    public:
+        /**
+         * @throws std::system_error if there is no such segment, or it isn't a shared state segment this can read.
+         */
+        explicit SharedStateReader(const std::string &name) {
+            int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+            if (fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "Unable to open " + name);
+            }
+
+            struct stat info{};
+            if (::fstat(fd, &info) != 0) {
+                int error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "Unable to stat " + name);
+            }
+            if (static_cast<std::size_t>(info.st_size) != sizeof(SharedStateSegment)) {
+                ::close(fd);
+                throw std::system_error(EINVAL, std::generic_category(), name + " is not a shared state segment");
+            }
+
+            void *data = ::mmap(nullptr, sizeof(SharedStateSegment), PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED) {
+                throw std::system_error(errno, std::generic_category(), "Unable to map " + name);
+            }
+            mSegment = static_cast<const SharedStateSegment *>(data);
+
+            if (std::memcmp(mSegment->magic, SHARED_STATE_MAGIC, sizeof(SHARED_STATE_MAGIC)) != 0
+                || mSegment->version != SHARED_STATE_VERSION || mSegment->size != sizeof(SharedStateSegment)) {
+                ::munmap(const_cast<SharedStateSegment *>(mSegment), sizeof(SharedStateSegment));
+                throw std::system_error(EINVAL, std::generic_category(), name + " is not a shared state segment");
+            }
+        }
+
+        SharedStateReader(const SharedStateReader &) = delete;
+        SharedStateReader &operator=(const SharedStateReader &) = delete;
+
+        ~SharedStateReader() {
+            ::munmap(const_cast<SharedStateSegment *>(mSegment), sizeof(SharedStateSegment));
+        }
+
+        /**
+         * Changes every time a snapshot is published, so that polling it says whether there is anything new to read.
+         */
+        uint64_t sequence() const {
+            return mSegment->sequence.load(std::memory_order_acquire);
+        }
+
+        /**
+         * Copy the latest snapshot, trying again for as long as the writer is in the middle of publishing one, but
+         * no longer than timeout. A writer only takes that long if it has been stopped, or has died, part way
+         * through.
+         *
+         * @return false if nothing has been published yet.
+         * @throws std::system_error with ETIMEDOUT if there was no complete snapshot to copy within timeout.
+         */
+        bool read(SharedSnapshot &snapshot, std::chrono::nanoseconds timeout = std::chrono::seconds(1)) {
+            std::chrono::steady_clock::time_point deadline{};
+            for (uint64_t attempt = 0;; attempt++) {
+                uint64_t before = mSegment->sequence.load(std::memory_order_acquire);
+                if (before == 0) {
+                    return false;
+                }
+
+                if ((before & 1) == 0) {
+                    uint64_t words[sizeof(SharedSnapshot) / sizeof(uint64_t)];
+                    for (std::size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+                        words[i] = mSegment->words[i].load(std::memory_order_relaxed);
+                    }
+                    std::atomic_thread_fence(std::memory_order_acquire);
+
+                    if (mSegment->sequence.load(std::memory_order_relaxed) == before) {
+                        std::memcpy(&snapshot, words, sizeof(words));
+                        return true;
+                    }
+                }
+                mRetries++;
+
+                // Publishing takes well under a microsecond, so only start watching the clock, and making room for
+                // the writer to run, once it is clearly taking longer than that
+                if (attempt == SPIN_ATTEMPTS) {
+                    deadline = std::chrono::steady_clock::now() + timeout;
+                } else if (attempt > SPIN_ATTEMPTS) {
+                    if (std::chrono::steady_clock::now() >= deadline) {
+                        throw std::system_error(ETIMEDOUT, std::generic_category(),
+                                                "The shared state writer stopped part way through publishing");
+                    }
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        /**
+         * Copies thrown away because the writer was publishing at the same time.
+         */
+        uint64_t retries() const {
+            return mRetries;
+        }
+
+    private:
+        static const uint64_t SPIN_ATTEMPTS{1000};
+
+        const SharedStateSegment *mSegment{nullptr};
+        uint64_t mRetries{0};
+    };
+}
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "analysis.hpp"
+#include "hash.hpp"
+#include "mappedfile.hpp"
+#include "rom.hpp"
+
+#ifdef CHIP8_BUILD_ID_HEADER
+#include CHIP8_BUILD_ID_HEADER
+#endif
+
+// Without a build ID, as when built outside CMake, nothing tells this build's entries from another's
+#ifndef CHIP8_BUILD_ID
+#define CHIP8_BUILD_ID ""
+#endif
+
+namespace chip8 {
+    /**
+     * Bump whenever the layout below, or the meaning of anything in ControlFlowGraph, changes.
+     */
+    const uint32_t TRANSLATION_CACHE_VERSION{2};
+    const char TRANSLATION_CACHE_MAGIC[8] = {'C', '8', 'X', 'L', 'A', 'T', 'E', '\0'};
+
+    /**
+     * Keeps the control flow analysis of every ROM a process has run in a cache directory, so that later processes
+     * running the same ROM can map the result instead of analyzing it again.
+     *
+     * Entries are keyed by ROM content hash, and carry the cache format version and the build ID of the emulator that
+     * wrote them, and a copy of the ROM itself. An entry written by a different build, for a different ROM, or that
+     * fails its checksum is treated as a miss and removed. The content hash only names the entry: the ROM is compared
+     * byte for byte, so another ROM that happens to hash the same never gets its analysis. Entries are written to a
+     * uniquely named temporary file and renamed into place, so concurrent writers, whether threads or processes
+     * sharing a directory, only ever see complete entries. With an empty build ID the cache is never read or written,
+     * since its entries couldn't be told apart from another build's.
+     */
+    class TranslationCache final {
+    public:
+        explicit TranslationCache(std::string directory, const std::string &buildId = CHIP8_BUILD_ID)
+            : mDirectory(std::move(directory)),
+              mBuildId(content_hash(reinterpret_cast<const uint8_t *>(buildId.data()), buildId.size())),
+              mEnabled(!buildId.empty())
+        {
+        }
+
+        /**
+         * @return true, with graph filled in, if there is a valid entry for this ROM.
+         */
+        bool load(const RomImage &rom, ControlFlowGraph &graph) const {
+            if (!mEnabled) {
+                return false;
+            }
+            std::string path{pathFor(rom)};
+
+            try {
+                MappedFile file{path};
+                if (decode(rom, file.data(), file.size(), graph)) {
+                    return true;
+                }
+            } catch (const std::system_error &) {
+                return false;
+            }
+
+            // Stale or damaged, get it out of the way so the next store replaces it.
+            std::remove(path.c_str());
+            graph = ControlFlowGraph();
+            return false;
+        }
+
+        /**
+         * Write the entry for this ROM. Failing to write is not an error, the cache is only an optimization.
+         *
+         * @return true if the entry was written.
+         */
+        bool store(const RomImage &rom, const ControlFlowGraph &graph) const {
+            if (!mEnabled) {
+                return false;
+            }
+            std::vector<uint8_t> contents{encode(rom, graph)};
+            std::string path{pathFor(rom)};
+            std::vector<char> temporary(path.begin(), path.end());
+            const char suffix[] = ".XXXXXX";
+            temporary.insert(temporary.end(), suffix, suffix + sizeof(suffix));
+            int fd = ::mkstemp(temporary.data());
+            if (fd < 0) {
+                return false;
+            }
+
+            // mkstemp() makes the file private to its owner, but other processes are meant to share the cache
+            std::FILE *file = ::fchmod(fd, 0644) == 0 ? ::fdopen(fd, "wb") : nullptr;
+            if (file == nullptr) {
+                ::close(fd);
+                std::remove(temporary.data());
+                return false;
+            }
+
+            bool written = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+            written = std::fclose(file) == 0 && written;
+            if (!written || std::rename(temporary.data(), path.c_str()) != 0) {
+                std::remove(temporary.data());
+                return false;
+            }
+
+            return true;
+        }
+
+        /**
+         * Load the analysis of this ROM from the cache, or analyze it and store the result.
+         */
+        ControlFlowGraph analyze(const RomImage &rom) const {
+            ControlFlowGraph graph;
+            if (!load(rom, graph)) {
+                graph = analyze_control_flow(rom.data, rom.size, PROGRAM_START);
+                store(rom, graph);
+            }
+            return graph;
+        }
+
+        std::string pathFor(const RomImage &rom) const {
+            std::ostringstream s;
+            s << mDirectory << "/" << std::hex << std::setw(16) << std::setfill('0') << rom.hash << ".c8tc";
+            return s.str();
+        }
+
+    private:
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t romSize;
+            uint64_t buildId;
+            uint64_t romHash;
+            uint64_t payloadHash;
+            uint32_t blockCount;
+            uint32_t successorCount;
+            uint32_t jumpTargetCount;
+            uint32_t callTargetCount;
+            uint32_t unresolvedCount;
+            uint32_t invalidCount;
+        };
+
+        struct Block {
+            uint16_t start;
+            uint16_t end;
+            uint16_t successorCount;
+            uint8_t unresolved;
+            uint8_t returns;
+        };
+
+        template <typename T>
+        static void append(std::vector<uint8_t> &out, const T &value) {
+            const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+            out.insert(out.end(), bytes, bytes + sizeof(T));
+        }
+
+        template <typename Container>
+        static void appendAddresses(std::vector<uint8_t> &out, const Container &addresses) {
+            for (uint16_t address : addresses) {
+                append(out, address);
+            }
+        }
+
+        std::vector<uint8_t> encode(const RomImage &rom, const ControlFlowGraph &graph) const {
+            std::vector<uint8_t> payload(rom.data, rom.data + rom.size);
+
+            for (std::size_t i = 0; i < MEMORY_SIZE; i += 8) {
+                uint8_t bits{0};
+                for (std::size_t bit = 0; bit < 8; bit++) {
+                    bits |= graph.instructions.test(i + bit) ? (1 << bit) : 0;
+                }
+                payload.push_back(bits);
+            }
+
+            for (ByteKind kind : graph.kinds) {
+                payload.push_back(static_cast<uint8_t>(kind));
+            }
+
+            std::size_t successorCount{0};
+            for (const auto &entry : graph.blocks) {
+                const BasicBlock &block = entry.second;
+                append(payload, Block{
+                    block.start,
+                    block.end,
+                    static_cast<uint16_t>(block.successors.size()),
+                    static_cast<uint8_t>(block.unresolved),
+                    static_cast<uint8_t>(block.returns)
+                });
+                successorCount += block.successors.size();
+            }
+
+            for (const auto &entry : graph.blocks) {
+                appendAddresses(payload, entry.second.successors);
+            }
+
+            appendAddresses(payload, graph.jumpTargets);
+            appendAddresses(payload, graph.callTargets);
+            appendAddresses(payload, graph.unresolvedJumps);
+            appendAddresses(payload, graph.invalidInstructions);
+
+            Header header{};
+            std::memcpy(header.magic, TRANSLATION_CACHE_MAGIC, sizeof(header.magic));
+            header.version = TRANSLATION_CACHE_VERSION;
+            header.romSize = static_cast<uint32_t>(rom.size);
+            header.buildId = mBuildId;
+            header.romHash = rom.hash;
+            header.payloadHash = content_hash(payload.data(), payload.size());
+            header.blockCount = static_cast<uint32_t>(graph.blocks.size());
+            header.successorCount = static_cast<uint32_t>(successorCount);
+            header.jumpTargetCount = static_cast<uint32_t>(graph.jumpTargets.size());
+            header.callTargetCount = static_cast<uint32_t>(graph.callTargets.size());
+            header.unresolvedCount = static_cast<uint32_t>(graph.unresolvedJumps.size());
+            header.invalidCount = static_cast<uint32_t>(graph.invalidInstructions.size());
+
+            std::vector<uint8_t> contents;
+            contents.reserve(sizeof(Header) + payload.size());
+            append(contents, header);
+            contents.insert(contents.end(), payload.begin(), payload.end());
+            return contents;
+        }
+
+        bool decode(const RomImage &rom, const uint8_t *data, std::size_t size, ControlFlowGraph &graph) const {
+            Header header{};
+            if (size < sizeof(Header)) {
+                return false;
+            }
+            std::memcpy(&header, data, sizeof(Header));
+
+            if (std::memcmp(header.magic, TRANSLATION_CACHE_MAGIC, sizeof(header.magic)) != 0
+                || header.version != TRANSLATION_CACHE_VERSION
+                || header.buildId != mBuildId
+                || header.romHash != rom.hash
+                || header.romSize != rom.size) {
+                return false;
+            }
+
+            const uint8_t *payload{data + sizeof(Header)};
+            std::size_t payloadSize{size - sizeof(Header)};
+            std::size_t addressCount{static_cast<std::size_t>(header.successorCount) + header.jumpTargetCount
+                                     + header.callTargetCount + header.unresolvedCount + header.invalidCount};
+            std::size_t expectedSize{rom.size + MEMORY_SIZE / 8 + MEMORY_SIZE
+                                     + header.blockCount * sizeof(Block) + addressCount * sizeof(uint16_t)};
+
+            if (payloadSize != expectedSize || content_hash(payload, payloadSize) != header.payloadHash
+                || std::memcmp(rom.data, payload, rom.size) != 0) {
+                return false;
+            }
+
+            graph = ControlFlowGraph();
+            const uint8_t *cursor{payload + rom.size};
+
+            for (std::size_t i = 0; i < MEMORY_SIZE; i++) {
+                graph.instructions.set(i, (cursor[i / 8] >> (i % 8)) & 1);
+            }
+            cursor += MEMORY_SIZE / 8;
+
+            for (std::size_t i = 0; i < MEMORY_SIZE; i++) {
+                graph.kinds[i] = static_cast<ByteKind>(cursor[i]);
+            }
+            cursor += MEMORY_SIZE;
+
+            std::vector<Block> blocks(header.blockCount);
+            std::memcpy(blocks.data(), cursor, blocks.size() * sizeof(Block));
+            cursor += blocks.size() * sizeof(Block);
+
+            auto readAddress = [&cursor]() {
+                uint16_t address;
+                std::memcpy(&address, cursor, sizeof(address));
+                cursor += sizeof(address);
+                return address;
+            };
+
+            std::size_t successorsLeft{header.successorCount};
+            for (const Block &stored : blocks) {
+                if (stored.successorCount > successorsLeft) {
+                    return false;
+                }
+                successorsLeft -= stored.successorCount;
+
+                BasicBlock &block = graph.blocks[stored.start];
+                block.start = stored.start;
+                block.end = stored.end;
+                block.unresolved = stored.unresolved != 0;
+                block.returns = stored.returns != 0;
+                for (uint16_t i = 0; i < stored.successorCount; i++) {
+                    block.successors.push_back(readAddress());
+                }
+            }
+
+            for (uint32_t i = 0; i < header.jumpTargetCount; i++) {
+                graph.jumpTargets.insert(readAddress());
+            }
+            for (uint32_t i = 0; i < header.callTargetCount; i++) {
+                graph.callTargets.insert(readAddress());
+            }
+            for (uint32_t i = 0; i < header.unresolvedCount; i++) {
+                graph.unresolvedJumps.push_back(readAddress());
+            }
+            for (uint32_t i = 0; i < header.invalidCount; i++) {
+                graph.invalidInstructions.push_back(readAddress());
+            }
+
+            return successorsLeft == 0;
+        }
+
+        std::string mDirectory;
+        uint64_t mBuildId;
+        bool mEnabled;
+    };
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace chip8 {
+    /**
+     * Hands whole values from one writer thread to one reader thread, without either ever waiting for the other and
+     * without the reader ever seeing a value half written.
+     *
+     * There are three buffers: the writer fills the back one, the reader reads the front one, and the third sits in
+     * the middle holding the latest published value. Publishing swaps back and middle, and taking the latest swaps
+     * middle and front, each with a single atomic exchange of the middle's index. A flag next to the index says
+     * whether the middle holds a value the reader hasn't taken yet.
+     */
+    template <typename T>
+    class TripleBuffer final {
+    public:
+        TripleBuffer() = default;
+
+        TripleBuffer(const TripleBuffer &) = delete;
+        TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+        /**
+         * Writer only. The buffer to fill before publish(), which still holds whatever was there before.
+         */
+        T &back() {
+            return mBuffers[mBack];
+        }
+
+        /**
+         * Writer only. Make the back buffer the latest value.
+         *
+         * @return false if the previous value was never taken by the reader, and so has been dropped.
+         */
+        bool publish() {
+            uint8_t previous = mMiddle.exchange(static_cast<uint8_t>(mBack | FRESH), std::memory_order_acq_rel);
+            mBack = previous & INDEX;
+            return (previous & FRESH) == 0;
+        }
+
+        /**
+         * Reader only. Take the latest published value into front(), if there is a new one.
+         *
+         * @return false if nothing has been published since the last update(), and front() is unchanged.
+         */
+        bool update() {
+            if ((mMiddle.load(std::memory_order_relaxed) & FRESH) == 0) {
+                return false;
+            }
+            mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        /**
+         * Reader only. The value taken by the last update() that returned true.
+         */
+        const T &front() const {
+            return mBuffers[mFront];
+        }
+
+    private:
+        static const uint8_t INDEX{0x3};
+        static const uint8_t FRESH{0x4};
+
+        std::array<T, 3> mBuffers{};
+
+        // Each index is only touched by one side, except the middle, which both swap with
+        alignas(64) uint8_t mBack{0};
+        alignas(64) std::atomic<uint8_t> mMiddle{1};
+        alignas(64) uint8_t mFront{2};
+    };
+
+    template <typename T>
+    const uint8_t TripleBuffer<T>::INDEX;
+
+    template <typename T>
+    const uint8_t TripleBuffer<T>::FRESH;
+}
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHIP8_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+#include "framebuffer.hpp"
+
+namespace chip8 {
+    class UpscaleError : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    enum class PixelFormat {
+        // Four bytes per pixel: red, green, blue, alpha
+        rgba8,
+
+        // One byte per pixel
+        gray8,
+    };
+
+    /**
+     * The instruction set a conversion kernel is written for.
+     */
+    enum class SimdKernel {
+        scalar,
+        sse2,
+        avx2,
+    };
+
+    inline const char *format_name(PixelFormat format) {
+        return format == PixelFormat::gray8 ? "gray" : "rgba";
+    }
+
+    /**
+     * @return false if name isn't the name of a format.
+     */
+    inline bool parse_format(const std::string &name, PixelFormat &format) {
+        for (PixelFormat candidate : {PixelFormat::rgba8, PixelFormat::gray8}) {
+            if (name == format_name(candidate)) {
+                format = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline const char *kernel_name(SimdKernel kernel) {
+        switch (kernel) {
+            case SimdKernel::sse2:
+                return "sse2";
+            case SimdKernel::avx2:
+                return "avx2";
+            case SimdKernel::scalar:
+                break;
+        }
+        return "scalar";
+    }
+
+    /**
+     * Whether the host can run kernel.
+     */
+    inline bool kernel_supported(SimdKernel kernel) {
+        switch (kernel) {
+            case SimdKernel::scalar:
+                return true;
+#ifdef CHIP8_X86_KERNELS
+            case SimdKernel::sse2:
+                return __builtin_cpu_supports("sse2");
+            case SimdKernel::avx2:
+                return __builtin_cpu_supports("avx2");
+#endif
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * The fastest kernel the host can run.
+     */
+    inline SimdKernel best_kernel() {
+        for (SimdKernel kernel : {SimdKernel::avx2, SimdKernel::sse2}) {
+            if (kernel_supported(kernel)) {
+                return kernel;
+            }
+        }
+        return SimdKernel::scalar;
+    }
+
+    struct Rgba {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+        uint8_t a;
+    };
+
+    /**
+     * The colours of pixels that are off and on. Grayscale images use their luma.
+     */
+    struct Palette {
+        Rgba off{0x00, 0x00, 0x00, 0xFF};
+        Rgba on{0xFF, 0xFF, 0xFF, 0xFF};
+    };
+
+    namespace detail {
+        /**
+         * Write out words * 64 pixels, one for each bit of bits from the most significant down, as off or on.
+         */
+        using PixelKernel = void (*)(const uint64_t *bits, std::size_t words, uint32_t off, uint32_t on, uint8_t *out);
+
+        inline void rgba_scalar(const uint64_t *bits, std::size_t words, uint32_t off, uint32_t on, uint8_t *out) {
+            for (std::size_t w = 0; w < words; w++) {
+                for (int bit = 63; bit >= 0; bit--) {
+                    uint32_t pixel = (bits[w] >> bit) & 1 ? on : off;
+                    std::memcpy(out, &pixel, sizeof(pixel));
+                    out += sizeof(pixel);
+                }
+            }
+        }
+
+        inline void gray_scalar(const uint64_t *bits, std::size_t words, uint32_t off, uint32_t on, uint8_t *out) {
+            for (std::size_t w = 0; w < words; w++) {
+                for (int bit = 63; bit >= 0; bit--) {
+                    *out++ = static_cast<uint8_t>((bits[w] >> bit) & 1 ? on : off);
+                }
+            }
+        }
+
+#ifdef CHIP8_X86_KERNELS
+        // Every byte of a byte, for spreading eight bits over eight lanes that then each test one of them
+        const uint64_t EVERY_BYTE{0x0101010101010101};
+
+        /*
+         * Each kernel spreads a few bits over the lanes of a vector, one per lane, ANDs every lane with the bit it
+         * stands for, and compares to get an all-ones or all-zeroes mask per pixel, which selects on or off.
+         */
+
+        __attribute__((target("sse2")))
+        inline void rgba_sse2(const uint64_t *bits, std::size_t words, uint32_t off, uint32_t on, uint8_t *out) {
+            const __m128i select = _mm_setr_epi32(8, 4, 2, 1);
+            const __m128i offs = _mm_set1_epi32(static_cast<int>(off));
+            const __m128i flips = _mm_set1_epi32(static_cast<int>(off ^ on));
+
+            for (std::size_t w = 0; w < words; w++) {
+                for (int shift = 60; shift >= 0; shift -= 4) {
+                    __m128i lanes = _mm_set1_epi32(static_cast<int>((bits[w] >> shift) & 0xF));
+                    __m128i mask = _mm_cmpeq_epi32(_mm_and_si128(lanes, select), select);
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                                     _mm_xor_si128(offs, _mm_and_si128(mask, flips)));
+                    out += 16;
+                }
+            }
+        }
+
+        __attribute__((target("sse2")))
+        inline void gray_sse2(const uint64_t *bits, std::size_t words, uint32_t off, uint32_t on, uint8_t *out) {
+            const __m128i select = _mm_set1_epi64x(static_cast<long long>(0x0102040810204080));
+            const __m128i offs = _mm_set1_epi8(static_cast<char>(off));
+            const __m128i flips = _mm_set1_epi8(static_cast<char>(off ^ on));
+
+            for (std::size_t w = 0; w < words; w++) {
+                for (int shift = 48; shift >= 0; shift -= 16) {
+                    uint64_t high = (bits[w] >> (shift + 8)) & 0xFF;
+                    uint64_t low = (bits[w] >> shift) & 0xFF;
+                    __m128i lanes = _mm_set_epi64x(static_cast<long long>(low * EVERY_BYTE),
+                                                   static_cast<long long>(high * EVERY_BYTE));
+                    __m128i mask = _mm_cmpeq_epi8(_mm_and_si128(lanes, select), select);
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out),
+                                     _mm_xor_si128(offs, _mm_and_si128(mask, flips)));
+                    out += 16;
+                }
+            }
+        }
+
+        __attribute__((target("avx2")))
+        inline void rgba_avx2(const uint64_t *bits, std::size_t words, uint32_t off, uint32_t on, uint8_t *out) {
+            const __m256i select = _mm256_setr_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+            const __m256i offs = _mm256_set1_epi32(static_cast<int>(off));
+            const __m256i flips = _mm256_set1_epi32(static_cast<int>(off ^ on));
+
+            for (std::size_t w = 0; w < words; w++) {
+                for (int shift = 56; shift >= 0; shift -= 8) {
+                    __m256i lanes = _mm256_set1_epi32(static_cast<int>((bits[w] >> shift) & 0xFF));
+                    __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(lanes, select), select);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                                        _mm256_xor_si256(offs, _mm256_and_si256(mask, flips)));
+                    out += 32;
+                }
+            }
+        }
+
+        __attribute__((target("avx2")))
+        inline void gray_avx2(const uint64_t *bits, std::size_t words, uint32_t off, uint32_t on, uint8_t *out) {
+            // Byte 3 of the 32 bits, the leftmost pixels, into the first 8 lanes, and so on down to byte 0
+            const __m256i spread = _mm256_setr_epi8(3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+                                                    1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+            const __m256i select = _mm256_set1_epi64x(static_cast<long long>(0x0102040810204080));
+            const __m256i offs = _mm256_set1_epi8(static_cast<char>(off));
+            const __m256i flips = _mm256_set1_epi8(static_cast<char>(off ^ on));
+
+            for (std::size_t w = 0; w < words; w++) {
+                for (int shift = 32; shift >= 0; shift -= 32) {
+                    __m256i lanes = _mm256_shuffle_epi8(_mm256_set1_epi32(static_cast<int>(bits[w] >> shift)), spread);
+                    __m256i mask = _mm256_cmpeq_epi8(_mm256_and_si256(lanes, select), select);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                                        _mm256_xor_si256(offs, _mm256_and_si256(mask, flips)));
+                    out += 32;
+                }
+            }
+        }
+#endif
+
+        inline PixelKernel pixel_kernel(SimdKernel kernel, PixelFormat format) {
+            bool gray = format == PixelFormat::gray8;
+            switch (kernel) {
+#ifdef CHIP8_X86_KERNELS
+                case SimdKernel::sse2:
+                    return gray ? gray_sse2 : rgba_sse2;
+                case SimdKernel::avx2:
+                    return gray ? gray_avx2 : rgba_avx2;
+#endif
+                default:
+                    return gray ? gray_scalar : rgba_scalar;
+            }
+        }
+
+        /**
+         * Stretch a row of the screen scale times wider, into scale words.
+         */
+        inline void stretch_row(uint64_t row, unsigned scale, uint64_t *out) {
+            std::fill(out, out + scale, 0);
+            if (scale == 1) {
+                out[0] = row;
+                return;
+            }
+
+            for (unsigned x = 0; x < DISPLAY_WIDTH; x++) {
+                if (((row >> (DISPLAY_WIDTH - 1 - x)) & 1) == 0) {
+                    continue;
+                }
+
+                // The pixel's run of bits may cross into the next word
+                unsigned position = x * scale;
+                unsigned remaining = scale;
+                while (remaining > 0) {
+                    unsigned offset = position % 64;
+                    unsigned count = std::min(remaining, 64 - offset);
+                    uint64_t run = count == 64 ? ~uint64_t{0} : ((uint64_t{1} << count) - 1);
+                    out[position / 64] |= run << (64 - offset - count);
+                    position += count;
+                    remaining -= count;
+                }
+            }
+        }
+    }
+
+    /**
+     * Turns the one bit per pixel screen into an image for a display or an encoder: RGBA or grayscale, every pixel
+     * blown up into a square of scale by scale, in the colours of a palette.
+     *
+     * Each row of the screen is stretched as bits first, then turned into pixels by a kernel that writes 16 or 32
+     * bytes at a time where the host has SSE2 or AVX2, and the row is copied down for the rest of its square. The
+     * kernel is picked when the upscaler is made, from what the host can run.
+     */
+    class Upscaler final {
+    public:
+        static const unsigned MAX_SCALE{32};
+
+        /**
+         * @throws UpscaleError if scale is 0 or more than MAX_SCALE, or the host can't run kernel.
+         */
+        explicit Upscaler(unsigned scale, PixelFormat format = PixelFormat::rgba8, const Palette &palette = Palette(),
+                          SimdKernel kernel = best_kernel())
+            : mScale(scale),
+              mFormat(format),
+              mKernel(kernel),
+              mPixels(detail::pixel_kernel(kernel, format))
+        {
+            if (scale == 0 || scale > MAX_SCALE) {
+                throw UpscaleError("Scale must be from 1 to " + std::to_string(MAX_SCALE) + ", not "
+                                   + std::to_string(scale));
+            }
+            if (!kernel_supported(kernel)) {
+                throw UpscaleError(std::string("This host can't run the ") + kernel_name(kernel) + " kernel");
+            }
+
+            if (format == PixelFormat::gray8) {
+                mOff = luma(palette.off);
+                mOn = luma(palette.on);
+            } else {
+                std::memcpy(&mOff, &palette.off, sizeof(mOff));
+                std::memcpy(&mOn, &palette.on, sizeof(mOn));
+            }
+        }
+
+        unsigned width() const {
+            return static_cast<unsigned>(DISPLAY_WIDTH) * mScale;
+        }
+
+        unsigned height() const {
+            return static_cast<unsigned>(DISPLAY_HEIGHT) * mScale;
+        }
+
+        std::size_t bytesPerPixel() const {
+            return mFormat == PixelFormat::gray8 ? 1 : 4;
+        }
+
+        /**
+         * Bytes from one row of the image to the next. Rows are packed.
+         */
+        std::size_t stride() const {
+            return width() * bytesPerPixel();
+        }
+
+        std::size_t size() const {
+            return stride() * height();
+        }
+
+        PixelFormat format() const {
+            return mFormat;
+        }
+
+        SimdKernel kernel() const {
+            return mKernel;
+        }
+
+        /**
+         * Draw frame into image, which must hold size() bytes. Only the rows of the screen set in rows are drawn, so
+         * that an image of the previous frame can be brought up to date by passing the rows that have changed since
+         * (see FrameBuffer::takeDirtyRows()).
+         */
+        void convert(const FrameBuffer &frame, uint8_t *image, uint32_t rows = ALL_ROWS) const {
+            uint64_t stretched[MAX_SCALE];
+            std::size_t rowBytes{stride()};
+
+            for (std::size_t y = 0; y < DISPLAY_HEIGHT; y++) {
+                if (((rows >> y) & 1) == 0) {
+                    continue;
+                }
+
+                uint8_t *square = image + y * mScale * rowBytes;
+                detail::stretch_row(frame.rows()[y], mScale, stretched);
+                mPixels(stretched, mScale, mOff, mOn, square);
+
+                for (unsigned copy = 1; copy < mScale; copy++) {
+                    std::memcpy(square + copy * rowBytes, square, rowBytes);
+                }
+            }
+        }
+
+    private:
+        static uint32_t luma(const Rgba &colour) {
+            // BT.601, in fixed point
+            return (colour.r * 77u + colour.g * 150u + colour.b * 29u) >> 8;
+        }
+
+        unsigned mScale;
+        PixelFormat mFormat;
+        SimdKernel mKernel;
+        detail::PixelKernel mPixels;
+        uint32_t mOff{0};
+        uint32_t mOn{0};
+    };
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Load a program image into anything with a loadProgram(data, size), such as a Machine or a Lockstep, so that tests
+ * can write their programs inline.
+ */
+template <typename Target>
+void load(Target &target, const std::vector<uint8_t> &image) {
+    target.loadProgram(image.data(), image.size());
+}
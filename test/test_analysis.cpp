@@ -0,0 +1,88 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "analysis"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "analysis.hpp"
+
+BOOST_AUTO_TEST_CASE(separates_code_from_sprite_data) {
+    std::vector<uint8_t> image{
+        0xA2, 0x08, // 0x200: LOADI 0x208
+        0xD0, 0x13, // 0x202: DRW V0, V1, 3
+        0x12, 0x06, // 0x204: JMP 0x206
+        0x12, 0x06, // 0x206: JMP 0x206
+        0xFF, 0x81, 0xFF, // 0x208: sprite
+        0x00, // 0x20B: never referenced
+    };
+
+    chip8::ControlFlowGraph graph = chip8::analyze_control_flow(image.data(), image.size());
+
+    BOOST_CHECK(graph.isInstruction(0x200));
+    BOOST_CHECK(graph.isInstruction(0x206));
+    BOOST_CHECK(!graph.isInstruction(0x208));
+    BOOST_CHECK(graph.kindAt(0x201) == chip8::ByteKind::Code);
+    BOOST_CHECK(graph.kindAt(0x208) == chip8::ByteKind::Sprite);
+    BOOST_CHECK(graph.kindAt(0x20A) == chip8::ByteKind::Sprite);
+    BOOST_CHECK(graph.kindAt(0x20B) == chip8::ByteKind::Unknown);
+    BOOST_CHECK(graph.invalidInstructions.empty());
+
+    BOOST_CHECK_EQUAL(graph.blocks.size(), 2);
+    BOOST_CHECK_EQUAL(graph.blocks.at(0x200).end, 0x206);
+    BOOST_CHECK_EQUAL(graph.blocks.at(0x200).successors.size(), 1);
+    BOOST_CHECK_EQUAL(graph.blocks.at(0x200).successors[0], 0x206);
+    BOOST_CHECK_EQUAL(graph.jumpTargets.count(0x206), 1);
+}
+
+BOOST_AUTO_TEST_CASE(follows_calls_and_skips) {
+    std::vector<uint8_t> image{
+        0x22, 0x0A, // 0x200: CALL 0x20A
+        0x30, 0x01, // 0x202: SKE V0, 0x1
+        0x12, 0x02, // 0x204: JMP 0x202
+        0xB3, 0x00, // 0x206: JUMPI 0x300
+        0xFF, 0xFF, // 0x208: not reachable
+        0x60, 0x01, // 0x20A: MOV V0, 0x1
+        0x00, 0xEE, // 0x20C: RET
+    };
+
+    chip8::ControlFlowGraph graph = chip8::analyze_control_flow(image.data(), image.size());
+
+    BOOST_CHECK_EQUAL(graph.callTargets.count(0x20A), 1);
+    BOOST_CHECK(graph.isInstruction(0x20C));
+    BOOST_CHECK(!graph.isInstruction(0x208));
+
+    BOOST_REQUIRE_EQUAL(graph.unresolvedJumps.size(), 1);
+    BOOST_CHECK_EQUAL(graph.unresolvedJumps[0], 0x206);
+
+    const chip8::BasicBlock &call = graph.blocks.at(0x200);
+    BOOST_REQUIRE_EQUAL(call.successors.size(), 1);
+    BOOST_CHECK_EQUAL(call.successors[0], 0x202);
+
+    const chip8::BasicBlock &skip = graph.blocks.at(0x202);
+    BOOST_REQUIRE_EQUAL(skip.successors.size(), 2);
+    BOOST_CHECK_EQUAL(skip.successors[0], 0x204);
+    BOOST_CHECK_EQUAL(skip.successors[1], 0x206);
+
+    BOOST_CHECK(graph.blocks.at(0x206).unresolved);
+    BOOST_CHECK(graph.blocks.at(0x20A).returns);
+}
+
+BOOST_AUTO_TEST_CASE(stops_at_invalid_instructions) {
+    std::vector<uint8_t> image{
+        0x60, 0x01, // 0x200: MOV V0, 0x1
+        0xFF, 0xFF, // 0x202: garbage
+    };
+
+    chip8::ControlFlowGraph graph = chip8::analyze_control_flow(image.data(), image.size());
+
+    BOOST_REQUIRE_EQUAL(graph.invalidInstructions.size(), 1);
+    BOOST_CHECK_EQUAL(graph.invalidInstructions[0], 0x202);
+    BOOST_CHECK_EQUAL(graph.blocks.at(0x200).end, 0x202);
+    BOOST_CHECK(graph.blocks.at(0x200).successors.empty());
+}
+
+#pragma clang diagnostic pop
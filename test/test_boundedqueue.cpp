@@ -0,0 +1,76 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "boundedqueue"
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "boundedqueue.hpp"
+
+BOOST_AUTO_TEST_CASE(boundedqueue) {
+    chip8::BoundedQueue<int> queue{3};
+
+    BOOST_CHECK_EQUAL(queue.capacity(), 4);
+
+    for (int i = 0; i < 4; i++) {
+        BOOST_CHECK(queue.push(i));
+    }
+    BOOST_CHECK(!queue.push(4));
+    BOOST_CHECK_EQUAL(queue.size(), 4);
+
+    int value{-1};
+    BOOST_CHECK(queue.pop(value));
+    BOOST_CHECK_EQUAL(value, 0);
+    BOOST_CHECK(queue.push(4));
+
+    for (int expected = 1; expected <= 4; expected++) {
+        BOOST_CHECK(queue.pop(value));
+        BOOST_CHECK_EQUAL(value, expected);
+    }
+    BOOST_CHECK(!queue.pop(value));
+}
+
+BOOST_AUTO_TEST_CASE(boundedqueue_concurrent) {
+    const int perThread{20000};
+    const int threadCount{4};
+    chip8::BoundedQueue<int> queue{64};
+
+    std::vector<long long> sums(threadCount, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; t++) {
+        threads.emplace_back([&queue, &sums, t]() {
+            // Every thread produces and consumes, so pushes and pops race from all sides. A thread that has had its
+            // share carries on until it has pushed all of its own, or the others would wait for them forever.
+            int produced{0};
+            int consumed{0};
+            while (consumed < perThread || produced < perThread) {
+                if (produced < perThread && queue.push(produced + 1)) {
+                    produced++;
+                }
+
+                int value;
+                if (consumed < perThread && queue.pop(value)) {
+                    sums[t] += value;
+                    consumed++;
+                }
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    long long total{0};
+    for (long long sum : sums) {
+        total += sum;
+    }
+    BOOST_CHECK_EQUAL(total, static_cast<long long>(threadCount) * perThread * (perThread + 1) / 2);
+    BOOST_CHECK_EQUAL(queue.size(), 0);
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,145 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "codemap"
+
+#include <boost/test/unit_test.hpp>
+
+#include "codemap.hpp"
+#include "cpu.hpp"
+#include "decodecache.hpp"
+#include "instructions.hpp"
+
+BOOST_AUTO_TEST_CASE(mark_and_invalidate) {
+    chip8::CodeMap<4096> code;
+
+    code.markCode(0x200, 4);
+    BOOST_CHECK(code.isCode(0x200));
+    BOOST_CHECK(code.isCode(0x203));
+    BOOST_CHECK(!code.isCode(0x204));
+    BOOST_CHECK_EQUAL(code.generation(0x200), 0);
+
+    // Writing data that isn't code leaves the generation alone
+    BOOST_CHECK(!code.invalidate(0x210, 8));
+    BOOST_CHECK_EQUAL(code.generation(0x200), 0);
+
+    // Overwriting code bumps the page generation, but no other page
+    BOOST_CHECK(code.invalidate(0x202, 1));
+    BOOST_CHECK_EQUAL(code.generation(0x200), 1);
+    BOOST_CHECK_EQUAL(code.generation(0x23F), 1);
+    BOOST_CHECK_EQUAL(code.generation(0x240), 0);
+    BOOST_CHECK_EQUAL(code.generation(0x1FF), 0);
+    BOOST_CHECK(!code.isCode(0x202));
+    BOOST_CHECK(code.isCode(0x203));
+}
+
+BOOST_AUTO_TEST_CASE(invalidate_straddling_instruction) {
+    chip8::CodeMap<4096> code;
+
+    // An instruction at the very end of a page
+    code.markCode(0x23F, 2);
+    BOOST_CHECK(code.invalidate(0x240, 1));
+
+    BOOST_CHECK_EQUAL(code.generation(0x23F), 1);
+    BOOST_CHECK_EQUAL(code.generation(0x240), 1);
+}
+
+BOOST_AUTO_TEST_CASE(invalidate_spanning_pages) {
+    chip8::CodeMap<4096> code;
+
+    code.markCode(0x200, 2);
+    code.markCode(0x240, 2);
+    code.markCode(0x280, 2);
+
+    BOOST_CHECK(code.invalidate(0x201, 0x40));
+
+    BOOST_CHECK_EQUAL(code.generation(0x200), 1);
+    BOOST_CHECK_EQUAL(code.generation(0x240), 1);
+    BOOST_CHECK_EQUAL(code.generation(0x280), 0);
+    BOOST_CHECK(code.isCode(0x200));
+    BOOST_CHECK(!code.isCode(0x240));
+    BOOST_CHECK(code.isCode(0x241));
+    BOOST_CHECK(code.isCode(0x280));
+}
+
+BOOST_AUTO_TEST_CASE(invalidate_wraps_around) {
+    chip8::CodeMap<4096> code;
+
+    code.markCode(0xFFE, 2);
+    code.markCode(0x000, 2);
+    code.markCode(0x200, 2);
+
+    // Off the end and round to the start, as memory writes go
+    BOOST_CHECK(code.invalidate(0xFFF, 3));
+    BOOST_CHECK_EQUAL(code.generation(0xFFE), 1);
+    BOOST_CHECK_EQUAL(code.generation(0x000), 1);
+    BOOST_CHECK(!code.isCode(0xFFF));
+    BOOST_CHECK(!code.isCode(0x001));
+    BOOST_CHECK(code.isWritten(0xFFF));
+    BOOST_CHECK(code.isWritten(0x000));
+
+    // Past the end altogether
+    BOOST_CHECK(!code.isWritten(0x200));
+    BOOST_CHECK(code.invalidate(0x1200, 2));
+    BOOST_CHECK_EQUAL(code.generation(0x200), 1);
+    BOOST_CHECK(!code.isCode(0x200));
+    BOOST_CHECK(code.isWritten(0x200));
+}
+
+BOOST_AUTO_TEST_CASE(store_registers_invalidates_code) {
+    chip8::cpu_t cpu;
+    cpu.reset();
+    cpu.code.markCode(0x300, 2);
+
+    chip8::StoreRegistersInstruction instruction{1};
+
+    cpu.I = 0x400;
+    instruction.execute(cpu);
+    BOOST_CHECK_EQUAL(cpu.code.generation(0x300), 0);
+
+    cpu.I = 0x2FF;
+    instruction.execute(cpu);
+    BOOST_CHECK_EQUAL(cpu.code.generation(0x300), 1);
+}
+
+BOOST_AUTO_TEST_CASE(store_decimal_invalidates_code) {
+    chip8::cpu_t cpu;
+    cpu.reset();
+    cpu.code.markCode(0x302, 2);
+
+    chip8::StoreDecimalInstruction instruction{1};
+    cpu.I = 0x300;
+    instruction.execute(cpu);
+
+    BOOST_CHECK_EQUAL(cpu.code.generation(0x302), 1);
+}
+
+BOOST_AUTO_TEST_CASE(decode_cache_sees_self_modifying_code) {
+    chip8::cpu_t cpu;
+    cpu.reset();
+    chip8::DecodeCache cache;
+
+    // MOV V1, 0x05
+    cpu.memory.write(0x200, 0x61);
+    cpu.memory.write(0x201, 0x05);
+
+    auto first = cache.fetch(cpu);
+    BOOST_REQUIRE(first != nullptr);
+    BOOST_CHECK_EQUAL(first->toString(), "MOV V1, 0x5");
+    BOOST_CHECK(cpu.code.isCode(0x200));
+
+    // The same instruction is handed back without decoding again
+    BOOST_CHECK_EQUAL(cache.fetch(cpu), first);
+
+    // Rewrite the immediate through FX33 (BCD of 123 -> 1, 2, 3 at 0x201..0x203)
+    cpu.V[2] = 123;
+    cpu.I = 0x201;
+    chip8::StoreDecimalInstruction{2}.execute(cpu);
+
+    auto second = cache.fetch(cpu);
+    BOOST_REQUIRE(second != nullptr);
+    BOOST_CHECK_EQUAL(second->toString(), "MOV V1, 0x1");
+}
+
+#pragma clang diagnostic pop
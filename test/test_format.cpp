@@ -0,0 +1,37 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "format"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#include "decode.hpp"
+#include "format.hpp"
+
+BOOST_AUTO_TEST_CASE(format_matches_to_string) {
+    char buffer[chip8::MAX_FORMATTED_OPCODE_LENGTH];
+
+    for (uint32_t opcode = 0; opcode <= 0xFFFF; opcode++) {
+        std::unique_ptr<chip8::Instruction> instruction = chip8::decode_opcode(static_cast<uint16_t>(opcode));
+        std::size_t length = chip8::format_opcode(static_cast<uint16_t>(opcode), buffer);
+
+        if (!instruction) {
+            BOOST_CHECK_EQUAL(length, 0);
+            continue;
+        }
+
+        BOOST_REQUIRE_EQUAL(std::string(buffer, length), instruction->toString());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(format_decodes_both_registers) {
+    char buffer[chip8::MAX_FORMATTED_OPCODE_LENGTH];
+    std::size_t length = chip8::format_opcode(0x8B02, buffer);
+
+    BOOST_CHECK_EQUAL(std::string(buffer, length), "AND V11, V0");
+}
+
+#pragma clang diagnostic pop
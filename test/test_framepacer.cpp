@@ -0,0 +1,132 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "framepacer"
+
+#include <chrono>
+
+#include <boost/test/unit_test.hpp>
+
+#include "framepacer.hpp"
+
+namespace {
+    /**
+     * A clock that only moves when told to, and that oversleeps by a set amount.
+     */
+    struct FakeClock {
+        using time_point = std::chrono::steady_clock::time_point;
+
+        static time_point current;
+        static std::chrono::nanoseconds oversleep;
+        static int sleeps;
+
+        static time_point now() {
+            return current;
+        }
+
+        static void sleep_until(time_point deadline) {
+            sleeps++;
+            current = std::max(current, deadline + oversleep);
+        }
+
+        static void reset(std::chrono::nanoseconds oversleepBy = std::chrono::nanoseconds(0)) {
+            current = time_point();
+            oversleep = oversleepBy;
+            sleeps = 0;
+        }
+    };
+
+    FakeClock::time_point FakeClock::current;
+    std::chrono::nanoseconds FakeClock::oversleep;
+    int FakeClock::sleeps;
+
+    const std::chrono::milliseconds PERIOD{10};
+}
+
+BOOST_AUTO_TEST_CASE(oversleeping_does_not_add_up) {
+    FakeClock::reset(std::chrono::milliseconds(1));
+    chip8::FramePacer<FakeClock> pacer{PERIOD};
+    pacer.start();
+
+    for (int frame = 0; frame < 100; frame++) {
+        pacer.wait();
+    }
+
+    // Every frame woke 1ms late, but only relative to when it was due
+    BOOST_CHECK(FakeClock::current.time_since_epoch() == PERIOD * 100 + std::chrono::milliseconds(1));
+    BOOST_CHECK_EQUAL(FakeClock::sleeps, 100);
+
+    chip8::PacingStats stats = pacer.stats();
+    BOOST_CHECK_EQUAL(stats.frames, 100u);
+    BOOST_CHECK_EQUAL(stats.lateFrames, 0u);
+    BOOST_CHECK_CLOSE(stats.p50FrameNs, 10e6, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(sixty_hertz_does_not_drift) {
+    FakeClock::reset();
+    chip8::FramePacer<FakeClock> pacer;
+    pacer.start();
+
+    // A 60th of a second isn't a whole number of nanoseconds, but an hour of frames still ends on the hour
+    for (int frame = 0; frame < 60 * 60 * 60; frame++) {
+        pacer.wait();
+    }
+    BOOST_CHECK(FakeClock::current.time_since_epoch() == std::chrono::hours(1));
+}
+
+BOOST_AUTO_TEST_CASE(jitter_of_long_steady_frames) {
+    FakeClock::reset();
+    chip8::FramePacer<FakeClock> pacer{std::chrono::seconds(1000)};
+    pacer.start();
+
+    // Frames of 1000 s have squares of 1e24 ns², far too big for their difference to keep a jitter of 2 ns
+    for (int frame = 0; frame < 1000; frame++) {
+        FakeClock::oversleep = std::chrono::nanoseconds(frame % 2 == 0 ? 0 : 2);
+        pacer.wait();
+    }
+
+    chip8::PacingStats stats = pacer.stats();
+    BOOST_CHECK_CLOSE(stats.meanFrameNs, 1e12, 0.001);
+    BOOST_CHECK_CLOSE(stats.jitterNs, 2.0, 1);
+}
+
+BOOST_AUTO_TEST_CASE(a_slow_frame_is_made_up_for) {
+    FakeClock::reset();
+    chip8::FramePacer<FakeClock> pacer{PERIOD};
+    pacer.start();
+
+    pacer.wait();
+    FakeClock::current += std::chrono::milliseconds(15);
+    pacer.wait();
+    pacer.wait();
+
+    // The second frame ran long, so the third starts straight away to get back on schedule
+    BOOST_CHECK(FakeClock::current.time_since_epoch() == PERIOD * 3);
+    BOOST_CHECK_EQUAL(FakeClock::sleeps, 2);
+
+    chip8::PacingStats stats = pacer.stats();
+    BOOST_CHECK_CLOSE(stats.maxFrameNs, 15e6, 0.001);
+    BOOST_CHECK_CLOSE(stats.meanFrameNs, 10e6, 0.001);
+    BOOST_CHECK_GT(stats.jitterNs, 0);
+}
+
+BOOST_AUTO_TEST_CASE(drops_frames_after_a_stall) {
+    FakeClock::reset();
+    chip8::FramePacer<FakeClock> pacer{PERIOD, 6};
+    pacer.start();
+
+    pacer.wait();
+    FakeClock::current += std::chrono::seconds(1);
+    pacer.wait();
+    pacer.wait();
+
+    // Rather than running a hundred frames back to back, pacing picks up again from the end of the stall
+    BOOST_CHECK(FakeClock::current.time_since_epoch() == PERIOD + std::chrono::seconds(1) + PERIOD);
+
+    chip8::PacingStats stats = pacer.stats();
+    BOOST_CHECK_EQUAL(stats.resyncs, 1u);
+    BOOST_CHECK_EQUAL(stats.lateFrames, 0u);
+}
+
+#pragma clang diagnostic pop
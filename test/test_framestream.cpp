@@ -0,0 +1,234 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "framestream"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include "framebuffer.hpp"
+#include "framestream.hpp"
+#include "machine.hpp"
+#include "rom.hpp"
+#include "runner.hpp"
+
+namespace {
+    /**
+     * Every frame of a few seconds of a game.
+     */
+    std::vector<chip8::FrameBuffer> game_frames(const std::string &game, uint64_t count) {
+        std::shared_ptr<const chip8::Rom> rom = chip8::load_rom(std::string(CHIP8_DATA_DIR) + "/games/" + game);
+        chip8::Machine machine;
+        machine.loadProgram(*rom);
+
+        std::vector<chip8::FrameBuffer> frames;
+        chip8::RunLimits limits;
+        limits.frames = count;
+        chip8::RunStats stats;
+        chip8::run(machine, limits, chip8::Movie(), stats, [&frames, &machine](uint64_t) {
+            frames.push_back(machine.cpu().fb);
+            return true;
+        });
+        return frames;
+    }
+
+    std::vector<uint8_t> encode(const std::vector<chip8::FrameBuffer> &frames, unsigned keyframeInterval) {
+        chip8::FrameEncoder encoder{keyframeInterval};
+        std::vector<uint8_t> stream(sizeof(chip8::FRAME_STREAM_MAGIC) + 1);
+        chip8::FrameEncoder::header(stream.data());
+
+        uint8_t record[chip8::MAX_FRAME_RECORD];
+        for (const chip8::FrameBuffer &frame : frames) {
+            std::size_t size = encoder.encode(frame, record);
+            stream.insert(stream.end(), record, record + size);
+        }
+        return stream;
+    }
+
+    std::vector<uint8_t> read_file(const std::string &path) {
+        std::ifstream in{path, std::ios::binary};
+        return std::vector<uint8_t>{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    }
+}
+
+BOOST_AUTO_TEST_CASE(games_round_trip) {
+    for (const char *game : {"BRIX", "PONG", "INVADERS"}) {
+        BOOST_TEST_CONTEXT(game) {
+            std::vector<chip8::FrameBuffer> frames = game_frames(game, 600);
+            std::vector<uint8_t> stream = encode(frames, 60);
+
+            std::vector<chip8::FrameBuffer> decoded = chip8::decode_frame_stream(stream);
+            BOOST_CHECK(decoded == frames);
+
+            // Most frames change a few bytes, if any
+            BOOST_TEST_MESSAGE(game << ": " << stream.size() << " bytes for " << frames.size() << " frames");
+            BOOST_CHECK_LT(stream.size(), frames.size() * chip8::FRAME_BYTES / 10);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(worst_case_frames) {
+    // Bytes that alternate between zero and not make a single byte literal and a single byte zero run of every pair,
+    // in keyframes and in deltas from a blank frame. Checkerboards make deltas of nothing but literals.
+    chip8::FrameBuffer stripes;
+    chip8::FrameBuffer checkers;
+    chip8::FrameBuffer inverse;
+    for (std::size_t y = 0; y < chip8::DISPLAY_HEIGHT; y++) {
+        stripes.setRow(y, 0xFF00FF00FF00FF00);
+        checkers.setRow(y, y % 2 == 0 ? 0xAAAAAAAAAAAAAAAA : 0x5555555555555555);
+        inverse.setRow(y, ~checkers.rows()[y]);
+    }
+    std::vector<chip8::FrameBuffer> frames{stripes, chip8::FrameBuffer(), stripes, checkers, inverse,
+                                           chip8::FrameBuffer(), chip8::FrameBuffer(), checkers, checkers, inverse};
+
+    chip8::FrameEncoder encoder{4};
+    uint8_t record[chip8::MAX_FRAME_RECORD];
+    BOOST_CHECK_EQUAL(chip8::MAX_FRAME_RECORD, 385u);
+    BOOST_CHECK_EQUAL(encoder.encode(stripes, record), chip8::MAX_FRAME_RECORD);
+    BOOST_CHECK_EQUAL(record[0], chip8::FRAME_KEY);
+    BOOST_CHECK_EQUAL(encoder.encode(stripes, record), 1u);
+    BOOST_CHECK_EQUAL(record[0], chip8::FRAME_SAME);
+    BOOST_CHECK_EQUAL(encoder.encode(chip8::FrameBuffer(), record), chip8::MAX_FRAME_RECORD);
+    BOOST_CHECK_EQUAL(record[0], chip8::FRAME_DELTA);
+    BOOST_CHECK_EQUAL(encoder.encode(checkers, record), 1u + chip8::FRAME_BYTES + 2);
+    BOOST_CHECK_EQUAL(record[0], chip8::FRAME_DELTA);
+    BOOST_CHECK_EQUAL(encoder.encode(chip8::FrameBuffer(), record), 3u);
+    BOOST_CHECK_EQUAL(record[0], chip8::FRAME_KEY);
+
+    for (unsigned interval : {0u, 1u, 2u, 5u}) {
+        BOOST_TEST_CONTEXT("keyframe interval " << interval) {
+            BOOST_CHECK(chip8::decode_frame_stream(encode(frames, interval)) == frames);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rejects_malformed_streams) {
+    std::vector<chip8::FrameBuffer> frames = game_frames("PONG", 10);
+    std::vector<uint8_t> stream = encode(frames, 0);
+
+    std::vector<uint8_t> wrongMagic{stream};
+    wrongMagic[0] = 'X';
+    BOOST_CHECK_THROW(chip8::decode_frame_stream(wrongMagic), chip8::FrameStreamError);
+
+    std::vector<uint8_t> wrongVersion{stream};
+    wrongVersion[sizeof(chip8::FRAME_STREAM_MAGIC)] = 99;
+    BOOST_CHECK_THROW(chip8::decode_frame_stream(wrongVersion), chip8::FrameStreamError);
+
+    std::vector<uint8_t> cutShort{stream.begin(), stream.begin() + sizeof(chip8::FRAME_STREAM_MAGIC) + 3};
+    BOOST_CHECK_THROW(chip8::decode_frame_stream(cutShort), chip8::FrameStreamError);
+
+    std::vector<uint8_t> unknownRecord{stream};
+    unknownRecord.push_back(7);
+    BOOST_CHECK_THROW(chip8::decode_frame_stream(unknownRecord), chip8::FrameStreamError);
+
+    // A run past the end of the frame
+    std::vector<uint8_t> overrun{stream.begin(), stream.begin() + sizeof(chip8::FRAME_STREAM_MAGIC) + 1};
+    overrun.insert(overrun.end(), {chip8::FRAME_KEY, 0x7F, 0x7E, 0x01});
+    BOOST_CHECK_THROW(chip8::decode_frame_stream(overrun), chip8::FrameStreamError);
+
+    // A delta with nothing to apply it to
+    chip8::FrameDecoder decoder;
+    uint8_t delta[] = {chip8::FRAME_DELTA, 0x7F, 0x7F};
+    BOOST_CHECK_THROW(decoder.decode(delta, sizeof(delta)), chip8::FrameStreamError);
+    uint8_t key[] = {chip8::FRAME_KEY, 0x7F, 0x7F};
+    BOOST_CHECK_EQUAL(decoder.decode(key, sizeof(key)), 3u);
+    BOOST_CHECK_EQUAL(decoder.decode(delta, sizeof(delta)), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(writes_files) {
+    std::vector<chip8::FrameBuffer> frames = game_frames("BRIX", 300);
+    std::string path{"framestream_test.c8f"};
+    {
+        chip8::FrameStreamOptions options;
+        options.keyframeInterval = 100;
+        options.flushBytes = 4096;
+        chip8::FrameStreamWriter writer{path, options};
+        for (const chip8::FrameBuffer &frame : frames) {
+            BOOST_CHECK(writer.write(frame));
+        }
+
+        chip8::FrameStreamStats stats = writer.stats();
+        BOOST_CHECK_EQUAL(stats.frames, 300u);
+        BOOST_CHECK_EQUAL(stats.keyframes, 3u);
+        BOOST_CHECK_EQUAL(stats.dropped, 0u);
+    }
+
+    std::vector<uint8_t> stream = read_file(path);
+    std::remove(path.c_str());
+    BOOST_CHECK(stream == encode(frames, 100));
+    BOOST_CHECK(chip8::decode_frame_stream(stream) == frames);
+
+    BOOST_CHECK_THROW(chip8::FrameStreamWriter("no/such/directory/stream.c8f"), std::system_error);
+}
+
+BOOST_AUTO_TEST_CASE(slow_viewers_get_keyframes_after_drops) {
+    std::string path{"/tmp/chip8_framestream_" + std::to_string(::getpid()) + ".sock"};
+    ::unlink(path.c_str());
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    BOOST_REQUIRE_GE(listener, 0);
+    BOOST_REQUIRE_EQUAL(::bind(listener, reinterpret_cast<const sockaddr *>(&address), sizeof(address)), 0);
+    BOOST_REQUIRE_EQUAL(::listen(listener, 1), 0);
+
+    // The viewer doesn't read anything until the game is over, so the socket and then the buffer fill up
+    std::vector<chip8::FrameBuffer> frames = game_frames("INVADERS", 2000);
+    chip8::FrameStreamOptions options;
+    options.bufferSize = 1024;
+    chip8::FrameStreamWriter writer{"unix:" + path, options};
+    int viewer = ::accept(listener, nullptr, nullptr);
+    BOOST_REQUIRE_GE(viewer, 0);
+    int small{4096};
+    ::setsockopt(viewer, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+
+    for (const chip8::FrameBuffer &frame : frames) {
+        writer.write(frame);
+    }
+    chip8::FrameStreamStats stats = writer.stats();
+    BOOST_TEST_MESSAGE(stats.dropped << " of " << stats.frames << " frames dropped, " << stats.keyframes
+                       << " keyframes");
+    BOOST_CHECK_GT(stats.dropped, 0u);
+    BOOST_CHECK_GT(stats.keyframes, 1u);
+    BOOST_CHECK_LE(writer.buffered(), options.bufferSize);
+
+    // Whatever got through decodes to frames of the game, in order
+    std::vector<uint8_t> stream;
+    uint8_t chunk[4096];
+    ssize_t size;
+    do {
+        writer.flush();
+        size = ::recv(viewer, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (size > 0) {
+            stream.insert(stream.end(), chunk, chunk + size);
+        }
+    } while (size > 0 || writer.buffered() > 0);
+    ::close(viewer);
+    ::close(listener);
+    ::unlink(path.c_str());
+
+    std::vector<chip8::FrameBuffer> decoded = chip8::decode_frame_stream(stream);
+    BOOST_CHECK_EQUAL(decoded.size(), stats.frames - stats.dropped);
+    std::size_t next{0};
+    for (const chip8::FrameBuffer &frame : decoded) {
+        while (next < frames.size() && frames[next] != frame) {
+            next++;
+        }
+        BOOST_REQUIRE_LT(next, frames.size());
+        next++;
+    }
+}
+
+#pragma clang diagnostic pop
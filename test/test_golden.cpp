@@ -0,0 +1,189 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "golden"
+
+/**
+ * Runs every ROM in data/games headlessly, with a fixed seed and input, and checks the framebuffer hash at regular
+ * checkpoints against data/golden/frames.txt, on every engine. Any change to what a game draws fails it.
+ *
+ * ROMs run in parallel, one per core. When a change to what games draw is intended, regenerate the golden hashes by
+ * running this test with CHIP8_UPDATE_GOLDEN=1 in the environment.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <libgen.h>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "files.hpp"
+#include "machine.hpp"
+#include "movie.hpp"
+#include "rom.hpp"
+#include "runner.hpp"
+
+namespace {
+    const uint32_t GOLDEN_SEED{0xC0FFEE};
+    const uint64_t GOLDEN_FRAMES{3000};
+    const uint64_t CHECKPOINT_INTERVAL{300};
+    const unsigned INSTRUCTIONS_PER_FRAME{10};
+
+    const std::string GOLDEN_PATH{std::string(CHIP8_DATA_DIR) + "/golden/frames.txt"};
+
+    /**
+     * The framebuffer hash at each checkpoint of each ROM, by ROM name.
+     */
+    using Golden = std::map<std::string, std::vector<uint64_t>>;
+
+    struct Run {
+        std::string name;
+        std::vector<uint64_t> hashes;
+        std::string error;
+    };
+
+    void run_rom(const std::string &path, const chip8::Movie &movie, chip8::Engine engine, Run &run) {
+        run.name = basename(const_cast<char *>(path.c_str()));
+
+        try {
+            std::shared_ptr<const chip8::Rom> rom = chip8::load_rom(path);
+            chip8::Machine machine;
+            machine.loadProgram(*rom);
+            machine.seed(GOLDEN_SEED);
+            machine.setEngine(engine);
+
+            chip8::RunLimits limits;
+            limits.frames = GOLDEN_FRAMES;
+            limits.instructionsPerFrame = INSTRUCTIONS_PER_FRAME;
+
+            chip8::RunStats stats;
+            chip8::run(machine, limits, movie, stats, [&machine, &run](uint64_t frame) {
+                if ((frame + 1) % CHECKPOINT_INTERVAL == 0) {
+                    run.hashes.push_back(machine.cpu().fb.hash());
+                }
+                return true;
+            });
+        } catch (const std::exception &e) {
+            run.error = e.what();
+        }
+    }
+
+    /**
+     * Run every ROM, spread over as many threads as there are cores.
+     */
+    std::vector<Run> run_all(const std::vector<std::string> &paths, const chip8::Movie &movie, chip8::Engine engine) {
+        std::vector<Run> runs(paths.size());
+        std::atomic<std::size_t> next{0};
+
+        auto worker = [&]() {
+            for (std::size_t i = next++; i < paths.size(); i = next++) {
+                run_rom(paths[i], movie, engine, runs[i]);
+            }
+        };
+
+        std::size_t threadCount = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                                         paths.size());
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < threadCount; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+
+        return runs;
+    }
+
+    /**
+     * Golden files hold one "ROM FRAME HASH" line per checkpoint, with the hash in hex.
+     */
+    Golden read_golden(const std::string &path) {
+        Golden golden;
+        std::ifstream file{path};
+
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields{line};
+            std::string rom;
+            uint64_t frame;
+            uint64_t hash;
+            if (!(fields >> rom) || rom[0] == '#') {
+                continue;
+            }
+            if (fields >> frame >> std::hex >> hash) {
+                golden[rom].push_back(hash);
+            }
+        }
+
+        return golden;
+    }
+
+    void write_golden(const std::string &path, const std::vector<Run> &runs) {
+        std::ofstream file{path};
+        file << "# Framebuffer hashes of every bundled ROM after every " << CHECKPOINT_INTERVAL << " of "
+             << GOLDEN_FRAMES << " frames, at " << INSTRUCTIONS_PER_FRAME << " instructions per frame, with seed 0x"
+             << std::hex << GOLDEN_SEED << " and data/golden/input.movie." << std::endl;
+        file << "# Written by test_golden with CHIP8_UPDATE_GOLDEN=1." << std::endl;
+        file << "# ROM FRAME HASH" << std::endl;
+
+        for (const Run &run : runs) {
+            for (std::size_t i = 0; i < run.hashes.size(); i++) {
+                file << run.name << ' ' << std::dec << (i + 1) * CHECKPOINT_INTERVAL << ' '
+                     << std::hex << std::setw(16) << std::setfill('0') << run.hashes[i] << std::endl;
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(every_rom_draws_its_golden_frames) {
+    std::vector<std::string> paths = chip8::list_roms(std::string(CHIP8_DATA_DIR) + "/games");
+    BOOST_REQUIRE(!paths.empty());
+
+    chip8::Movie movie = chip8::load_movie(std::string(CHIP8_DATA_DIR) + "/golden/input.movie");
+
+    if (std::getenv("CHIP8_UPDATE_GOLDEN") != nullptr) {
+        std::vector<Run> runs = run_all(paths, movie, chip8::Engine::cached);
+        for (const Run &run : runs) {
+            BOOST_REQUIRE_MESSAGE(run.error.empty(), run.name << ": " << run.error);
+        }
+        write_golden(GOLDEN_PATH, runs);
+        BOOST_TEST_MESSAGE("Wrote " << GOLDEN_PATH);
+        return;
+    }
+
+    Golden golden = read_golden(GOLDEN_PATH);
+    BOOST_REQUIRE_MESSAGE(!golden.empty(), "No golden hashes in " << GOLDEN_PATH);
+
+    for (chip8::Engine engine : {chip8::Engine::cached, chip8::Engine::decode}) {
+        for (const Run &run : run_all(paths, movie, engine)) {
+            BOOST_TEST_CONTEXT(run.name << " on the " << chip8::engine_name(engine) << " engine") {
+                BOOST_CHECK_MESSAGE(run.error.empty(), run.error);
+
+                auto expected = golden.find(run.name);
+                if (expected == golden.end()) {
+                    BOOST_ERROR("no golden hashes");
+                    continue;
+                }
+
+                // Report the first checkpoint that differs, later ones are bound to differ too
+                auto mismatch = std::mismatch(run.hashes.begin(), run.hashes.end(),
+                                              expected->second.begin(), expected->second.end());
+                BOOST_CHECK_MESSAGE(mismatch.first == run.hashes.end() && mismatch.second == expected->second.end(),
+                                    "differs from frame "
+                                    << (mismatch.first - run.hashes.begin() + 1) * CHECKPOINT_INTERVAL);
+            }
+        }
+    }
+}
+
+#pragma clang diagnostic pop
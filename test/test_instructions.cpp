@@ -12,6 +12,16 @@
 #include "cpu.hpp"
 #include "instructions.hpp"
 
+namespace {
+    std::string frame_buffer_to_string(const chip8::FrameBuffer &fb) {
+        std::string pixels;
+        for (std::size_t i = 0; i < fb.size(); i++) {
+            pixels += fb[i] ? '1' : '0';
+        }
+        return pixels;
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_store_in_register) {
     chip8::StoreInVxInstruction storeInVxInstruction{5, 123};
     BOOST_CHECK_EQUAL(storeInVxInstruction.toString(), "MOV V5, 0x7b");
@@ -99,10 +109,15 @@ BOOST_AUTO_TEST_CASE(clear_screen_instruction) {
 
     chip8::cpu_t cpu;
     cpu.reset();
-    cpu.fb[12] = true;
+    cpu.fb.set(12, 0, true);
+    cpu.fb.set(3, 7, true);
+    cpu.fb.takeDirtyRows();
     instruction.execute(cpu);
 
     BOOST_CHECK_EQUAL(cpu.fb[12], false);
+
+    // Only rows that had something on them change
+    BOOST_CHECK_EQUAL(cpu.fb.dirtyRows(), (1u << 0) | (1u << 7));
 }
 
 BOOST_AUTO_TEST_CASE(bitwise_and_instruction) {
@@ -160,9 +175,7 @@ BOOST_AUTO_TEST_CASE(system_call_instruction) {
 
 
     BOOST_CHECK_EQUAL_COLLECTIONS(cpu.V.begin(), cpu.V.end(), unused_cpu.V.begin(), unused_cpu.V.end());
-    BOOST_CHECK_EQUAL_COLLECTIONS(
-        cpu.memory.begin(), cpu.memory.end(),
-        unused_cpu.memory.begin(), unused_cpu.memory.end());
+    BOOST_CHECK(cpu.memory == unused_cpu.memory);
 }
 
 BOOST_AUTO_TEST_CASE(call_instruction) {
@@ -330,12 +343,12 @@ BOOST_AUTO_TEST_CASE(read_instruction) {
     chip8::cpu_t cpu;
     cpu.reset();
 
-    cpu.memory[0x900] = 99;
-    cpu.memory[0x901] = 98;
-    cpu.memory[0x902] = 97;
-    cpu.memory[0x903] = 96;
-    cpu.memory[0x904] = 95;
-    cpu.memory[0x905] = 94;
+    cpu.memory.write(0x900, 99);
+    cpu.memory.write(0x901, 98);
+    cpu.memory.write(0x902, 97);
+    cpu.memory.write(0x903, 96);
+    cpu.memory.write(0x904, 95);
+    cpu.memory.write(0x905, 94);
 
     cpu.I = 0x900;
 
@@ -456,7 +469,26 @@ BOOST_AUTO_TEST_CASE(wait_for_key_press_instruction) {
     chip8::WaitForKeypressInstruction instruction{1};
     BOOST_CHECK_EQUAL(instruction.toString(), "KEYD");
 
-    // TODO: Implement KEYD
+    chip8::cpu_t cpu;
+    cpu.reset();
+    cpu.pc = 0x220;
+
+    // Nothing held, so the machine waits
+    instruction.execute(cpu);
+    BOOST_CHECK_EQUAL(cpu.pc, 0x220);
+    BOOST_CHECK_EQUAL(cpu.keyWait, 1);
+    BOOST_CHECK(!chip8::WaitForKeypressInstruction::resume(cpu));
+
+    cpu.keys = (1 << 0xB) | (1 << 0xD);
+    BOOST_CHECK(chip8::WaitForKeypressInstruction::resume(cpu));
+    BOOST_CHECK_EQUAL(cpu.V[1], 0xB);
+    BOOST_CHECK_EQUAL(cpu.keyWait, chip8::NO_KEY_WAIT);
+
+    // Held already, so there is no wait
+    cpu.keys = 1 << 0x4;
+    instruction.execute(cpu);
+    BOOST_CHECK_EQUAL(cpu.V[1], 0x4);
+    BOOST_CHECK_EQUAL(cpu.keyWait, chip8::NO_KEY_WAIT);
 }
 
 BOOST_AUTO_TEST_CASE(draw_sprite_instruction) {
@@ -475,7 +507,7 @@ BOOST_AUTO_TEST_CASE(draw_sprite_instruction) {
     cpu.reset();
 
     // Write the test sprite into main memory at address 0x40
-    std::copy(sprite.begin(), sprite.end(), cpu.memory.begin() + 0x40);
+    cpu.memory.write(0x40, sprite.data(), sprite.size());
 
     // Draw the sprite at (10, 10) on the display
     cpu.V[1] = 10;
@@ -523,15 +555,7 @@ BOOST_AUTO_TEST_CASE(draw_sprite_instruction) {
         "0000000000000000000000000000000000000000000000000000000000000000"
         "0000000000000000000000000000000000000000000000000000000000000000";
 
-    std::array<uint8_t, 64 * 32> expected_frame_buffer;
-    std::transform(
-        expected_frame_buffer_str.begin(), expected_frame_buffer_str.end(),
-        expected_frame_buffer.begin(),
-        [](char c) { return c == '1'; });
-
-    BOOST_CHECK_EQUAL_COLLECTIONS(
-        cpu.fb.begin(), cpu.fb.end(),
-        expected_frame_buffer.begin(), expected_frame_buffer.end());
+    BOOST_CHECK_EQUAL(frame_buffer_to_string(cpu.fb), expected_frame_buffer_str);
 
     // Now draw the same sprite again at (9, 9)
     cpu.V[1] = 9;
@@ -576,13 +600,42 @@ BOOST_AUTO_TEST_CASE(draw_sprite_instruction) {
         "0000000000000000000000000000000000000000000000000000000000000000"
         "0000000000000000000000000000000000000000000000000000000000000000";
 
-    std::transform(
-        expected_frame_buffer_str_2.begin(), expected_frame_buffer_str_2.end(),
-        expected_frame_buffer.begin(),
-        [](char c) { return c == '1'; });
-    BOOST_CHECK_EQUAL_COLLECTIONS(
-        cpu.fb.begin(), cpu.fb.end(),
-        expected_frame_buffer.begin(), expected_frame_buffer.end());
+    BOOST_CHECK_EQUAL(frame_buffer_to_string(cpu.fb), expected_frame_buffer_str_2);
+}
+
+BOOST_AUTO_TEST_CASE(draw_sprite_instruction_wraps) {
+    chip8::DrawSpriteInstruction instruction{1, 2, 2};
+
+    chip8::cpu_t cpu;
+    cpu.reset();
+    cpu.memory.write(0x40, 0b11000011);
+    cpu.memory.write(0x41, 0b10000001);
+    cpu.fb.takeDirtyRows();
+
+    // Straddles the bottom right corner
+    cpu.V[1] = 60;
+    cpu.V[2] = 31;
+    cpu.I = 0x40;
+    instruction.execute(cpu);
+
+    BOOST_CHECK_EQUAL(cpu.V[15], 0);
+    BOOST_CHECK(cpu.fb.get(60, 31));
+    BOOST_CHECK(cpu.fb.get(61, 31));
+    BOOST_CHECK(cpu.fb.get(2, 31));
+    BOOST_CHECK(cpu.fb.get(3, 31));
+    BOOST_CHECK(cpu.fb.get(60, 0));
+    BOOST_CHECK(cpu.fb.get(3, 0));
+    BOOST_CHECK(!cpu.fb.get(61, 0));
+
+    // Only the two rows of the sprite are drawn
+    BOOST_CHECK(!cpu.fb.get(60, 1));
+    BOOST_CHECK_EQUAL(cpu.fb.takeDirtyRows(), (1u << 31) | (1u << 0));
+    BOOST_CHECK_EQUAL(cpu.fb.dirtyRows(), 0u);
+
+    // Blank sprite rows leave their screen rows clean
+    cpu.memory.write(0x40, 0);
+    instruction.execute(cpu);
+    BOOST_CHECK_EQUAL(cpu.fb.dirtyRows(), 1u);
 }
 
 // TODO: Validate that carry is handled appropriately
@@ -620,16 +673,36 @@ BOOST_AUTO_TEST_CASE(decrement_instruction) {
     BOOST_CHECK_EQUAL(cpu.V[15], 1);
 }
 
-// TODO: Implement SKP
 BOOST_AUTO_TEST_CASE(skip_if_key_pressed_instruction) {
     chip8::SkipIfKeyPressedInstruction instruction{1};
     BOOST_CHECK_EQUAL(instruction.toString(), "SKP V1");
+
+    chip8::cpu_t cpu;
+    cpu.reset();
+    cpu.V[1] = 0xA;
+
+    instruction.execute(cpu);
+    BOOST_CHECK_EQUAL(cpu.pc, 0x200);
+
+    cpu.keys = 1 << 0xA;
+    instruction.execute(cpu);
+    BOOST_CHECK_EQUAL(cpu.pc, 0x202);
 }
 
-// TODO: Implement SKNP
 BOOST_AUTO_TEST_CASE(skip_if_key_not_pressed_instruction) {
     chip8::SkipIfKeyNotPressedInstruction instruction{1};
     BOOST_CHECK_EQUAL(instruction.toString(), "SKNP V1");
+
+    chip8::cpu_t cpu;
+    cpu.reset();
+    cpu.V[1] = 0xA;
+
+    instruction.execute(cpu);
+    BOOST_CHECK_EQUAL(cpu.pc, 0x202);
+
+    cpu.keys = 1 << 0xA;
+    instruction.execute(cpu);
+    BOOST_CHECK_EQUAL(cpu.pc, 0x202);
 }
 
 BOOST_AUTO_TEST_CASE(add_to_I_instruction) {
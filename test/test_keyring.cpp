@@ -0,0 +1,134 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "keyring"
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "keyring.hpp"
+#include "load_program.hpp"
+#include "machine.hpp"
+#include "runner.hpp"
+
+namespace {
+    /**
+     * Run a program that counts in V3 until key 0 is held, with key 0 pressed on cycle.
+     */
+    int count_until_pressed(uint64_t cycle) {
+        chip8::Machine machine;
+        load(machine, {
+            0x73, 0x01, // 0x200: ADD V3, 0x1
+            0xE0, 0x9E, // 0x202: SKP V0
+            0x12, 0x00, // 0x204: JMP 0x200
+            0x12, 0x06, // 0x206: JMP 0x206
+        });
+
+        chip8::KeyRing input;
+        BOOST_REQUIRE(input.push({cycle, 1 << 0}));
+
+        chip8::RunLimits limits;
+        limits.frames = 5;
+        chip8::RunStats stats;
+        chip8::run(machine, limits, input, stats, [](uint64_t) {
+            return true;
+        });
+        BOOST_CHECK_EQUAL(stats.instructions, 50u);
+        return machine.cpu().V[3];
+    }
+}
+
+BOOST_AUTO_TEST_CASE(keyring) {
+    chip8::KeyRing ring{3};
+    BOOST_CHECK_EQUAL(ring.capacity(), 4);
+    BOOST_CHECK(ring.front() == nullptr);
+
+    for (uint16_t i = 0; i < 4; i++) {
+        BOOST_CHECK(ring.push({i, i}));
+    }
+    BOOST_CHECK(!ring.push({4, 4}));
+
+    BOOST_REQUIRE(ring.front() != nullptr);
+    BOOST_CHECK_EQUAL(ring.front()->keys, 0);
+    ring.pop();
+    BOOST_CHECK(ring.push({4, 4}));
+
+    for (uint16_t expected = 1; expected <= 4; expected++) {
+        const chip8::KeyEvent *event = ring.front();
+        BOOST_REQUIRE(event != nullptr);
+        BOOST_CHECK_EQUAL(event->cycle, expected);
+        BOOST_CHECK_EQUAL(event->keys, expected);
+        ring.pop();
+    }
+    BOOST_CHECK(ring.front() == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(keyring_concurrent) {
+    const uint64_t count{200000};
+    chip8::KeyRing ring{16};
+
+    std::thread producer([&ring, count]() {
+        for (uint64_t i = 0; i < count; i++) {
+            while (!ring.push({i, static_cast<uint16_t>(i)})) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint64_t received{0};
+    bool ordered{true};
+    while (received < count) {
+        const chip8::KeyEvent *event = ring.front();
+        if (event == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered = ordered && event->cycle == received && event->keys == static_cast<uint16_t>(received);
+        ring.pop();
+        received++;
+    }
+    producer.join();
+
+    BOOST_CHECK(ordered);
+    BOOST_CHECK(ring.front() == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(events_land_on_their_cycle) {
+    // SKP runs on cycles 1, 4, 7, 10..., so a press on 7 is seen on 7 and a press on 8 not until 10
+    BOOST_CHECK_EQUAL(count_until_pressed(7), 3);
+    BOOST_CHECK_EQUAL(count_until_pressed(8), 4);
+    BOOST_CHECK_EQUAL(count_until_pressed(10), 4);
+    BOOST_CHECK_EQUAL(count_until_pressed(11), 5);
+
+    // Stamped in the past, so it applies straight away
+    BOOST_CHECK_EQUAL(count_until_pressed(0), 1);
+}
+
+BOOST_AUTO_TEST_CASE(waiting_machines_wake_on_the_events_cycle) {
+    chip8::Machine machine;
+    load(machine, {
+        0xF2, 0x0A, // 0x200: KEYD V2
+        0x12, 0x02, // 0x202: JMP 0x202
+    });
+
+    chip8::KeyRing input;
+    BOOST_REQUIRE(input.push({25, 1 << 0x7}));
+
+    chip8::RunLimits limits;
+    limits.frames = 3;
+    chip8::RunStats stats;
+    chip8::run(machine, limits, input, stats, [](uint64_t) {
+        return true;
+    });
+
+    // KEYD on cycle 0, then nothing until the press wakes it on 25, and JMP on 26 to 29
+    BOOST_CHECK_EQUAL(machine.cpu().V[2], 0x7);
+    BOOST_CHECK_EQUAL(stats.instructions, 6u);
+    BOOST_CHECK_EQUAL(stats.frames, 3u);
+    BOOST_CHECK(!stats.waitingForKey);
+}
+
+#pragma clang diagnostic pop
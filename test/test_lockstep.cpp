@@ -0,0 +1,134 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "lockstep"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "load_program.hpp"
+#include "lockstep.hpp"
+#include "programfuzzer.hpp"
+
+BOOST_AUTO_TEST_CASE(names_the_first_difference) {
+    chip8::cpu_t a;
+    chip8::cpu_t b;
+    a.reset();
+    b.reset();
+
+    chip8::Divergence divergence;
+    BOOST_CHECK(!chip8::find_difference(a, b, divergence));
+
+    b.fb.set(3, 7, true);
+    BOOST_REQUIRE(chip8::find_difference(a, b, divergence));
+    BOOST_CHECK_EQUAL(divergence.field, "fb.rows[7]");
+
+    b.memory.write(0x2A4, 0x12);
+    BOOST_REQUIRE(chip8::find_difference(a, b, divergence));
+    BOOST_CHECK_EQUAL(divergence.field, "memory[0x2a4]");
+    BOOST_CHECK_EQUAL(divergence.reference, "0x0");
+    BOOST_CHECK_EQUAL(divergence.candidate, "0x12");
+
+    b.stack.push(0x204);
+    BOOST_REQUIRE(chip8::find_difference(a, b, divergence));
+    BOOST_CHECK_EQUAL(divergence.field, "stack.size()");
+
+    b.V[3] = 1;
+    BOOST_REQUIRE(chip8::find_difference(a, b, divergence));
+    BOOST_CHECK_EQUAL(divergence.field, "V[3]");
+}
+
+BOOST_AUTO_TEST_CASE(passes_on_errors_both_machines_agree_on) {
+    chip8::Lockstep lockstep{chip8::Engine::cached};
+    load(lockstep, {
+        0x00, 0xEE, // 0x200: RET
+    });
+
+    BOOST_CHECK_THROW(lockstep.step(), chip8::MachineError);
+    BOOST_CHECK(!lockstep.diverged());
+}
+
+BOOST_AUTO_TEST_CASE(cached_engine_sees_code_rewritten_across_the_end_of_memory) {
+    // The instruction at 0xFFF takes its second byte from 0x000, and rewriting that byte must be noticed
+    std::vector<uint8_t> image(0xF8);
+    std::vector<uint8_t> code{
+        0xAF, 0xFF, // 0x200: LOADI 0xFFF
+        0x60, 0x12, // 0x202: MOV V0, 0x12
+        0xF0, 0x55, // 0x204: STOR V0, so 0xFFF holds JMP 0x2F0 with the font's first byte
+        0x1F, 0xFF, // 0x206: JMP 0xFFF
+    };
+    std::copy(code.begin(), code.end(), image.begin());
+    std::vector<uint8_t> rewrite{
+        0xA0, 0x00, // 0x2F0: LOADI 0x000
+        0x60, 0x10, // 0x2F2: MOV V0, 0x10
+        0xF0, 0x55, // 0x2F4: STOR V0, so 0xFFF now holds JMP 0x210
+        0x1F, 0xFF, // 0x2F6: JMP 0xFFF
+    };
+    std::copy(rewrite.begin(), rewrite.end(), image.begin() + 0xF0);
+    image[0x10] = 0x65; // 0x210: MOV V5, 0x1
+    image[0x11] = 0x01;
+
+    chip8::Lockstep lockstep{chip8::Engine::cached};
+    load(lockstep, image);
+    for (int i = 0; i < 11; i++) {
+        bool agreed = lockstep.step();
+        BOOST_REQUIRE_MESSAGE(agreed, lockstep.divergence().describe());
+    }
+    BOOST_CHECK_EQUAL(lockstep.candidate().cpu().V[5], 1);
+}
+
+BOOST_AUTO_TEST_CASE(cached_engine_sees_code_rewritten_through_an_address_past_the_end) {
+    chip8::Lockstep lockstep{chip8::Engine::cached};
+    load(lockstep, {
+        0x61, 0x22, // 0x200: MOV V1, 0x22
+        0x32, 0x01, // 0x202: SE V2, 0x1
+        0x12, 0x08, // 0x204: JMP 0x208
+        0x12, 0x06, // 0x206: JMP 0x206
+        0x72, 0x01, // 0x208: INC V2, 0x1
+        0xAF, 0x01, // 0x20A: LOADI 0xF01
+        0x63, 0xFF, // 0x20C: MOV V3, 0xff
+        0xF3, 0x1E, // 0x20E: ADD I, V3
+        0xF3, 0x1E, // 0x210: ADD I, V3
+        0xF3, 0x1E, // 0x212: ADD I, V3
+        0x63, 0x02, // 0x214: MOV V3, 0x2
+        0xF3, 0x1E, // 0x216: ADD I, V3
+        0x60, 0x61, // 0x218: MOV V0, 0x61
+        0x61, 0x77, // 0x21A: MOV V1, 0x77
+        0xF1, 0x55, // 0x21C: STOR V1, which with I at 0x1200 rewrites 0x200 as MOV V1, 0x77
+        0x12, 0x00, // 0x21E: JMP 0x200
+    });
+
+    for (int i = 0; i < 20; i++) {
+        bool agreed = lockstep.step();
+        BOOST_REQUIRE_MESSAGE(agreed, lockstep.divergence().describe());
+    }
+    BOOST_CHECK_EQUAL(lockstep.candidate().cpu().V[1], 0x77);
+}
+
+BOOST_AUTO_TEST_CASE(engines_agree_on_random_programs) {
+    chip8::Lockstep lockstep{chip8::Engine::cached};
+
+    for (uint64_t seed = 1; seed <= 2000; seed++) {
+        chip8::ProgramFuzzer fuzzer{seed};
+        std::vector<uint8_t> program = fuzzer.program(32);
+        load(lockstep, program);
+        lockstep.seed(fuzzer.seed());
+
+        try {
+            for (int frame = 0; frame < 8; frame++) {
+                lockstep.setKeys(fuzzer.keys());
+                if (!lockstep.runFrame(10)) {
+                    break;
+                }
+            }
+        } catch (const chip8::MachineError &) {
+        }
+
+        bool agreed = lockstep.check();
+        BOOST_REQUIRE_MESSAGE(agreed, "program " << seed << ": " << lockstep.divergence().describe());
+    }
+}
+
+#pragma clang diagnostic pop
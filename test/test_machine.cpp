@@ -0,0 +1,231 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "machine"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "load_program.hpp"
+#include "machine.hpp"
+#include "runner.hpp"
+
+BOOST_AUTO_TEST_CASE(jumps_and_calls_land_on_their_target) {
+    chip8::Machine machine;
+    load(machine, {
+        0x12, 0x04, // 0x200: JMP 0x204
+        0x00, 0x00, // 0x202: not reached
+        0x22, 0x0A, // 0x204: CALL 0x20A
+        0x61, 0x07, // 0x206: MOV V1, 0x7
+        0x00, 0x00, // 0x208: not reached
+        0x60, 0x03, // 0x20A: MOV V0, 0x3
+        0x00, 0xEE, // 0x20C: RET
+    });
+
+    machine.step();
+    BOOST_CHECK_EQUAL(machine.cpu().pc, 0x204);
+
+    machine.step();
+    BOOST_CHECK_EQUAL(machine.cpu().pc, 0x20A);
+
+    machine.step();
+    machine.step();
+    BOOST_CHECK_EQUAL(machine.cpu().pc, 0x206);
+    BOOST_CHECK_EQUAL(machine.cpu().V[0], 0x3);
+
+    machine.step();
+    BOOST_CHECK_EQUAL(machine.cpu().V[1], 0x7);
+}
+
+BOOST_AUTO_TEST_CASE(waits_for_a_key) {
+    chip8::Machine machine;
+    load(machine, {
+        0xF2, 0x0A, // 0x200: KEYD V2
+        0x61, 0x01, // 0x202: MOV V1, 0x1
+    });
+
+    machine.runFrame(5);
+    BOOST_CHECK(machine.waitingForKey());
+    BOOST_CHECK(!machine.step());
+
+    machine.setKeys(1 << 0xC);
+    BOOST_CHECK(!machine.waitingForKey());
+    BOOST_CHECK(machine.step());
+    BOOST_CHECK_EQUAL(machine.cpu().V[2], 0xC);
+
+    machine.step();
+    BOOST_CHECK_EQUAL(machine.cpu().V[1], 0x1);
+}
+
+BOOST_AUTO_TEST_CASE(timers_run_while_waiting_for_a_key) {
+    chip8::Machine machine;
+    load(machine, {
+        0x60, 0x05, // 0x200: MOV V0, 0x5
+        0xF0, 0x15, // 0x202: LOADD V0
+        0xF2, 0x0A, // 0x204: KEYD V2
+    });
+
+    machine.runFrame(10);
+    BOOST_CHECK(machine.waitingForKey());
+    BOOST_CHECK_EQUAL(machine.cpu().delayTimer, 4);
+
+    machine.runFrame(10);
+    BOOST_CHECK_EQUAL(machine.cpu().delayTimer, 3);
+
+    // A scheduler that parked the machine catches the timers up in one go
+    machine.tickTimers(100);
+    BOOST_CHECK_EQUAL(machine.cpu().delayTimer, 0);
+}
+
+BOOST_AUTO_TEST_CASE(runs_stop_when_the_movie_never_presses_a_key) {
+    chip8::Machine machine;
+    load(machine, {
+        0xF2, 0x0A, // 0x200: KEYD V2
+        0x12, 0x00, // 0x202: JMP 0x200
+    });
+
+    // Key 3 goes down on frame 2 and up on frame 3
+    chip8::Movie movie{{{2, 1 << 3}, {3, 0}}};
+    chip8::RunLimits limits;
+    limits.instructions = 1000;
+    chip8::RunStats stats;
+    chip8::run(machine, limits, movie, stats);
+
+    BOOST_CHECK(stats.waitingForKey);
+    BOOST_CHECK_EQUAL(stats.frames, 4u);
+    BOOST_CHECK_EQUAL(machine.cpu().V[2], 3);
+
+    // With a frame limit, waiting frames run to the limit but cost no instructions
+    load(machine, {0xF2, 0x0A});
+    limits.frames = 50;
+    stats = chip8::RunStats();
+    chip8::run(machine, limits, chip8::Movie(), stats);
+    BOOST_CHECK(!stats.waitingForKey);
+    BOOST_CHECK_EQUAL(stats.frames, 50u);
+    BOOST_CHECK_EQUAL(stats.instructions, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(frames_tick_the_timers) {
+    chip8::Machine machine;
+    load(machine, {
+        0x60, 0x02, // 0x200: MOV V0, 0x2
+        0xF0, 0x15, // 0x202: LOADD V0
+        0xF0, 0x18, // 0x204: LOADS V0
+        0x12, 0x06, // 0x206: JMP 0x206
+    });
+
+    machine.runFrame(3);
+    BOOST_CHECK_EQUAL(machine.cpu().delayTimer, 1);
+    BOOST_CHECK_EQUAL(machine.cpu().soundTimer, 1);
+
+    machine.runFrame(3);
+    machine.runFrame(3);
+    BOOST_CHECK_EQUAL(machine.cpu().delayTimer, 0);
+    BOOST_CHECK_EQUAL(machine.cpu().soundTimer, 0);
+}
+
+BOOST_AUTO_TEST_CASE(seed_makes_random_numbers_repeatable) {
+    std::vector<uint8_t> image{
+        0xC0, 0xFF, // 0x200: RND V0, 0xff
+        0xC1, 0xFF, // 0x202: RND V1, 0xff
+    };
+
+    chip8::Machine a;
+    chip8::Machine b;
+    load(a, image);
+    load(b, image);
+    a.seed(1234);
+    b.seed(1234);
+
+    a.runFrame(2);
+    b.runFrame(2);
+    BOOST_CHECK_EQUAL(a.cpu().V[0], b.cpu().V[0]);
+    BOOST_CHECK_EQUAL(a.cpu().V[1], b.cpu().V[1]);
+}
+
+BOOST_AUTO_TEST_CASE(reports_undecodable_instructions) {
+    for (chip8::Engine engine : {chip8::Engine::cached, chip8::Engine::decode}) {
+        chip8::Machine machine;
+        machine.setEngine(engine);
+        load(machine, {0xFF, 0xFF});
+
+        BOOST_CHECK_THROW(machine.step(), chip8::MachineError);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(engines_agree) {
+    std::vector<uint8_t> image{
+        0x60, 0x00, // 0x200: MOV V0, 0x0
+        0x61, 0x00, // 0x202: MOV V1, 0x0
+        0xA2, 0x10, // 0x204: LOADI 0x210
+        0xD0, 0x13, // 0x206: DRW V0, V1, 3
+        0x70, 0x09, // 0x208: INC V0, 0x9
+        0xC1, 0x1F, // 0x20A: RND V1, 0x1f
+        0x12, 0x06, // 0x20C: JMP 0x206
+        0x00, 0x00, // 0x20E: padding
+        0xE0, 0xA0, // 0x210: sprite
+        0xE0, 0x00,
+    };
+
+    chip8::Machine cached;
+    chip8::Machine decode;
+    decode.setEngine(chip8::Engine::decode);
+    BOOST_CHECK_EQUAL(chip8::engine_name(decode.engine()), "decode");
+    load(cached, image);
+    load(decode, image);
+
+    for (int frame = 0; frame < 20; frame++) {
+        cached.runFrame(10);
+        decode.runFrame(10);
+        BOOST_REQUIRE(cached.cpu().fb == decode.cpu().fb);
+        BOOST_REQUIRE_EQUAL(cached.cpu().pc, decode.cpu().pc);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(engines_agree_on_code_rewritten_through_a_wrapped_address) {
+    std::vector<uint8_t> image{
+        0x61, 0x22, // 0x200: MOV V1, 0x22
+        0x32, 0x01, // 0x202: SE V2, 0x1
+        0x12, 0x08, // 0x204: JMP 0x208
+        0x12, 0x06, // 0x206: JMP 0x206
+        0x72, 0x01, // 0x208: INC V2, 0x1
+        0xAF, 0x01, // 0x20A: LOADI 0xF01
+        0x63, 0xFF, // 0x20C: MOV V3, 0xff
+        0xF3, 0x1E, // 0x20E: ADD I, V3
+        0xF3, 0x1E, // 0x210: ADD I, V3
+        0xF3, 0x1E, // 0x212: ADD I, V3
+        0x63, 0x02, // 0x214: MOV V3, 0x2
+        0xF3, 0x1E, // 0x216: ADD I, V3
+        0x60, 0x61, // 0x218: MOV V0, 0x61
+        0x61, 0x77, // 0x21A: MOV V1, 0x77
+        0xF1, 0x55, // 0x21C: STOR V1, which with I at 0x1200 rewrites 0x200 as MOV V1, 0x77
+        0x12, 0x00, // 0x21E: JMP 0x200
+    };
+
+    chip8::Machine cached;
+    chip8::Machine decode;
+    decode.setEngine(chip8::Engine::decode);
+    load(cached, image);
+    load(decode, image);
+
+    for (int step = 0; step < 40; step++) {
+        cached.step();
+        decode.step();
+    }
+    BOOST_CHECK_EQUAL(decode.cpu().V[1], 0x77);
+    BOOST_CHECK_EQUAL(cached.cpu().V[1], decode.cpu().V[1]);
+    BOOST_CHECK_EQUAL(cached.cpu().pc, 0x206);
+}
+
+BOOST_AUTO_TEST_CASE(parses_engine_names) {
+    chip8::Engine engine{chip8::Engine::cached};
+    BOOST_CHECK(chip8::parse_engine("decode", engine));
+    BOOST_CHECK(engine == chip8::Engine::decode);
+    BOOST_CHECK(chip8::parse_engine("cached", engine));
+    BOOST_CHECK(engine == chip8::Engine::cached);
+    BOOST_CHECK(!chip8::parse_engine("jit", engine));
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,121 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "machinepool"
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "machinepool.hpp"
+
+namespace {
+    std::shared_ptr<const chip8::Rom> make_test_rom() {
+        std::vector<uint8_t> image{
+            0x61, 0x05, // 0x200: MOV V1, 0x5
+            0xA2, 0x00, // 0x202: MOV I, 0x200
+            0xF1, 0x55, // 0x204: STOR V1
+            0x12, 0x00, // 0x206: JMP 0x200
+        };
+        return chip8::make_rom(image.data(), image.size(), "test");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(hands_out_loaded_machines) {
+    auto rom = make_test_rom();
+    chip8::MachinePool pool{*rom, 4};
+    BOOST_CHECK_EQUAL(pool.available(), 4);
+
+    {
+        auto session = pool.acquire();
+        BOOST_CHECK_EQUAL(pool.available(), 3);
+        BOOST_CHECK_EQUAL(session->cpu().pc, chip8::PROGRAM_START);
+        BOOST_CHECK_EQUAL(session->cpu().memory[0x200], 0x61);
+        BOOST_CHECK_EQUAL(session->cpu().memory[chip8::FONT_DATA_OFFSET], chip8::FONT_DATA[0]);
+    }
+
+    BOOST_CHECK_EQUAL(pool.available(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(recycled_machines_start_over) {
+    auto rom = make_test_rom();
+    chip8::MachinePool pool{*rom, 1};
+
+    {
+        auto session = pool.acquire();
+        for (int i = 0; i < 3; i++) {
+            session->step();
+        }
+
+        // The program overwrote its own first instruction
+        BOOST_CHECK_EQUAL(session->cpu().memory[0x200], 0x00);
+        BOOST_CHECK_EQUAL(session->cpu().V[1], 0x05);
+    }
+
+    auto session = pool.acquire();
+    BOOST_CHECK_EQUAL(session->cpu().pc, chip8::PROGRAM_START);
+    BOOST_CHECK_EQUAL(session->cpu().V[1], 0);
+    BOOST_CHECK_EQUAL(session->cpu().memory[0x200], 0x61);
+    BOOST_CHECK_EQUAL(session->cpu().memory.privatePageCount(), 0);
+
+    session->step();
+    BOOST_CHECK_EQUAL(session->cpu().V[1], 0x05);
+}
+
+BOOST_AUTO_TEST_CASE(grows_past_capacity) {
+    auto rom = make_test_rom();
+    chip8::MachinePool pool{*rom, 2};
+
+    std::vector<chip8::MachinePool::Session> sessions;
+    for (int i = 0; i < 5; i++) {
+        sessions.push_back(pool.acquire());
+    }
+    BOOST_CHECK_EQUAL(pool.available(), 0);
+
+    sessions.clear();
+    BOOST_CHECK_EQUAL(pool.available(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_sessions) {
+    auto rom = make_test_rom();
+    chip8::MachinePool pool{*rom, 8};
+
+    std::vector<std::thread> threads;
+    std::vector<int> ok(4, 1);
+    for (std::size_t t = 0; t < ok.size(); t++) {
+        threads.emplace_back([&pool, &ok, t]() {
+            for (int i = 0; i < 2000; i++) {
+                auto session = pool.acquire();
+                if (session->cpu().V[1] != 0 || session->cpu().memory[0x200] != 0x61) {
+                    ok[t] = 0;
+                }
+                for (int step = 0; step < 3; step++) {
+                    session->step();
+                }
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (int threadOk : ok) {
+        BOOST_CHECK(threadOk);
+    }
+    // A push or pop that races another thread can fail spuriously, so the pool may have deleted a machine it had
+    // room for; it must never hold more than its capacity, and must fill back up once the threads are done
+    BOOST_CHECK_LE(pool.available(), pool.capacity());
+
+    std::vector<chip8::MachinePool::Session> sessions;
+    for (std::size_t i = 0; i < pool.capacity(); i++) {
+        sessions.push_back(pool.acquire());
+        BOOST_CHECK_EQUAL(sessions.back()->cpu().pc, 0x200);
+    }
+    sessions.clear();
+    BOOST_CHECK_EQUAL(pool.available(), pool.capacity());
+}
+
+#pragma clang diagnostic pop
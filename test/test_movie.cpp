@@ -0,0 +1,45 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "movie"
+
+#include <sstream>
+
+#include <boost/test/unit_test.hpp>
+
+#include "movie.hpp"
+
+BOOST_AUTO_TEST_CASE(plays_back_key_states) {
+    std::istringstream input{
+        "# Hold 5, then 5 and A, then let go\n"
+        "10 0020\n"
+        "\n"
+        "20 0420\n"
+        "30 0000\n"
+    };
+    chip8::Movie movie = chip8::parse_movie(input);
+
+    BOOST_CHECK_EQUAL(movie.events().size(), 3);
+    BOOST_CHECK_EQUAL(movie.keysAt(0), 0);
+    BOOST_CHECK_EQUAL(movie.keysAt(9), 0);
+    BOOST_CHECK_EQUAL(movie.keysAt(10), 0x0020);
+    BOOST_CHECK_EQUAL(movie.keysAt(25), 0x0420);
+    BOOST_CHECK_EQUAL(movie.keysAt(30), 0);
+    BOOST_CHECK_EQUAL(movie.keysAt(1000000), 0);
+}
+
+BOOST_AUTO_TEST_CASE(empty_movie_holds_nothing) {
+    chip8::Movie movie;
+    BOOST_CHECK(movie.empty());
+    BOOST_CHECK_EQUAL(movie.keysAt(42), 0);
+}
+
+BOOST_AUTO_TEST_CASE(rejects_malformed_movies) {
+    for (const char *text : {"10\n", "10 0020 3\n", "x 0020\n", "10 10000\n", "-1 0001\n", "20 0001\n10 0002\n"}) {
+        std::istringstream input{text};
+        BOOST_CHECK_THROW(chip8::parse_movie(input), chip8::MovieError);
+    }
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,115 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "pagedmemory"
+
+#include <array>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "instructions.hpp"
+#include "machine.hpp"
+#include "pagedmemory.hpp"
+#include "rom.hpp"
+
+namespace {
+    using memory_t = chip8::PagedMemory<256, 64>;
+
+    std::shared_ptr<const uint8_t> make_image() {
+        std::shared_ptr<uint8_t> image{new uint8_t[256], std::default_delete<uint8_t[]>()};
+        for (std::size_t i = 0; i < 256; i++) {
+            image.get()[i] = static_cast<uint8_t>(i);
+        }
+        return image;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(starts_out_zeroed) {
+    memory_t memory;
+    for (std::size_t i = 0; i < memory.size(); i++) {
+        BOOST_CHECK_EQUAL(memory[i], 0);
+    }
+    BOOST_CHECK_EQUAL(memory.privatePageCount(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(copies_a_page_on_first_write) {
+    auto image = make_image();
+    memory_t memory;
+    memory.share(image);
+
+    BOOST_CHECK_EQUAL(memory[0x81], 0x81);
+    BOOST_CHECK(!memory.isPrivate(0x81));
+
+    memory.write(0x81, 0xAA);
+    BOOST_CHECK_EQUAL(memory[0x81], 0xAA);
+    BOOST_CHECK_EQUAL(memory[0x80], 0x80);
+    BOOST_CHECK_EQUAL(memory[0xBF], 0xBF);
+    BOOST_CHECK(memory.isPrivate(0x81));
+    BOOST_CHECK_EQUAL(memory.privatePageCount(), 1);
+
+    // The image itself is untouched
+    BOOST_CHECK_EQUAL(image.get()[0x81], 0x81);
+}
+
+BOOST_AUTO_TEST_CASE(writes_across_pages_and_wraps) {
+    memory_t memory;
+    std::array<uint8_t, 4> data{{1, 2, 3, 4}};
+
+    memory.write(0x3E, data.data(), data.size());
+    BOOST_CHECK_EQUAL(memory[0x3E], 1);
+    BOOST_CHECK_EQUAL(memory[0x41], 4);
+    BOOST_CHECK_EQUAL(memory.privatePageCount(), 2);
+
+    memory.write(0xFF, data.data(), 2);
+    BOOST_CHECK_EQUAL(memory[0xFF], 1);
+    BOOST_CHECK_EQUAL(memory[0x00], 2);
+
+    std::array<uint8_t, 2> out{};
+    memory.read(0xFF, out.data(), out.size());
+    BOOST_CHECK_EQUAL(out[0], 1);
+    BOOST_CHECK_EQUAL(out[1], 2);
+}
+
+BOOST_AUTO_TEST_CASE(copies_are_independent) {
+    memory_t memory;
+    memory.share(make_image());
+    memory.write(0x10, 0xEE);
+
+    memory_t copy{memory};
+    BOOST_CHECK(copy == memory);
+
+    copy.write(0x10, 0x11);
+    copy.write(0x90, 0x22);
+    BOOST_CHECK_EQUAL(memory[0x10], 0xEE);
+    BOOST_CHECK_EQUAL(memory[0x90], 0x90);
+    BOOST_CHECK(copy != memory);
+}
+
+BOOST_AUTO_TEST_CASE(machines_share_rom_pages_until_stored_to) {
+    std::vector<uint8_t> image(0x100, 0x12);
+    auto rom = chip8::make_rom(image.data(), image.size(), "pages");
+
+    chip8::Machine a;
+    chip8::Machine b;
+    a.loadProgram(*rom);
+    b.loadProgram(*rom);
+
+    BOOST_CHECK_EQUAL(a.cpu().memory.privatePageCount(), 0);
+    BOOST_CHECK_EQUAL(a.cpu().memory[0x200], 0x12);
+    BOOST_CHECK_EQUAL(a.cpu().memory[chip8::FONT_DATA_OFFSET], chip8::FONT_DATA[0]);
+
+    // Only the page that is stored to gets copied
+    chip8::cpu_t cpu = a.cpu();
+    cpu.I = 0x280;
+    cpu.V[0] = 0x34;
+    chip8::StoreRegistersInstruction{0}.execute(cpu);
+
+    BOOST_CHECK_EQUAL(cpu.memory[0x280], 0x34);
+    BOOST_CHECK_EQUAL(cpu.memory.privatePageCount(), 1);
+    BOOST_CHECK_EQUAL(b.cpu().memory[0x280], 0x12);
+    BOOST_CHECK_EQUAL(b.cpu().memory.privatePageCount(), 0);
+}
+
+#pragma clang diagnostic pop
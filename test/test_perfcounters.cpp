@@ -0,0 +1,46 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "perfcounters"
+
+#include <boost/test/unit_test.hpp>
+
+#include "perfcounters.hpp"
+
+BOOST_AUTO_TEST_CASE(explains_missing_counters) {
+    chip8::PerfCounters counters;
+
+    for (std::size_t i = 0; i < chip8::PERF_COUNTER_COUNT; i++) {
+        if (!counters.available(static_cast<chip8::PerfCounter>(i))) {
+            BOOST_CHECK(!counters.error().empty());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(counts_only_the_available_counters) {
+    chip8::PerfCounters counters;
+
+    counters.start();
+    volatile uint64_t sum{0};
+    for (uint64_t i = 0; i < 100000; i++) {
+        sum = sum + i;
+    }
+    chip8::PerfSample sample = counters.stop();
+
+    for (std::size_t i = 0; i < chip8::PERF_COUNTER_COUNT; i++) {
+        // An available counter can still miss out on the hardware, if other users have it all
+        if (!counters.available(static_cast<chip8::PerfCounter>(i))) {
+            BOOST_CHECK(!sample.valid[i]);
+        }
+        if (!sample.valid[i]) {
+            BOOST_CHECK_EQUAL(sample.values[i], 0u);
+        }
+    }
+
+    if (sample.valid[chip8::PERF_INSTRUCTIONS]) {
+        BOOST_CHECK_GT(sample.values[chip8::PERF_INSTRUCTIONS], 100000u);
+    }
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,187 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "presenter"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "framebuffer.hpp"
+#include "machine.hpp"
+#include "presenter.hpp"
+#include "rom.hpp"
+#include "runner.hpp"
+#include "triplebuffer.hpp"
+#include "upscaler.hpp"
+
+namespace {
+    /**
+     * A frame that is all one number, so that a torn one, half old and half new, shows.
+     */
+    chip8::FrameBuffer frame_of(uint8_t number) {
+        chip8::FrameBuffer frame;
+        for (std::size_t y = 0; y < chip8::DISPLAY_HEIGHT; y++) {
+            for (std::size_t x = 0; x < chip8::DISPLAY_WIDTH; x += 8) {
+                frame.drawRow(x, y, number);
+            }
+        }
+        return frame;
+    }
+
+    bool torn(const chip8::FrameBuffer &frame) {
+        for (uint64_t row : frame.rows()) {
+            if (row != frame.rows()[0]) {
+                return true;
+            }
+        }
+        return (frame.rows()[0] >> 56) != (frame.rows()[0] & 0xFF);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(triplebuffer) {
+    chip8::TripleBuffer<int> buffer;
+    BOOST_CHECK(!buffer.update());
+
+    buffer.back() = 1;
+    BOOST_CHECK(buffer.publish());
+    BOOST_CHECK(buffer.update());
+    BOOST_CHECK_EQUAL(buffer.front(), 1);
+    BOOST_CHECK(!buffer.update());
+    BOOST_CHECK_EQUAL(buffer.front(), 1);
+
+    // Only the latest of several publishes gets through
+    buffer.back() = 2;
+    BOOST_CHECK(buffer.publish());
+    buffer.back() = 3;
+    BOOST_CHECK(!buffer.publish());
+    BOOST_CHECK(buffer.update());
+    BOOST_CHECK_EQUAL(buffer.front(), 3);
+
+    // The writer never gets the buffer the reader holds
+    buffer.back() = 4;
+    BOOST_CHECK(buffer.publish());
+    BOOST_CHECK_EQUAL(buffer.front(), 3);
+    BOOST_CHECK(buffer.update());
+    BOOST_CHECK_EQUAL(buffer.front(), 4);
+}
+
+BOOST_AUTO_TEST_CASE(triplebuffer_never_tears) {
+    chip8::TripleBuffer<std::array<uint64_t, 64>> buffer;
+    const uint64_t count{200000};
+
+    std::thread writer([&buffer, count]() {
+        for (uint64_t i = 1; i <= count; i++) {
+            buffer.back().fill(i);
+            buffer.publish();
+        }
+    });
+
+    uint64_t last{0};
+    bool whole{true};
+    bool ordered{true};
+    while (last < count) {
+        if (!buffer.update()) {
+            continue;
+        }
+        const std::array<uint64_t, 64> &value = buffer.front();
+        for (uint64_t word : value) {
+            whole = whole && word == value[0];
+        }
+        ordered = ordered && value[0] > last;
+        last = value[0];
+    }
+    writer.join();
+
+    BOOST_CHECK(whole);
+    BOOST_CHECK(ordered);
+}
+
+BOOST_AUTO_TEST_CASE(headless_presenter) {
+    std::atomic<int> tornFrames{0};
+    std::atomic<int> lastNumber{-1};
+    std::atomic<bool> outOfOrder{false};
+
+    chip8::Presenter<> presenter{[&](const chip8::FrameBuffer &frame, bool fresh, uint32_t) {
+        if (torn(frame)) {
+            tornFrames++;
+        }
+        int number = static_cast<int>(frame.rows()[0] & 0xFF);
+        if (fresh && number <= lastNumber.load() && lastNumber.load() >= 0) {
+            outOfOrder = true;
+        }
+        if (fresh) {
+            lastNumber = number;
+        }
+    }, std::chrono::microseconds(200)};
+
+    presenter.start();
+    for (int number = 1; number <= 250; number++) {
+        presenter.publish(frame_of(static_cast<uint8_t>(number)));
+        std::this_thread::sleep_for(std::chrono::microseconds(number % 2 == 0 ? 50 : 600));
+    }
+    presenter.stop();
+
+    chip8::PresentStats stats = presenter.stats();
+    BOOST_CHECK_EQUAL(tornFrames, 0);
+    BOOST_CHECK(!outOfOrder);
+
+    // Stopping shows the last frame
+    BOOST_CHECK_EQUAL(lastNumber, 250);
+    BOOST_CHECK_EQUAL(stats.published, 250u);
+    BOOST_CHECK_GT(stats.presented, 0u);
+
+    // Every frame published was either shown once or dropped, and every other refresh repeated one
+    BOOST_CHECK_EQUAL(stats.published - stats.dropped, stats.presented - stats.duplicated);
+}
+
+BOOST_AUTO_TEST_CASE(dirty_rows_keep_an_image_up_to_date) {
+    std::shared_ptr<const chip8::Rom> rom = chip8::load_rom(std::string(CHIP8_DATA_DIR) + "/games/BRIX");
+    chip8::Machine machine;
+    machine.loadProgram(*rom);
+
+    // The image starts out as garbage, and is only ever drawn a few rows at a time
+    chip8::Upscaler upscaler{3};
+    std::vector<uint8_t> image(upscaler.size(), 0x5A);
+    uint64_t freshFrames{0};
+    chip8::Presenter<> presenter{[&](const chip8::FrameBuffer &frame, bool fresh, uint32_t dirtyRows) {
+        if (fresh) {
+            upscaler.convert(frame, image.data(), dirtyRows);
+            freshFrames++;
+        }
+    }, std::chrono::microseconds(100)};
+
+    // Frames are published faster than they are shown, so that many are dropped, and their dirty rows must be
+    // carried over to the frames that are shown
+    presenter.start();
+    chip8::RunLimits limits;
+    limits.frames = 2000;
+    chip8::RunStats stats;
+    chip8::run(machine, limits, chip8::Movie(), stats, [&presenter, &machine](uint64_t frame) {
+        presenter.publish(machine.cpu().fb, machine.takeDirtyRows());
+        if (frame % 4 == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    });
+    presenter.stop();
+
+    std::vector<uint8_t> expected(upscaler.size());
+    upscaler.convert(machine.cpu().fb, expected.data());
+    BOOST_CHECK(image == expected);
+
+    chip8::PresentStats presented = presenter.stats();
+    BOOST_TEST_MESSAGE(presented.dropped << " of " << presented.published << " frames dropped, "
+                       << presented.dirtyRows << " of " << freshFrames * chip8::DISPLAY_HEIGHT << " rows converted");
+    BOOST_CHECK_GT(presented.dropped, 0u);
+    BOOST_CHECK_GT(freshFrames, 100u);
+    BOOST_CHECK_LT(presented.dirtyRows, freshFrames * chip8::DISPLAY_HEIGHT);
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,100 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "rom"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include "machine.hpp"
+#include "rom.hpp"
+
+namespace {
+    class TemporaryFile {
+    public:
+        explicit TemporaryFile(const std::vector<uint8_t> &contents) {
+            char name[] = "/tmp/chip8_rom_XXXXXX";
+            int fd = ::mkstemp(name);
+            ::close(fd);
+            mPath = name;
+
+            std::ofstream file{mPath, std::ios::binary};
+            file.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+        }
+
+        ~TemporaryFile() {
+            std::remove(mPath.c_str());
+        }
+
+        const std::string &path() const {
+            return mPath;
+        }
+
+    private:
+        std::string mPath;
+    };
+}
+
+BOOST_AUTO_TEST_CASE(loads_whitespace_bytes) {
+    // 0x20 and 0x09-0x0D used to be dropped by the istream_iterator based loader
+    std::vector<uint8_t> image{0x12, 0x20, 0x0A, 0x09, 0x0D, 0x0B, 0x0C, 0x20, 0x6A, 0x02};
+    TemporaryFile file{image};
+
+    auto rom = chip8::load_rom(file.path());
+    BOOST_CHECK_EQUAL(rom->info.size, image.size());
+    BOOST_CHECK_EQUAL_COLLECTIONS(rom->bytes.begin(), rom->bytes.end(), image.begin(), image.end());
+
+    chip8::Machine machine;
+    machine.loadProgram(*rom);
+    std::vector<uint8_t> loaded(image.size());
+    machine.cpu().memory.read(0x200, loaded.data(), loaded.size());
+    BOOST_CHECK_EQUAL_COLLECTIONS(loaded.begin(), loaded.end(), image.begin(), image.end());
+    BOOST_CHECK_EQUAL(machine.cpu().memory[0x200 + image.size()], 0);
+}
+
+BOOST_AUTO_TEST_CASE(rejects_oversized_images) {
+    std::vector<uint8_t> fits(0xE00, 0x00);
+    BOOST_CHECK_NO_THROW(chip8::make_rom(fits.data(), fits.size(), "fits"));
+
+    std::vector<uint8_t> tooBig(0xE01, 0x00);
+    BOOST_CHECK_THROW(chip8::make_rom(tooBig.data(), tooBig.size(), "too big"), chip8::RomError);
+
+    chip8::Machine machine;
+    BOOST_CHECK_THROW(machine.loadProgram(tooBig.data(), tooBig.size()), chip8::RomError);
+}
+
+BOOST_AUTO_TEST_CASE(catalog_reuses_loaded_roms) {
+    std::vector<uint8_t> image{0x60, 0x01, 0x12, 0x02};
+    TemporaryFile first{image};
+    TemporaryFile second{image};
+
+    chip8::RomCatalog catalog;
+    auto rom = catalog.load(first.path());
+
+    BOOST_CHECK_EQUAL(catalog.load(first.path()), rom);
+    BOOST_CHECK_EQUAL(catalog.load(second.path()), rom);
+    BOOST_CHECK_EQUAL(catalog.find(rom->info.hash), rom);
+    BOOST_CHECK_EQUAL(catalog.size(), 1);
+    BOOST_CHECK(catalog.find(rom->info.hash + 1) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(detects_quirks) {
+    std::vector<uint8_t> image{
+        0x81, 0x26, // SHR V1, V2
+        0xF3, 0x55, // STOR V3
+        0x12, 0x04, // JMP 0x204
+        0xB2, 0x00, // unreachable JUMPI
+    };
+
+    auto rom = chip8::make_rom(image.data(), image.size(), "quirks");
+    BOOST_CHECK_EQUAL(rom->info.quirks, chip8::QUIRK_SHIFT | chip8::QUIRK_LOAD_STORE);
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,175 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "rompack"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include "machine.hpp"
+#include "rompack.hpp"
+#include "sharedcode.hpp"
+
+namespace {
+    std::string temporary_path() {
+        char name[] = "/tmp/chip8_pack_XXXXXX";
+        int fd = ::mkstemp(name);
+        ::close(fd);
+        return name;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(round_trip) {
+    std::vector<uint8_t> pong{0x6A, 0x02, 0x12, 0x02};
+    std::vector<uint8_t> brix{0x20, 0x0A, 0x09, 0xFF, 0x00};
+
+    std::vector<std::shared_ptr<const chip8::Rom>> roms{
+        chip8::make_rom(pong.data(), pong.size(), "PONG"),
+        chip8::make_rom(brix.data(), brix.size(), "BRIX"),
+        chip8::make_rom(pong.data(), pong.size(), "PONG copy"),
+    };
+
+    std::string path = temporary_path();
+    chip8::write_rom_pack(path, roms);
+
+    chip8::RomPack pack{path};
+    BOOST_REQUIRE_EQUAL(pack.size(), 2);
+
+    std::size_t index = pack.find(roms[1]->info.hash);
+    BOOST_REQUIRE_LT(index, pack.size());
+
+    chip8::RomPack::Entry entry = pack.at(index);
+    BOOST_CHECK_EQUAL(entry.title, "BRIX");
+    BOOST_CHECK_EQUAL(entry.hash, chip8::content_hash(brix.data(), brix.size()));
+    BOOST_CHECK_EQUAL_COLLECTIONS(entry.data, entry.data + entry.size, brix.begin(), brix.end());
+
+    entry = pack.at(pack.find(roms[0]->info.hash));
+    BOOST_CHECK_EQUAL(entry.title, "PONG");
+
+    BOOST_CHECK_EQUAL(pack.find(0), pack.size());
+
+    // Images can be loaded straight out of the mapping
+    chip8::Machine machine;
+    machine.loadProgram(entry.data, entry.size);
+    BOOST_CHECK_EQUAL(machine.cpu().memory[0x200], 0x6A);
+
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(refuses_different_images_with_the_same_hash) {
+    // Real collisions are hard to come by, so force one
+    auto rom = [](std::vector<uint8_t> bytes, const std::string &title) {
+        auto made = std::make_shared<chip8::Rom>();
+        made->info.hash = 0x1234;
+        made->info.size = bytes.size();
+        made->info.title = title;
+        made->bytes = std::move(bytes);
+        return std::shared_ptr<const chip8::Rom>(made);
+    };
+
+    std::string path = temporary_path();
+    std::remove(path.c_str());
+
+    // The same image twice is stored once, whatever its hash
+    chip8::write_rom_pack(path, {rom({0x6A, 0x02}, "FIRST"), rom({0x6A, 0x02}, "SECOND")});
+    {
+        chip8::RomPack pack{path};
+        BOOST_REQUIRE_EQUAL(pack.size(), 1);
+        BOOST_CHECK_EQUAL(pack.at(pack.find(0x1234)).title, "FIRST");
+    }
+    std::remove(path.c_str());
+
+    // Different images would leave find() one of them to return, so the pack isn't written at all
+    BOOST_CHECK_THROW(chip8::write_rom_pack(path, {rom({0x6A, 0x02}, "FIRST"), rom({0x12, 0x00}, "SECOND")}),
+                      chip8::RomError);
+    BOOST_CHECK(!std::ifstream(path).good());
+}
+
+BOOST_AUTO_TEST_CASE(loads_roms_into_machines) {
+    std::vector<uint8_t> image{0x6A, 0x02, 0xA2, 0x0A, 0x12, 0x04};
+    auto original = chip8::make_rom(image.data(), image.size(), "LOOP");
+    std::string path = temporary_path();
+    chip8::write_rom_pack(path, {original});
+
+    chip8::RomPack pack{path};
+    BOOST_REQUIRE_EQUAL(pack.findTitle("LOOP"), 0);
+    BOOST_CHECK_EQUAL(pack.findTitle("LOO"), pack.size());
+
+    chip8::RomImage packed = pack.image(pack.findTitle("LOOP"));
+    BOOST_CHECK_EQUAL(packed.hash, original->info.hash);
+    BOOST_CHECK_EQUAL_COLLECTIONS(packed.data, packed.data + packed.size, original->bytes.begin(),
+                                  original->bytes.end());
+    BOOST_CHECK_THROW(pack.image(pack.size()), chip8::RomPackError);
+    BOOST_CHECK_THROW(pack.at(pack.size()), chip8::RomPackError);
+
+    // Machines loading it from the pack and from the file share their code
+    chip8::Machine fromPack;
+    fromPack.loadProgram(packed);
+    std::size_t shared{chip8::SharedCodeRegistry::global().size()};
+    chip8::Machine fromFile;
+    fromFile.loadProgram(*original);
+    BOOST_CHECK_EQUAL(chip8::SharedCodeRegistry::global().size(), shared);
+
+    fromPack.step();
+    fromPack.step();
+    BOOST_CHECK_EQUAL(fromPack.cpu().V[0xA], 0x02);
+    BOOST_CHECK_EQUAL(fromPack.cpu().I, 0x20A);
+
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_writers_never_leave_a_partial_pack) {
+    std::vector<std::shared_ptr<const chip8::Rom>> roms;
+    for (uint8_t i = 0; i < 64; i++) {
+        std::vector<uint8_t> image(512, i);
+        roms.push_back(chip8::make_rom(image.data(), image.size(), "ROM " + std::to_string(i)));
+    }
+
+    std::string path = temporary_path();
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 4; i++) {
+        writers.emplace_back([&path, &roms]() {
+            for (int j = 0; j < 10; j++) {
+                chip8::write_rom_pack(path, roms);
+            }
+        });
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+
+    chip8::RomPack pack{path};
+    BOOST_CHECK_EQUAL(pack.size(), roms.size());
+
+    std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(rejects_corrupt_packs) {
+    std::string path = temporary_path();
+
+    {
+        std::ofstream file{path, std::ios::binary};
+        file << "definitely not a pack file, but long enough to have a header in it........";
+    }
+    BOOST_CHECK_THROW(chip8::RomPack{path}, chip8::RomPackError);
+
+    std::vector<uint8_t> image{0x00, 0xE0};
+    chip8::write_rom_pack(path, {chip8::make_rom(image.data(), image.size(), "CLS")});
+    BOOST_CHECK_NO_THROW(chip8::RomPack{path});
+
+    // Chop off the image data
+    BOOST_REQUIRE_EQUAL(::truncate(path.c_str(), sizeof(chip8::RomPackHeader) + 8), 0);
+    BOOST_CHECK_THROW(chip8::RomPack{path}, chip8::RomPackError);
+
+    std::remove(path.c_str());
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,214 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "scheduler"
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "files.hpp"
+#include "load_program.hpp"
+#include "lockstep.hpp"
+#include "machine.hpp"
+#include "movie.hpp"
+#include "rom.hpp"
+#include "scheduler.hpp"
+
+namespace {
+    /**
+     * Check that a scheduled machine is exactly where running the same machine frame by frame leaves it.
+     */
+    void check_same(const chip8::Machine &plain, const chip8::Machine &scheduled, const std::string &context) {
+        chip8::Divergence divergence;
+        bool differs = chip8::find_difference(plain.cpu(), scheduled.cpu(), divergence);
+        BOOST_CHECK_MESSAGE(!differs, context << ": " << divergence.field << " is " << divergence.reference
+                                              << " run frame by frame but " << divergence.candidate << " scheduled");
+    }
+
+    const std::vector<uint8_t> DELAY_LOOP{
+        0x60, 0x1E, // 0x200: MOV V0, 0x1E
+        0xF0, 0x15, // 0x202: LOADD V0
+        0xF1, 0x07, // 0x204: MOV V1, DELAY
+        0x31, 0x00, // 0x206: SKE V1, 0x0
+        0x12, 0x04, // 0x208: JMP 0x204
+        0x65, 0x01, // 0x20A: MOV V5, 0x1
+        0x12, 0x0C, // 0x20C: JMP 0x20C
+    };
+}
+
+BOOST_AUTO_TEST_CASE(delay_loops_sleep_and_wake_exactly) {
+    for (unsigned ipf : {1u, 2u, 3u, 7u, 10u}) {
+        chip8::Machine plain;
+        chip8::Machine scheduled;
+        load(plain, DELAY_LOOP);
+        load(scheduled, DELAY_LOOP);
+
+        chip8::Scheduler scheduler{ipf};
+        chip8::Scheduler::SessionId id = scheduler.add(scheduled);
+
+        bool slept{false};
+        for (uint64_t frame = 0; frame < 40; frame++) {
+            plain.runFrame(ipf);
+            scheduler.runFrame();
+            slept = slept || scheduler.state(id) == chip8::SessionState::waitingForTimer;
+
+            // Looking catches the sleeper up part of the way, so look only now and then
+            if (frame % 9 == 4) {
+                check_same(plain, scheduler.machine(id), "ipf " + std::to_string(ipf) + " frame "
+                                                         + std::to_string(frame));
+            }
+        }
+
+        BOOST_CHECK(slept);
+        BOOST_CHECK(scheduler.state(id) == chip8::SessionState::halted);
+        check_same(plain, scheduler.machine(id), "ipf " + std::to_string(ipf) + " at the end");
+        BOOST_CHECK_EQUAL(scheduler.machine(id).cpu().V[5], 1);
+        BOOST_CHECK_GT(scheduler.stats().framesParked, 25u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sessions_waiting_for_a_key_cost_nothing) {
+    const std::size_t count{1000};
+    std::vector<std::unique_ptr<chip8::Machine>> machines;
+    chip8::Scheduler scheduler;
+    std::vector<chip8::Scheduler::SessionId> ids;
+    for (std::size_t i = 0; i < count; i++) {
+        machines.emplace_back(new chip8::Machine());
+        load(*machines.back(), {
+            0x60, 0x3C, // 0x200: MOV V0, 0x3C
+            0xF0, 0x18, // 0x202: LOADS V0
+            0xF2, 0x0A, // 0x204: KEYD V2
+            0x12, 0x06, // 0x206: JMP 0x206
+        });
+        ids.push_back(scheduler.add(*machines.back()));
+    }
+
+    for (int frame = 0; frame < 100; frame++) {
+        scheduler.runFrame();
+    }
+    BOOST_CHECK_EQUAL(scheduler.stats().framesRun, count);
+    BOOST_CHECK_EQUAL(scheduler.ready(), 0u);
+    BOOST_CHECK(scheduler.state(ids[7]) == chip8::SessionState::waitingForKey);
+
+    // Pressing a key wakes only that session, with its timers caught up
+    scheduler.setKeys(ids[7], 1 << 0xA);
+    BOOST_CHECK_EQUAL(scheduler.ready(), 1u);
+    BOOST_CHECK_EQUAL(scheduler.machine(ids[7]).cpu().soundTimer, 0);
+    scheduler.runFrame();
+
+    BOOST_CHECK_EQUAL(scheduler.stats().framesRun, count + 1);
+    BOOST_CHECK_EQUAL(scheduler.stats().wakeups, 1u);
+    BOOST_CHECK_EQUAL(scheduler.machine(ids[7]).cpu().V[2], 0xA);
+    BOOST_CHECK(scheduler.state(ids[7]) == chip8::SessionState::halted);
+    BOOST_CHECK_EQUAL(scheduler.machine(ids[8]).cpu().V[2], 0);
+}
+
+BOOST_AUTO_TEST_CASE(failed_and_removed_sessions) {
+    chip8::Machine broken;
+    chip8::Machine first;
+    chip8::Machine second;
+    load(broken, {0x00, 0x00});
+    load(first, DELAY_LOOP);
+    load(second, DELAY_LOOP);
+
+    chip8::Scheduler scheduler;
+    chip8::Scheduler::SessionId brokenId = scheduler.add(broken);
+    chip8::Scheduler::SessionId firstId = scheduler.add(first);
+    scheduler.runFrame();
+    BOOST_CHECK(scheduler.state(brokenId) == chip8::SessionState::failed);
+    BOOST_CHECK(!scheduler.error(brokenId).empty());
+    BOOST_CHECK(scheduler.state(firstId) == chip8::SessionState::waitingForTimer);
+
+    // The id is reused, and the old session's wake-up doesn't run the new one early
+    scheduler.remove(firstId);
+    BOOST_CHECK_EQUAL(scheduler.add(second), firstId);
+    for (int frame = 0; frame < 40; frame++) {
+        scheduler.runFrame();
+    }
+    BOOST_CHECK_EQUAL(scheduler.stats().wakeups, 1u);
+    BOOST_CHECK_EQUAL(scheduler.machine(firstId).cpu().V[5], 1);
+    BOOST_CHECK_EQUAL(first.cpu().V[5], 0);
+}
+
+BOOST_AUTO_TEST_CASE(removed_session_ids_are_ignored) {
+    chip8::Machine machine;
+    load(machine, {0xF0, 0x0A, 0x12, 0x02});
+
+    chip8::Scheduler scheduler;
+    chip8::Scheduler::SessionId id = scheduler.add(machine);
+    scheduler.runFrame();
+    BOOST_CHECK(scheduler.state(id) == chip8::SessionState::waitingForKey);
+
+    BOOST_CHECK(scheduler.remove(id));
+    BOOST_CHECK(!scheduler.contains(id));
+    BOOST_CHECK(!scheduler.remove(id));
+    BOOST_CHECK(!scheduler.setKeys(id, 1));
+    BOOST_CHECK(!scheduler.setKeys(id + 1, 1));
+    BOOST_CHECK_THROW(scheduler.machine(id), std::out_of_range);
+    BOOST_CHECK_EQUAL(machine.cpu().keys, 0);
+
+    // Removing twice didn't free the id twice, so two new sessions get different ones
+    chip8::Machine first;
+    chip8::Machine second;
+    load(first, {0x12, 0x00});
+    load(second, {0x12, 0x00});
+    chip8::Scheduler::SessionId firstId = scheduler.add(first);
+    chip8::Scheduler::SessionId secondId = scheduler.add(second);
+    BOOST_CHECK_NE(firstId, secondId);
+    BOOST_CHECK(scheduler.setKeys(firstId, 1));
+    BOOST_CHECK_EQUAL(first.cpu().keys, 1);
+    BOOST_CHECK_EQUAL(second.cpu().keys, 0);
+
+    scheduler.runFrame();
+    BOOST_CHECK_EQUAL(scheduler.stats().framesRun, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(every_rom_runs_as_it_does_on_its_own) {
+    std::vector<std::string> paths = chip8::list_roms(std::string(CHIP8_DATA_DIR) + "/games");
+    BOOST_REQUIRE(!paths.empty());
+    chip8::Movie movie = chip8::load_movie(std::string(CHIP8_DATA_DIR) + "/golden/input.movie");
+
+    for (unsigned ipf : {7u, 10u}) {
+        std::vector<std::unique_ptr<chip8::Machine>> plain;
+        std::vector<std::unique_ptr<chip8::Machine>> scheduled;
+        std::vector<chip8::Scheduler::SessionId> ids;
+        chip8::Scheduler scheduler{ipf};
+
+        for (const std::string &path : paths) {
+            std::shared_ptr<const chip8::Rom> rom = chip8::load_rom(path);
+            for (auto *machines : {&plain, &scheduled}) {
+                machines->emplace_back(new chip8::Machine());
+                machines->back()->loadProgram(*rom);
+                machines->back()->seed(0xC0FFEE);
+            }
+            ids.push_back(scheduler.add(*scheduled.back()));
+        }
+
+        for (uint64_t frame = 0; frame < 1500; frame++) {
+            uint16_t keys = movie.keysAt(frame);
+            for (std::size_t i = 0; i < paths.size(); i++) {
+                plain[i]->setKeys(keys);
+                scheduler.setKeys(ids[i], keys);
+                plain[i]->runFrame(ipf);
+            }
+            scheduler.runFrame();
+
+            if (frame % 97 == 96) {
+                for (std::size_t i = 0; i < paths.size(); i++) {
+                    check_same(*plain[i], scheduler.machine(ids[i]), paths[i] + " frame " + std::to_string(frame));
+                }
+            }
+        }
+
+        BOOST_TEST_MESSAGE("ipf " << ipf << ": " << scheduler.stats().framesRun << " frames run, "
+                                  << scheduler.stats().framesParked << " parked");
+        BOOST_CHECK_GT(scheduler.stats().framesParked, 0u);
+    }
+}
+
+#pragma clang diagnostic pop
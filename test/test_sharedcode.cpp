@@ -0,0 +1,102 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "sharedcode"
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "decodecache.hpp"
+#include "font.hpp"
+#include "instructions.hpp"
+#include "sharedcode.hpp"
+
+namespace {
+    std::shared_ptr<const chip8::Rom> make_test_rom() {
+        std::vector<uint8_t> image{
+            0x61, 0x05, // 0x200: MOV V1, 0x5
+            0x12, 0x00, // 0x202: JMP 0x200
+        };
+        return chip8::make_rom(image.data(), image.size(), "test");
+    }
+
+    void load(chip8::cpu_t &cpu, const chip8::Rom &rom) {
+        cpu.reset();
+        cpu.memory.write(chip8::FONT_DATA_OFFSET, chip8::FONT_DATA.data(), chip8::FONT_DATA.size());
+        cpu.memory.write(chip8::PROGRAM_START, rom.bytes.data(), rom.bytes.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(registry_shares_code_per_rom) {
+    chip8::SharedCodeRegistry registry;
+    auto rom = make_test_rom();
+
+    auto first = registry.acquire(*rom);
+    auto second = registry.acquire(*rom);
+    BOOST_CHECK_EQUAL(first, second);
+    BOOST_CHECK_EQUAL(registry.size(), 1);
+
+    first.reset();
+    second.reset();
+    BOOST_CHECK_EQUAL(registry.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(machines_share_until_they_modify_code) {
+    chip8::SharedCodeRegistry registry;
+    auto rom = make_test_rom();
+
+    chip8::cpu_t cpuA;
+    chip8::cpu_t cpuB;
+    load(cpuA, *rom);
+    load(cpuB, *rom);
+
+    chip8::DecodeCache cacheA;
+    chip8::DecodeCache cacheB;
+    cacheA.share(registry.acquire(*rom));
+    cacheB.share(registry.acquire(*rom));
+
+    const chip8::Instruction *sharedInstruction = cacheA.fetch(cpuA);
+    BOOST_REQUIRE(sharedInstruction != nullptr);
+    BOOST_CHECK_EQUAL(cacheB.fetch(cpuB), sharedInstruction);
+
+    // Machine A rewrites the immediate of its first instruction
+    cpuA.V[2] = 123;
+    cpuA.I = 0x201;
+    chip8::StoreDecimalInstruction{2}.execute(cpuA);
+
+    const chip8::Instruction *privateInstruction = cacheA.fetch(cpuA);
+    BOOST_REQUIRE(privateInstruction != nullptr);
+    BOOST_CHECK(privateInstruction != sharedInstruction);
+    BOOST_CHECK_EQUAL(privateInstruction->toString(), "MOV V1, 0x1");
+
+    // Machine B is unaffected
+    BOOST_CHECK_EQUAL(cacheB.fetch(cpuB), sharedInstruction);
+    BOOST_CHECK_EQUAL(cacheB.fetch(cpuB)->toString(), "MOV V1, 0x5");
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_lookups_agree) {
+    auto rom = make_test_rom();
+    chip8::SharedCode code{*rom};
+
+    std::vector<const chip8::Instruction *> seen(8);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < seen.size(); i++) {
+        threads.emplace_back([&code, &seen, i]() {
+            // Not reachable from the entry point, so nobody decoded it up front
+            seen[i] = code.fetch(0x300);
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (const auto *instruction : seen) {
+        BOOST_CHECK_EQUAL(instruction, seen[0]);
+    }
+}
+
+#pragma clang diagnostic pop
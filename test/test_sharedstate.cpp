@@ -0,0 +1,298 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "sharedstate"
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include "cpu.hpp"
+#include "machine.hpp"
+#include "rom.hpp"
+#include "runner.hpp"
+#include "sharedstate.hpp"
+
+namespace {
+    std::string segment_name(const char *test) {
+        return std::string("/chip8_") + test + "_" + std::to_string(::getpid());
+    }
+
+    /**
+     * The state a reader should see after each frame of a game.
+     */
+    struct Expected {
+        uint64_t rows[chip8::DISPLAY_HEIGHT];
+        uint8_t V[chip8::REGISTER_COUNT];
+        uint16_t pc;
+        uint16_t I;
+    };
+
+    bool matches(const chip8::SharedSnapshot &snapshot, const Expected &expected) {
+        return std::memcmp(snapshot.rows, expected.rows, sizeof(expected.rows)) == 0
+               && std::memcmp(snapshot.V, expected.V, sizeof(expected.V)) == 0
+               && snapshot.pc == expected.pc && snapshot.I == expected.I;
+    }
+
+    /**
+     * A forked process that is killed if the test gives up on it, so that a failed check can't leave it behind
+     * waiting on a pipe.
+     */
+    struct Child {
+        pid_t pid;
+
+        ~Child() {
+            if (pid > 0) {
+                ::kill(pid, SIGKILL);
+                ::waitpid(pid, nullptr, 0);
+            }
+        }
+
+        /**
+         * @return whether the process has exited, with how in status.
+         */
+        bool exited(int &status, int options = 0) {
+            if (::waitpid(pid, &status, options) != pid) {
+                return false;
+            }
+            pid = 0;
+            return true;
+        }
+    };
+
+    /**
+     * The test's ends of the pipes to and from a Child, closed however the test ends.
+     */
+    struct ParentEnds {
+        int fromChild;
+        int toChild;
+
+        ~ParentEnds() {
+            ::close(fromChild);
+            ::close(toChild);
+        }
+    };
+}
+
+BOOST_AUTO_TEST_CASE(publishes_machine_state) {
+    std::shared_ptr<const chip8::Rom> rom = chip8::load_rom(std::string(CHIP8_DATA_DIR) + "/games/PONG");
+    chip8::Machine machine;
+    machine.loadProgram(*rom);
+
+    std::string name = segment_name("publish");
+    BOOST_CHECK_THROW(chip8::SharedStateReader{name}, std::system_error);
+
+    chip8::SharedStateWriter writer{name};
+    BOOST_CHECK_THROW(chip8::SharedStateWriter{name}, std::system_error);
+    chip8::SharedStateReader reader{name};
+    chip8::SharedSnapshot snapshot{};
+    BOOST_CHECK(!reader.read(snapshot));
+    BOOST_CHECK_EQUAL(reader.sequence(), 0u);
+
+    chip8::RunLimits limits;
+    limits.frames = 100;
+    chip8::RunStats stats;
+    chip8::run(machine, limits, chip8::Movie(), stats, [&writer, &machine](uint64_t frame) {
+        writer.publish(machine.cpu(), frame + 1);
+        return true;
+    });
+
+    BOOST_CHECK_EQUAL(reader.sequence(), 200u);
+    BOOST_REQUIRE(reader.read(snapshot));
+    BOOST_CHECK_EQUAL(reader.retries(), 0u);
+
+    const chip8::cpu_t &cpu = machine.cpu();
+    BOOST_CHECK_EQUAL(snapshot.frame, 100u);
+    BOOST_CHECK(std::memcmp(snapshot.rows, cpu.fb.rows().data(), sizeof(snapshot.rows)) == 0);
+    BOOST_CHECK(std::memcmp(snapshot.V, cpu.V.data(), sizeof(snapshot.V)) == 0);
+    BOOST_CHECK_EQUAL(snapshot.pc, cpu.pc);
+    BOOST_CHECK_EQUAL(snapshot.I, cpu.I);
+    BOOST_CHECK_EQUAL(snapshot.delayTimer, cpu.delayTimer);
+    BOOST_CHECK_EQUAL(snapshot.soundTimer, cpu.soundTimer);
+    BOOST_CHECK_EQUAL(snapshot.keyWait, cpu.keyWait);
+    BOOST_REQUIRE_EQUAL(snapshot.stackDepth, cpu.stack.size());
+    for (std::size_t i = 0; i < cpu.stack.size(); i++) {
+        BOOST_CHECK_EQUAL(snapshot.stack[i], cpu.stack[i]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(readers_in_other_processes_never_see_torn_snapshots) {
+    std::shared_ptr<const chip8::Rom> rom = chip8::load_rom(std::string(CHIP8_DATA_DIR) + "/games/BRIX");
+    const uint64_t frames{3000};
+
+    // What every frame should look like, worked out before the writer starts
+    std::vector<Expected> expected;
+    {
+        chip8::Machine machine;
+        machine.loadProgram(*rom);
+        chip8::RunLimits limits;
+        limits.frames = frames;
+        chip8::RunStats stats;
+        chip8::run(machine, limits, chip8::Movie(), stats, [&expected, &machine](uint64_t) {
+            Expected state{};
+            std::memcpy(state.rows, machine.cpu().fb.rows().data(), sizeof(state.rows));
+            std::memcpy(state.V, machine.cpu().V.data(), sizeof(state.V));
+            state.pc = machine.cpu().pc;
+            state.I = machine.cpu().I;
+            expected.push_back(state);
+            return true;
+        });
+    }
+    BOOST_REQUIRE_EQUAL(expected.size(), frames);
+
+    std::string name = segment_name("processes");
+    int toReader[2];
+    int toWriter[2];
+    BOOST_REQUIRE_EQUAL(::pipe(toReader), 0);
+    BOOST_REQUIRE_EQUAL(::pipe(toWriter), 0);
+
+    pid_t writerPid = ::fork();
+    BOOST_REQUIRE_GE(writerPid, 0);
+    if (writerPid == 0) {
+        // The writer runs the game far faster than 60 Hz once the reader is there to watch, only pausing every few
+        // frames so that a reader built without optimisation gets a chance to copy a whole snapshot
+        ::close(toReader[0]);
+        ::close(toWriter[1]);
+        int status{0};
+        try {
+            chip8::SharedStateWriter writer{name};
+            char go;
+            if (::write(toReader[1], "r", 1) != 1 || ::read(toWriter[0], &go, 1) != 1) {
+                ::_exit(2);
+            }
+
+            chip8::Machine machine;
+            machine.loadProgram(*rom);
+            chip8::RunLimits limits;
+            limits.frames = frames;
+            chip8::RunStats stats;
+            chip8::run(machine, limits, chip8::Movie(), stats, [&writer, &machine](uint64_t frame) {
+                writer.publish(machine.cpu(), frame + 1);
+                if (frame % 8 == 0) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                return true;
+            });
+
+            // Keep the segment until the reader has seen the end
+            if (::read(toWriter[0], &go, 1) != 1) {
+                status = 2;
+            }
+        } catch (const std::exception &) {
+            status = 1;
+        }
+        ::_exit(status);
+    }
+
+    // With only the writer holding the other ends, reads see the end of the pipe rather than hang if it dies
+    Child writer{writerPid};
+    ::close(toReader[1]);
+    ::close(toWriter[0]);
+    ParentEnds pipes{toReader[0], toWriter[1]};
+
+    char created;
+    BOOST_REQUIRE_EQUAL(::read(pipes.fromChild, &created, 1), 1);
+    chip8::SharedStateReader reader{name};
+    BOOST_REQUIRE_EQUAL(::write(pipes.toChild, "g", 1), 1);
+
+    uint64_t reads{0};
+    uint64_t framesSeen{0};
+    uint64_t torn{0};
+    uint64_t last{0};
+    bool ordered{true};
+    chip8::SharedSnapshot snapshot{};
+    int status{0};
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    for (uint64_t polls = 1; last < frames; polls++) {
+        // The writer only exits early if something went wrong
+        if (polls % 4096 == 0 && (writer.exited(status, WNOHANG) || std::chrono::steady_clock::now() > deadline)) {
+            break;
+        }
+
+        if (!reader.read(snapshot)) {
+            continue;
+        }
+        reads++;
+        if (snapshot.frame < 1 || snapshot.frame > frames || !matches(snapshot, expected[snapshot.frame - 1])) {
+            torn++;
+        }
+        ordered = ordered && snapshot.frame >= last;
+        framesSeen += snapshot.frame != last;
+        last = snapshot.frame;
+    }
+    BOOST_REQUIRE_EQUAL(last, frames);
+    BOOST_REQUIRE_EQUAL(::write(pipes.toChild, "d", 1), 1);
+    BOOST_REQUIRE(writer.exited(status));
+    BOOST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    BOOST_TEST_MESSAGE(reads << " reads saw " << framesSeen << " of " << frames << " frames, with "
+                       << reader.retries() << " retries");
+    BOOST_CHECK_EQUAL(torn, 0u);
+    BOOST_CHECK(ordered);
+}
+
+BOOST_AUTO_TEST_CASE(takes_over_the_segment_of_a_writer_that_died_publishing) {
+    std::string name = segment_name("takeover");
+
+    // A writer that dies part way through publishing, leaving its segment behind with the sequence odd
+    pid_t writerPid = ::fork();
+    BOOST_REQUIRE_GE(writerPid, 0);
+    if (writerPid == 0) {
+        int status{0};
+        try {
+            chip8::SharedStateWriter writer{name};
+            chip8::SharedSnapshot snapshot{};
+            snapshot.frame = 1;
+            writer.publish(snapshot);
+
+            int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+            void *data = ::mmap(nullptr, sizeof(chip8::SharedStateSegment), PROT_READ | PROT_WRITE, MAP_SHARED,
+                                fd, 0);
+            if (data == MAP_FAILED) {
+                ::_exit(2);
+            }
+            static_cast<chip8::SharedStateSegment *>(data)->sequence.fetch_add(1);
+
+            // Without the writer's destructor, as if it had crashed
+            ::_exit(0);
+        } catch (const std::exception &) {
+            status = 1;
+        }
+        ::_exit(status);
+    }
+
+    Child dead{writerPid};
+    int status{0};
+    BOOST_REQUIRE(dead.exited(status));
+    BOOST_REQUIRE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    chip8::SharedStateReader reader{name};
+    chip8::SharedSnapshot snapshot{};
+    BOOST_CHECK_EQUAL(reader.sequence(), 3u);
+    BOOST_CHECK_THROW(reader.read(snapshot, std::chrono::milliseconds(10)), std::system_error);
+
+    chip8::SharedStateWriter writer{name};
+    BOOST_CHECK_THROW(chip8::SharedStateWriter{name}, std::system_error);
+    BOOST_CHECK_THROW(reader.read(snapshot, std::chrono::milliseconds(10)), std::system_error);
+
+    chip8::SharedSnapshot published{};
+    published.frame = 2;
+    writer.publish(published);
+    BOOST_CHECK_EQUAL(reader.sequence(), 4u);
+    BOOST_REQUIRE(reader.read(snapshot));
+    BOOST_CHECK_EQUAL(snapshot.frame, 2u);
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,209 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "translationcache"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include "machine.hpp"
+#include "translationcache.hpp"
+
+namespace {
+    class TemporaryDirectory {
+    public:
+        TemporaryDirectory() {
+            char name[] = "/tmp/chip8_cache_XXXXXX";
+            mPath = ::mkdtemp(name);
+        }
+
+        ~TemporaryDirectory() {
+            std::string command{"rm -rf " + mPath};
+            std::system(command.c_str());
+        }
+
+        const std::string &path() const {
+            return mPath;
+        }
+
+    private:
+        std::string mPath;
+    };
+
+    bool exists(const std::string &path) {
+        return ::access(path.c_str(), F_OK) == 0;
+    }
+
+    std::shared_ptr<const chip8::Rom> make_test_rom() {
+        std::vector<uint8_t> image{
+            0x22, 0x08, // 0x200: CALL 0x208
+            0x30, 0x01, // 0x202: SKE V0, 0x1
+            0x12, 0x02, // 0x204: JMP 0x202
+            0xB3, 0x00, // 0x206: JUMPI 0x300
+            0xA2, 0x0E, // 0x208: LOADI 0x20E
+            0xD0, 0x12, // 0x20A: DRW V0, V1, 2
+            0x00, 0xEE, // 0x20C: RET
+            0xFF, 0x81, // 0x20E: sprite
+        };
+        return chip8::make_rom(image.data(), image.size(), "test");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(round_trip) {
+    TemporaryDirectory directory;
+    chip8::TranslationCache cache{directory.path(), "build-1"};
+    auto rom = make_test_rom();
+
+    chip8::ControlFlowGraph graph;
+    BOOST_CHECK(!cache.load(*rom, graph));
+
+    chip8::ControlFlowGraph analyzed = cache.analyze(*rom);
+    BOOST_REQUIRE(exists(cache.pathFor(*rom)));
+
+    chip8::ControlFlowGraph loaded;
+    BOOST_REQUIRE(cache.load(*rom, loaded));
+
+    BOOST_CHECK(loaded.instructions == analyzed.instructions);
+    BOOST_CHECK(loaded.kinds == analyzed.kinds);
+    BOOST_CHECK(loaded.jumpTargets == analyzed.jumpTargets);
+    BOOST_CHECK(loaded.callTargets == analyzed.callTargets);
+    BOOST_CHECK(loaded.unresolvedJumps == analyzed.unresolvedJumps);
+    BOOST_CHECK(loaded.invalidInstructions == analyzed.invalidInstructions);
+    BOOST_REQUIRE_EQUAL(loaded.blocks.size(), analyzed.blocks.size());
+
+    for (const auto &entry : analyzed.blocks) {
+        const chip8::BasicBlock &block = loaded.blocks.at(entry.first);
+        BOOST_CHECK_EQUAL(block.start, entry.second.start);
+        BOOST_CHECK_EQUAL(block.end, entry.second.end);
+        BOOST_CHECK(block.successors == entry.second.successors);
+        BOOST_CHECK_EQUAL(block.unresolved, entry.second.unresolved);
+        BOOST_CHECK_EQUAL(block.returns, entry.second.returns);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(discards_entries_from_other_builds) {
+    TemporaryDirectory directory;
+    auto rom = make_test_rom();
+
+    chip8::TranslationCache oldBuild{directory.path(), "build-1"};
+    oldBuild.analyze(*rom);
+
+    chip8::TranslationCache newBuild{directory.path(), "build-2"};
+    chip8::ControlFlowGraph graph;
+    BOOST_CHECK(!newBuild.load(*rom, graph));
+    BOOST_CHECK(!exists(newBuild.pathFor(*rom)));
+}
+
+BOOST_AUTO_TEST_CASE(needs_a_build_id) {
+    // The build's own ID is a hash of its sources
+    BOOST_CHECK_EQUAL(std::string(CHIP8_BUILD_ID).size(), 16u);
+
+    TemporaryDirectory directory;
+    auto rom = make_test_rom();
+    chip8::TranslationCache unversioned{directory.path(), ""};
+    chip8::ControlFlowGraph analyzed = unversioned.analyze(*rom);
+    BOOST_CHECK(!analyzed.blocks.empty());
+    BOOST_CHECK(!exists(unversioned.pathFor(*rom)));
+}
+
+BOOST_AUTO_TEST_CASE(discards_corrupt_entries) {
+    TemporaryDirectory directory;
+    chip8::TranslationCache cache{directory.path(), "build-1"};
+    auto rom = make_test_rom();
+    cache.analyze(*rom);
+
+    {
+        std::fstream file{cache.pathFor(*rom), std::ios::binary | std::ios::in | std::ios::out};
+        file.seekp(200);
+        file.put('\x7f');
+    }
+
+    chip8::ControlFlowGraph graph;
+    BOOST_CHECK(!cache.load(*rom, graph));
+    BOOST_CHECK(!exists(cache.pathFor(*rom)));
+}
+
+BOOST_AUTO_TEST_CASE(threads_storing_the_same_entry_leave_a_complete_one) {
+    TemporaryDirectory directory;
+    chip8::TranslationCache cache{directory.path(), "build-1"};
+    auto rom = make_test_rom();
+    chip8::ControlFlowGraph graph = chip8::analyze_control_flow(rom->bytes.data(), rom->bytes.size(),
+                                                                chip8::PROGRAM_START);
+
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 4; i++) {
+        writers.emplace_back([&cache, &rom, &graph]() {
+            for (int j = 0; j < 50; j++) {
+                cache.store(*rom, graph);
+            }
+        });
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+
+    chip8::ControlFlowGraph loaded;
+    BOOST_CHECK(cache.load(*rom, loaded));
+
+    // Nothing but the entry itself is left behind
+    std::size_t files{0};
+    DIR *listing = ::opendir(directory.path().c_str());
+    BOOST_REQUIRE(listing != nullptr);
+    while (dirent *entry = ::readdir(listing)) {
+        files += entry->d_name[0] != '.';
+    }
+    ::closedir(listing);
+    BOOST_CHECK_EQUAL(files, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(rejects_other_roms_with_the_same_hash) {
+    TemporaryDirectory directory;
+    chip8::TranslationCache cache{directory.path(), "build-1"};
+    auto rom = make_test_rom();
+    cache.analyze(*rom);
+
+    // Same hash and size, different bytes
+    chip8::Rom collision{*rom};
+    collision.bytes[1] = 0x0A;
+
+    chip8::ControlFlowGraph graph;
+    BOOST_CHECK(!cache.load(collision, graph));
+    BOOST_CHECK(!exists(cache.pathFor(*rom)));
+}
+
+BOOST_AUTO_TEST_CASE(loading_a_program_uses_the_cache) {
+    TemporaryDirectory directory;
+    chip8::TranslationCache cache{directory.path(), "build-1"};
+    auto rom = make_test_rom();
+
+    {
+        chip8::Machine machine;
+        machine.loadProgram(*rom, &cache);
+        BOOST_CHECK(exists(cache.pathFor(*rom)));
+
+        machine.step();
+        BOOST_CHECK_EQUAL(machine.cpu().pc, 0x208);
+    }
+
+    // With nobody running the ROM any more, the next machine to load it gets the analysis from the cache
+    chip8::ControlFlowGraph graph;
+    BOOST_REQUIRE(cache.load(*rom, graph));
+    BOOST_CHECK(graph.isInstruction(0x208));
+
+    chip8::Machine machine;
+    machine.loadProgram(*rom, &cache);
+    machine.step();
+    machine.step();
+    BOOST_CHECK_EQUAL(machine.cpu().I, 0x20E);
+}
+
+#pragma clang diagnostic pop
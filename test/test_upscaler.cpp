@@ -0,0 +1,109 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "ClangTidyInspection"
+#pragma ide diagnostic ignored "OCUnusedMacroInspection"
+#define BOOST_TEST_DYN_LINK 1
+#define BOOST_TEST_MODULE "upscaler"
+
+#include <cstdint>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include "framebuffer.hpp"
+#include "upscaler.hpp"
+
+namespace {
+    chip8::FrameBuffer random_frame(uint64_t seed) {
+        chip8::FrameBuffer frame;
+        for (std::size_t y = 0; y < chip8::DISPLAY_HEIGHT; y++) {
+            for (std::size_t x = 0; x < chip8::DISPLAY_WIDTH; x++) {
+                seed = seed * 6364136223846793005 + 1442695040888963407;
+                frame.set(x, y, (seed >> 62) & 1);
+            }
+        }
+        return frame;
+    }
+
+    /**
+     * The image the upscaler should make, a pixel at a time.
+     */
+    std::vector<uint8_t> expected_image(const chip8::FrameBuffer &frame, unsigned scale, chip8::PixelFormat format,
+                                        const chip8::Palette &palette) {
+        std::vector<uint8_t> image;
+        for (std::size_t y = 0; y < chip8::DISPLAY_HEIGHT * scale; y++) {
+            for (std::size_t x = 0; x < chip8::DISPLAY_WIDTH * scale; x++) {
+                const chip8::Rgba &colour = frame.get(x / scale, y / scale) ? palette.on : palette.off;
+                if (format == chip8::PixelFormat::gray8) {
+                    image.push_back(static_cast<uint8_t>((colour.r * 77 + colour.g * 150 + colour.b * 29) >> 8));
+                } else {
+                    image.insert(image.end(), {colour.r, colour.g, colour.b, colour.a});
+                }
+            }
+        }
+        return image;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(every_kernel_draws_the_same_image) {
+    chip8::Palette palette;
+    palette.off = {0x10, 0x20, 0x30, 0xFF};
+    palette.on = {0xF0, 0xB0, 0x40, 0x80};
+    chip8::FrameBuffer frame = random_frame(42);
+
+    for (chip8::SimdKernel kernel : {chip8::SimdKernel::scalar, chip8::SimdKernel::sse2, chip8::SimdKernel::avx2}) {
+        if (!chip8::kernel_supported(kernel)) {
+            BOOST_TEST_MESSAGE("Skipping the " << chip8::kernel_name(kernel) << " kernel, which this host can't run");
+            continue;
+        }
+
+        for (chip8::PixelFormat format : {chip8::PixelFormat::rgba8, chip8::PixelFormat::gray8}) {
+            for (unsigned scale : {1u, 2u, 3u, 5u, 8u, 13u, 32u}) {
+                BOOST_TEST_CONTEXT(chip8::kernel_name(kernel) << " " << chip8::format_name(format) << " x" << scale) {
+                    chip8::Upscaler upscaler{scale, format, palette, kernel};
+                    BOOST_CHECK_EQUAL(upscaler.width(), 64 * scale);
+                    BOOST_CHECK_EQUAL(upscaler.height(), 32 * scale);
+
+                    std::vector<uint8_t> image(upscaler.size());
+                    upscaler.convert(frame, image.data());
+
+                    std::vector<uint8_t> expected = expected_image(frame, scale, format, palette);
+                    BOOST_CHECK(image == expected);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(default_palette_and_formats) {
+    chip8::FrameBuffer frame;
+    frame.set(0, 0, true);
+
+    chip8::Upscaler rgba{1};
+    std::vector<uint8_t> image(rgba.size());
+    rgba.convert(frame, image.data());
+    BOOST_CHECK_EQUAL(rgba.stride(), 256u);
+    BOOST_CHECK_EQUAL(image[0], 0xFF);
+    BOOST_CHECK_EQUAL(image[3], 0xFF);
+    BOOST_CHECK_EQUAL(image[4], 0x00);
+    BOOST_CHECK_EQUAL(image[7], 0xFF);
+
+    chip8::Upscaler gray{2, chip8::PixelFormat::gray8};
+    image.assign(gray.size(), 0x55);
+    gray.convert(frame, image.data());
+    BOOST_CHECK_EQUAL(gray.stride(), 128u);
+    BOOST_CHECK_EQUAL(image[0], 0xFF);
+    BOOST_CHECK_EQUAL(image[129], 0xFF);
+    BOOST_CHECK_EQUAL(image[2], 0x00);
+
+    chip8::PixelFormat format;
+    BOOST_CHECK(chip8::parse_format("gray", format) && format == chip8::PixelFormat::gray8);
+    BOOST_CHECK(chip8::parse_format("rgba", format) && format == chip8::PixelFormat::rgba8);
+    BOOST_CHECK(!chip8::parse_format("yuv", format));
+}
+
+BOOST_AUTO_TEST_CASE(rejects_bad_scales) {
+    BOOST_CHECK_THROW(chip8::Upscaler(0), chip8::UpscaleError);
+    BOOST_CHECK_THROW(chip8::Upscaler(chip8::Upscaler::MAX_SCALE + 1), chip8::UpscaleError);
+}
+
+#pragma clang diagnostic pop